@@ -0,0 +1,97 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "CommandLine.h"
+
+struct BenchOptions {
+    std::vector<std::size_t> series{8, 64};
+    std::vector<std::size_t> points{1000, 10000};
+    std::vector<std::size_t> threads{1, 4};
+    int repetitions = 7;
+    int min_time_ms = 50; // every repetition re-runs the benchmark until it was timed this long
+    std::string filter;      // only run benchmarks whose name contains this
+    std::string out_path;    // results JSON, stdout when empty
+    std::string baseline_path;
+    std::string against_path; // compare two result files without running the suite
+    double threshold = 0.05; // minimum relative change reported as a regression/improvement
+
+    static BenchOptions fromCommandLine(const CommandLine &cl);
+};
+
+struct BenchParams {
+    std::size_t series = 0;
+    std::size_t points = 0;
+    std::size_t threads = 1;
+};
+
+// One pass: prepare() builds fresh inputs untimed, then run(thread) is timed on `threads` threads
+// released together. run returns the number of operations it performed.
+struct Benchmark {
+    std::string name;
+    std::string unit; // what one operation is, e.g. "sample"
+    BenchParams params;
+    std::function<void()> prepare;
+    std::function<std::uint64_t(std::size_t thread)> run;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    BenchParams params;
+    std::uint64_t ops = 0; // per repetition
+    std::vector<double> ns_per_op; // one entry per repetition
+
+    [[nodiscard]] std::string key() const;
+
+    [[nodiscard]] double median() const;
+
+    // Half the min..max range relative to the median: how far repetitions of the same build wander.
+    [[nodiscard]] double spread() const;
+
+    [[nodiscard]] nlohmann::json toJson() const;
+
+    static BenchResult fromJson(const nlohmann::json &j);
+};
+
+// Keeps the compiler from optimising a computed value away.
+template<typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchOptions &options);
+
+    BenchResult measure(const Benchmark &benchmark) const;
+
+    static nlohmann::json toJson(const std::vector<BenchResult> &results, int repetitions);
+
+    static std::vector<BenchResult> fromJson(const nlohmann::json &j);
+
+    // Prints a per-benchmark comparison; returns the number of regressions, i.e. slowdowns
+    // larger than both the threshold and the run-to-run spread of either side.
+    static int compare(const std::vector<BenchResult> &baseline, const std::vector<BenchResult> &current,
+                       double threshold);
+
+private:
+    // Runs one prepared pass and returns its duration; ops receives the operation count.
+    static std::chrono::steady_clock::duration runPass(const Benchmark &benchmark, std::uint64_t &ops);
+
+    const BenchOptions &options_;
+};
+
+#endif //BENCH_H
@@ -0,0 +1,232 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace {
+    std::vector<std::size_t> parse_list(const std::string &text, const std::vector<std::size_t> &default_value) {
+        if (text.empty()) {
+            return default_value;
+        }
+        std::vector<std::size_t> values;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (!item.empty()) {
+                values.push_back(static_cast<std::size_t>(std::stoull(item)));
+            }
+        }
+        return values.empty() ? default_value : values;
+    }
+}
+
+BenchOptions BenchOptions::fromCommandLine(const CommandLine &cl) {
+    BenchOptions options;
+    options.series = parse_list(cl.getString("series"), options.series);
+    options.points = parse_list(cl.getString("points"), options.points);
+    options.threads = parse_list(cl.getString("threads"), options.threads);
+    options.repetitions = static_cast<int>(std::max(1LL, cl.getInt("repetitions", options.repetitions)));
+    options.min_time_ms = static_cast<int>(std::max(0LL, cl.getInt("min-time-ms", options.min_time_ms)));
+    options.filter = cl.getString("filter");
+    options.out_path = cl.getString("out");
+    options.baseline_path = cl.getString("compare");
+    options.against_path = cl.getString("against");
+    options.threshold = cl.getDouble("threshold", options.threshold);
+    return options;
+}
+
+std::string BenchResult::key() const {
+    return name + "/series=" + std::to_string(params.series) + "/points=" + std::to_string(params.points) +
+           "/threads=" + std::to_string(params.threads);
+}
+
+double BenchResult::median() const {
+    if (ns_per_op.empty()) {
+        return 0.0;
+    }
+    auto sorted = ns_per_op;
+    std::sort(sorted.begin(), sorted.end());
+    const auto mid = sorted.size() / 2;
+    return sorted.size() % 2 == 1 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2.0;
+}
+
+double BenchResult::spread() const {
+    const auto m = median();
+    if (ns_per_op.empty() || m <= 0.0) {
+        return 0.0;
+    }
+    const auto [lo, hi] = std::minmax_element(ns_per_op.begin(), ns_per_op.end());
+    return (*hi - *lo) / (2.0 * m);
+}
+
+nlohmann::json BenchResult::toJson() const {
+    return {
+        {"name", name},
+        {"unit", unit},
+        {"params", {{"series", params.series}, {"points", params.points}, {"threads", params.threads}}},
+        {"ops", ops},
+        {"ns_per_op", {
+            {"median", median()},
+            {"min", ns_per_op.empty() ? 0.0 : *std::min_element(ns_per_op.begin(), ns_per_op.end())},
+            {"max", ns_per_op.empty() ? 0.0 : *std::max_element(ns_per_op.begin(), ns_per_op.end())},
+            {"spread", spread()},
+            {"samples", ns_per_op}
+        }}
+    };
+}
+
+BenchResult BenchResult::fromJson(const nlohmann::json &j) {
+    BenchResult result;
+    result.name = j.at("name").get<std::string>();
+    result.unit = j.value("unit", "");
+    const auto &params = j.at("params");
+    result.params.series = params.value("series", std::size_t{0});
+    result.params.points = params.value("points", std::size_t{0});
+    result.params.threads = params.value("threads", std::size_t{1});
+    result.ops = j.value("ops", std::uint64_t{0});
+    result.ns_per_op = j.at("ns_per_op").at("samples").get<std::vector<double> >();
+    return result;
+}
+
+BenchRunner::BenchRunner(const BenchOptions &options): options_(options) {
+}
+
+BenchResult BenchRunner::measure(const Benchmark &benchmark) const {
+    BenchResult result;
+    result.name = benchmark.name;
+    result.unit = benchmark.unit;
+    result.params = benchmark.params;
+
+    const auto min_time = std::chrono::milliseconds(options_.min_time_ms);
+    // The first repetition warms caches and allocators and is not recorded.
+    for (int repetition = -1; repetition < options_.repetitions; ++repetition) {
+        std::chrono::steady_clock::duration elapsed{};
+        std::uint64_t total = 0;
+        do {
+            std::uint64_t ops = 0;
+            elapsed += runPass(benchmark, ops);
+            total += ops;
+        } while (elapsed < min_time && total > 0);
+
+        if (repetition < 0 || total == 0) {
+            continue;
+        }
+        result.ops = total;
+        result.ns_per_op.push_back(
+            static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+            static_cast<double>(total));
+    }
+    return result;
+}
+
+std::chrono::steady_clock::duration BenchRunner::runPass(const Benchmark &benchmark, std::uint64_t &ops) {
+    if (benchmark.prepare) {
+        benchmark.prepare();
+    }
+
+    const auto threads = std::max<std::size_t>(1, benchmark.params.threads);
+    if (threads == 1) {
+        const auto start = std::chrono::steady_clock::now();
+        ops = benchmark.run(0);
+        return std::chrono::steady_clock::now() - start;
+    }
+
+    std::vector<std::uint64_t> thread_ops(threads, 0);
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            thread_ops[t] = benchmark.run(t);
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ops = 0;
+    for (const auto n: thread_ops) {
+        ops += n;
+    }
+    return elapsed;
+}
+
+nlohmann::json BenchRunner::toJson(const std::vector<BenchResult> &results, int repetitions) {
+    nlohmann::json j;
+    j["suite"] = "perfmon-bench";
+    j["repetitions"] = repetitions;
+    j["hardware_threads"] = std::thread::hardware_concurrency();
+#ifdef NDEBUG
+    j["build"] = "release";
+#else
+    j["build"] = "debug";
+#endif
+    j["results"] = nlohmann::json::array();
+    for (const auto &result: results) {
+        j["results"].push_back(result.toJson());
+    }
+    return j;
+}
+
+std::vector<BenchResult> BenchRunner::fromJson(const nlohmann::json &j) {
+    std::vector<BenchResult> results;
+    for (const auto &entry: j.at("results")) {
+        results.push_back(BenchResult::fromJson(entry));
+    }
+    return results;
+}
+
+int BenchRunner::compare(const std::vector<BenchResult> &baseline, const std::vector<BenchResult> &current,
+                         double threshold) {
+    std::map<std::string, const BenchResult *> by_key;
+    for (const auto &result: baseline) {
+        by_key[result.key()] = &result;
+    }
+
+    int regressions = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto &result: current) {
+        const auto it = by_key.find(result.key());
+        if (it == by_key.end()) {
+            std::cout << "  new         " << result.key() << ": " << result.median() << " ns/" << result.unit << "\n";
+            continue;
+        }
+        const auto before = it->second->median();
+        const auto after = result.median();
+        if (before <= 0.0) {
+            continue;
+        }
+        const auto delta = (after - before) / before;
+        const auto noise = std::max({threshold, it->second->spread(), result.spread()});
+
+        const char *verdict = "  ok         ";
+        if (delta > noise) {
+            verdict = "  REGRESSION ";
+            ++regressions;
+        } else if (delta < -noise) {
+            verdict = "  improved   ";
+        }
+        std::cout << verdict << result.key() << ": " << before << " -> " << after << " ns/" << result.unit
+                << " (" << std::showpos << delta * 100.0 << std::noshowpos << "%, noise +-" << noise * 100.0
+                << "%)\n";
+    }
+    std::cout << std::defaultfloat << std::flush;
+    return regressions;
+}
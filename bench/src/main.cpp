@@ -0,0 +1,358 @@
+#include "Bench.h"
+#include "ClientData.h"
+#include "CommandLine.h"
+#include "Iso8601.h"
+#include "MetricDataPoint.h"
+#include "MetricStore.h"
+#include "SampleJson.h"
+#include "SessionRegistry.h"
+#ifdef __linux__
+#include "LinuxProcCollector.h"
+#include "LinuxProcessCollector.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+using json = nlohmann::json;
+
+namespace {
+    const auto base_time = std::chrono::system_clock::time_point(std::chrono::seconds(1750000000));
+
+    ClientData make_sample(std::size_t series) {
+        ClientData data;
+        data.clientId = "bench-client";
+        data.clientIp = "127.0.0.1";
+        data.timestamp = base_time;
+        for (std::size_t i = 0; i < series; ++i) {
+            data.metrics.push_back({"Counter " + std::to_string(i), static_cast<double>(i) * 1.5});
+        }
+        return data;
+    }
+
+    // Fresh stores for every repetition, one per thread so the threads only share the allocator.
+    void add_store_benchmarks(std::vector<Benchmark> &suite, const BenchParams &params) {
+        struct ThreadState {
+            std::unique_ptr<MetricStore> store;
+            ClientData data;
+            // Clients that only send changed counters: each message leaves out a different
+            // quarter of the counters, so the remaining ones shift position.
+            std::vector<ClientData> subsets;
+            MetricStore::SeriesCache cache;
+        };
+        auto states = std::make_shared<std::vector<ThreadState> >(params.threads);
+        auto prepare = [states, params]() {
+            for (auto &state: *states) {
+                state.store = std::make_unique<MetricStore>();
+                state.data = make_sample(params.series);
+                state.subsets.assign(4, state.data);
+                for (std::size_t k = 0; k < state.subsets.size(); ++k) {
+                    auto &metrics = state.subsets[k].metrics;
+                    metrics.clear();
+                    for (std::size_t i = 0; i < state.data.metrics.size(); ++i) {
+                        if (i % 4 != k) {
+                            metrics.push_back(state.data.metrics[i]);
+                        }
+                    }
+                }
+                state.cache.clear();
+            }
+        };
+
+        suite.push_back({
+            "store.addData", "sample", params, prepare, [states, params](std::size_t t) {
+                auto &state = (*states)[t];
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    state.data.timestamp += std::chrono::seconds(1);
+                    state.store->addData(state.data, state.cache);
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+        suite.push_back({
+            "store.addData.varying", "sample", params, prepare, [states, params](std::size_t t) {
+                auto &state = (*states)[t];
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    auto &data = state.subsets[i % state.subsets.size()];
+                    data.timestamp = base_time + std::chrono::seconds(i + 1);
+                    state.store->addData(data, state.cache);
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+        suite.push_back({
+            "store.addData.uncached", "sample", params, prepare, [states, params](std::size_t t) {
+                auto &state = (*states)[t];
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    state.data.timestamp += std::chrono::seconds(1);
+                    state.store->addData(state.data);
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+    }
+
+    void add_export_benchmark(std::vector<Benchmark> &suite, const BenchParams &params) {
+        auto store = std::make_shared<std::unique_ptr<MetricStore> >();
+        suite.push_back({
+            "store.exportToJson", "point", params, [store, params]() {
+                if (*store) {
+                    return;
+                }
+                *store = std::make_unique<MetricStore>();
+                auto data = make_sample(params.series);
+                MetricStore::SeriesCache cache;
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    data.timestamp += std::chrono::seconds(1);
+                    (*store)->addData(data, cache);
+                }
+            },
+            [store, params](std::size_t) {
+                const auto exported = (*store)->exportToJson();
+                doNotOptimize(exported);
+                return static_cast<std::uint64_t>(params.series * params.points);
+            }
+        });
+    }
+
+    void add_parse_benchmarks(std::vector<Benchmark> &suite, const BenchParams &params) {
+        auto timestamps = std::make_shared<std::vector<std::string> >();
+        suite.push_back({
+            "parse_iso8601", "call", params, [timestamps, params]() {
+                if (!timestamps->empty()) {
+                    return;
+                }
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    timestamps->push_back(format_iso8601(base_time + std::chrono::seconds(i * 37)));
+                }
+            },
+            [timestamps](std::size_t) {
+                std::chrono::system_clock::rep sum = 0;
+                for (const auto &timestamp: *timestamps) {
+                    sum += parse_iso8601(timestamp).time_since_epoch().count();
+                }
+                doNotOptimize(sum);
+                return static_cast<std::uint64_t>(timestamps->size());
+            }
+        });
+
+        auto counters = std::make_shared<json>(json::array());
+        suite.push_back({
+            "from_json.MetricDataPoint", "sample", params, [counters, params]() {
+                if (!counters->empty()) {
+                    return;
+                }
+                for (std::size_t i = 0; i < params.series; ++i) {
+                    counters->push_back({{"name", "Counter " + std::to_string(i)}, {"value", i * 1.5}});
+                }
+            },
+            [counters, params](std::size_t) {
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    const auto metrics = counters->get<std::vector<MetricDataPoint> >();
+                    doNotOptimize(metrics);
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+    }
+
+    void add_format_benchmark(std::vector<Benchmark> &suite, const BenchParams &params) {
+        auto counters = std::make_shared<std::vector<std::pair<std::string, double> > >();
+        for (std::size_t i = 0; i < params.series; ++i) {
+            counters->emplace_back("Counter " + std::to_string(i), static_cast<double>(i) * 1.5);
+        }
+        suite.push_back({
+            "format_sample_json", "sample", params, nullptr, [counters, params](std::size_t) {
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    const auto message = format_sample_json("bench-client", base_time, *counters);
+                    doNotOptimize(message);
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+    }
+    // Connection churn and iteration on a registry already holding `points` sessions. One
+    // insert_remove operation is a client connecting and disconnecting; forEach visits every
+    // session once, as broadcasts and the periodic stats do. Threads share the registry.
+    void add_registry_benchmarks(std::vector<Benchmark> &suite, const BenchParams &params) {
+        using Registry = ShardedRegistry<std::shared_ptr<int> >;
+        struct State {
+            std::unique_ptr<Registry> registry;
+            std::vector<std::shared_ptr<int> > values; // one per thread, so refcounts are not shared
+        };
+        auto state = std::make_shared<State>();
+        auto prepare = [state, params]() {
+            state->registry = std::make_unique<Registry>();
+            state->values.clear();
+            for (std::size_t t = 0; t < params.threads; ++t) {
+                state->values.push_back(std::make_shared<int>(static_cast<int>(t)));
+            }
+            for (std::size_t i = 0; i < params.points; ++i) {
+                state->registry->insert(std::make_shared<int>(0));
+            }
+        };
+
+        suite.push_back({
+            "registry.insert_remove", "connection", params, prepare, [state, params](std::size_t t) {
+                const auto &value = state->values[t];
+                for (std::size_t i = 0; i < params.points; ++i) {
+                    state->registry->remove(state->registry->insert(value));
+                }
+                return static_cast<std::uint64_t>(params.points);
+            }
+        });
+        suite.push_back({
+            "registry.forEach", "session", params, prepare, [state](std::size_t) {
+                std::uint64_t visited = 0;
+                state->registry->forEach([&visited](const std::shared_ptr<int> &value) {
+                    visited += value ? 1 : 0;
+                });
+                doNotOptimize(visited);
+                return visited;
+            }
+        });
+    }
+
+#ifdef __linux__
+    // One client tick on this host; independent of the series/points/threads parameters.
+    void add_collector_benchmark(std::vector<Benchmark> &suite) {
+        auto collector = std::make_shared<LinuxProcCollector>();
+        if (!collector->initialize()) {
+            return;
+        }
+        suite.push_back({
+            "collector.collect", "tick", {0, 100, 1}, nullptr, [collector](std::size_t) {
+                for (int i = 0; i < 100; ++i) {
+                    collector->collect();
+                }
+                doNotOptimize(collector->get_counters());
+                return std::uint64_t{100};
+            }
+        });
+    }
+
+    // One top-N scan of every process on this host; compare against the process interval for the
+    // collector's CPU share.
+    void add_process_benchmark(std::vector<Benchmark> &suite) {
+        auto collector = std::make_shared<LinuxProcessCollector>(5);
+        if (!collector->initialize()) {
+            return;
+        }
+        suite.push_back({
+            "process.collect", "tick", {0, 10, 1}, nullptr, [collector](std::size_t) {
+                for (int i = 0; i < 10; ++i) {
+                    collector->collect();
+                }
+                doNotOptimize(collector->get_counters());
+                return std::uint64_t{10};
+            }
+        });
+    }
+#endif
+
+    std::vector<Benchmark> build_suite(const BenchOptions &options) {
+        std::vector<Benchmark> suite;
+        for (const auto series: options.series) {
+            for (const auto points: options.points) {
+                for (const auto threads: options.threads) {
+                    const BenchParams params{series, points, threads};
+                    add_store_benchmarks(suite, params);
+                    add_parse_benchmarks(suite, params);
+                    add_format_benchmark(suite, params);
+                }
+                // exportToJson holds the store lock for the whole call; threads would only queue.
+                add_export_benchmark(suite, {series, points, 1});
+            }
+        }
+        // The registry holds sessions, not series: one copy per points/threads.
+        for (const auto points: options.points) {
+            for (const auto threads: options.threads) {
+                add_registry_benchmarks(suite, {0, points, threads});
+            }
+        }
+#ifdef __linux__
+        add_collector_benchmark(suite);
+        add_process_benchmark(suite);
+#endif
+
+        // parse_iso8601 does not depend on the series count; keep one copy per points/threads.
+        std::vector<Benchmark> filtered;
+        for (auto &benchmark: suite) {
+            if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            if (benchmark.name == "parse_iso8601") {
+                if (benchmark.params.series != options.series.front()) {
+                    continue;
+                }
+                benchmark.params.series = 0;
+            }
+            filtered.push_back(std::move(benchmark));
+        }
+        return filtered;
+    }
+
+    bool load_results(const std::string &path, std::vector<BenchResult> &out) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            return false;
+        }
+        try {
+            out = BenchRunner::fromJson(json::parse(in));
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << path << " is not a bench result file: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const CommandLine cl(argc, argv);
+    const auto options = BenchOptions::fromCommandLine(cl);
+
+    if (!options.against_path.empty()) {
+        std::vector<BenchResult> baseline, current;
+        if (options.baseline_path.empty() || !load_results(options.baseline_path, baseline) ||
+            !load_results(options.against_path, current)) {
+            std::cerr << "Usage: bench --compare=<baseline.json> --against=<current.json> [--threshold=0.05]" << std::endl;
+            return 2;
+        }
+        return BenchRunner::compare(baseline, current, options.threshold) > 0 ? 1 : 0;
+    }
+
+    const BenchRunner runner(options);
+    std::vector<BenchResult> results;
+    for (const auto &benchmark: build_suite(options)) {
+        results.push_back(runner.measure(benchmark));
+        const auto &result = results.back();
+        std::cerr << result.key() << ": " << result.median() << " ns/" << result.unit
+                << " (+-" << result.spread() * 100.0 << "%)" << std::endl;
+    }
+
+    const auto report = BenchRunner::toJson(results, options.repetitions);
+    if (options.out_path.empty()) {
+        // With --compare the comparison goes to stdout instead.
+        if (options.baseline_path.empty()) {
+            std::cout << report.dump(2) << std::endl;
+        }
+    } else {
+        std::ofstream out(options.out_path);
+        if (!out) {
+            std::cerr << "Error: Could not open file for writing: " << options.out_path << std::endl;
+            return 2;
+        }
+        out << report.dump(2) << std::endl;
+    }
+
+    if (!options.baseline_path.empty()) {
+        std::vector<BenchResult> baseline;
+        if (!load_results(options.baseline_path, baseline)) {
+            return 2;
+        }
+        return BenchRunner::compare(baseline, results, options.threshold) > 0 ? 1 : 0;
+    }
+    return 0;
+}
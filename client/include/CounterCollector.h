@@ -0,0 +1,31 @@
+#ifndef COUNTERCOLLECTOR_H
+#define COUNTERCOLLECTOR_H
+
+#include <vector>
+
+#include "MonitoredCounterData.h"
+
+// A source of host counters for PerformanceMonitor. The counter list is fixed once
+// initialize() succeeded; collect() refreshes the values in place. Slots keep their index but
+// may be renamed by collect() (LinuxProcessCollector's top-N).
+class CounterCollector {
+public:
+    virtual ~CounterCollector() = default;
+
+    virtual bool initialize() = 0;
+
+    virtual void uninitialize() = 0;
+
+    virtual bool collect() = 0;
+
+    // Refreshes at least the counters whose index is set in due; the others may keep their last
+    // values. Collectors that can only read everything at once keep this default.
+    virtual bool collect(const std::vector<bool> &due) {
+        (void) due;
+        return collect();
+    }
+
+    [[nodiscard]] virtual const std::vector<MonitoredCounterData> &get_counters() const = 0;
+};
+
+#endif //COUNTERCOLLECTOR_H
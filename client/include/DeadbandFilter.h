@@ -0,0 +1,60 @@
+#ifndef DEADBANDFILTER_H
+#define DEADBANDFILTER_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandLine.h"
+#include "MonitoredCounterData.h"
+
+struct DeadbandOptions {
+    // A value is reported once it moved more than max(absolute, relative% of the last reported
+    // value) away from the last reported one; both 0 reports every change.
+    struct Band {
+        double absolute = 0.0;
+        double relative = 0.0;
+    };
+
+    bool enabled = true;
+    Band default_band;
+    std::map<std::string, Band> counters; // per-counter overrides
+    std::chrono::seconds heartbeat{60};   // report unchanged values at least this often
+
+    // --deadband-counters="Available RAM (MB)=16;CPU Usage=2:5" sets absolute[:relative] per counter.
+    static DeadbandOptions fromCommandLine(const CommandLine &cl);
+};
+
+// Change-only reporting: drops counters that stayed within their deadband since they were last
+// reported, so the server receives the points where the step function changes plus a heartbeat.
+// Used from the monitor thread only, except reset().
+class DeadbandFilter {
+public:
+    explicit DeadbandFilter(DeadbandOptions options);
+
+    // The counters of data that are due for reporting; invalid counters are dropped as well.
+    // The result stays valid until the next call.
+    const std::vector<MonitoredCounterData> &filter(const std::vector<MonitoredCounterData> &data);
+
+    // Report every counter again on the next call, e.g. after reconnecting to a server that may
+    // have lost the series, or after reported values were dropped before reaching it.
+    void reset();
+
+private:
+    struct Reported {
+        double value = 0.0;
+        std::chrono::system_clock::time_point at;
+    };
+
+    [[nodiscard]] const DeadbandOptions::Band &bandFor(const std::string &name) const;
+
+    DeadbandOptions options_;
+    std::unordered_map<std::string, Reported> reported_;
+    std::vector<MonitoredCounterData> due_;
+    std::atomic<bool> reset_requested_{false};
+};
+
+#endif //DEADBANDFILTER_H
@@ -0,0 +1,85 @@
+#ifndef LINUXPROCCOLLECTOR_H
+#define LINUXPROCCOLLECTOR_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CounterCollector.h"
+
+// Linux backend: host CPU, memory, disk, network and pressure (PSI) counters from /proc. The
+// files are opened once and re-read with pread into one preallocated buffer; the parsers walk
+// that buffer in place, so a tick costs a handful of syscalls and no allocations. Sources the
+// kernel does not provide (e.g. /proc/pressure without CONFIG_PSI) leave their counters invalid.
+class LinuxProcCollector : public CounterCollector {
+public:
+    LinuxProcCollector();
+
+    ~LinuxProcCollector() override;
+
+    bool initialize() override;
+
+    void uninitialize() override;
+
+    bool collect() override;
+
+    // Only reads the /proc files behind the due counters.
+    bool collect(const std::vector<bool> &due) override;
+
+    [[nodiscard]] const std::vector<MonitoredCounterData> &get_counters() const override;
+
+private:
+    enum Source : std::size_t {
+        STAT, MEMINFO, DISKSTATS, NET_DEV, PRESSURE_CPU, PRESSURE_MEMORY, PRESSURE_IO, SOURCE_COUNT
+    };
+
+    enum Counter : std::size_t {
+        CPU_USAGE, CPU_IOWAIT, AVAILABLE_RAM, MEMORY_USED, SWAP_USED, DISK_READ, DISK_WRITE, DISK_BUSY,
+        NET_RECEIVED, NET_SENT, CPU_PRESSURE, MEMORY_PRESSURE, IO_PRESSURE, COUNTER_COUNT
+    };
+
+    struct DiskState {
+        std::string name;
+        std::uint64_t io_ticks_ms = 0;
+    };
+
+    bool collect_sources(const std::array<bool, SOURCE_COUNT> &sources);
+
+    std::string_view read_source(Source source);
+
+    // Seconds since the previous successful read of source (0 for the first), then marks now.
+    double elapsed(Source source, std::chrono::steady_clock::time_point now);
+
+    void set(Counter counter, double value);
+
+    void collect_cpu(std::string_view text, double seconds);
+
+    void collect_memory(std::string_view text);
+
+    void collect_disks(std::string_view text, double seconds);
+
+    void collect_network(std::string_view text, double seconds);
+
+    void collect_pressure(std::string_view text, double seconds, Source source, Counter counter);
+
+    std::vector<MonitoredCounterData> counters_{};
+    std::array<int, SOURCE_COUNT> fds_{};
+    std::array<std::chrono::steady_clock::time_point, SOURCE_COUNT> read_at_{};
+    std::vector<char> buffer_;
+    bool is_initialized_ = false;
+
+    std::uint64_t cpu_total_ = 0;
+    std::uint64_t cpu_idle_ = 0;
+    std::uint64_t cpu_iowait_ = 0;
+    std::vector<DiskState> disks_;
+    std::uint64_t disk_sectors_read_ = 0;
+    std::uint64_t disk_sectors_written_ = 0;
+    std::uint64_t net_received_ = 0;
+    std::uint64_t net_sent_ = 0;
+    std::array<std::uint64_t, SOURCE_COUNT> pressure_total_us_{};
+};
+
+#endif //LINUXPROCCOLLECTOR_H
@@ -0,0 +1,109 @@
+#ifndef LINUXPROCESSCOLLECTOR_H
+#define LINUXPROCESSCOLLECTOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+
+#include "CommandLine.h"
+#include "CounterCollector.h"
+
+struct ProcessOptions {
+    bool enabled = false;
+    std::size_t top = 5;
+    std::chrono::milliseconds interval{5000};
+    bool raise_fd_limit = false; // keep every stat file open, raising RLIMIT_NOFILE if needed
+
+    static ProcessOptions fromCommandLine(const CommandLine &cl) {
+        ProcessOptions options;
+        options.enabled = cl.getBool("processes", options.enabled);
+        options.top = static_cast<std::size_t>(std::max(1LL, cl.getInt("process-top", 5)));
+        options.interval = std::chrono::milliseconds(cl.getInt("process-interval-ms", options.interval.count()));
+        options.raise_fd_limit = cl.getBool("process-raise-fd-limit", options.raise_fd_limit);
+        return options;
+    }
+};
+
+// Per-process CPU and RSS from /proc/<pid>/stat, reduced to the top consumers. Processes are
+// grouped by command name, so the series stay the same across restarts and pid reuse. The
+// counters are fixed slots that are renamed each tick:
+//   "Process CPU (%)/<name>" x top, "Process CPU (%)/(other)",
+//   "Process RSS (MB)/<name>" x top, "Process RSS (MB)/(other)",
+//   then top ended slots each for CPU and RSS
+// CPU is in percent of one core since the previous tick; slots without a process are invalid.
+// A name that was in the top on the previous tick but no longer is gets one closing 0 in an
+// ended slot, so readers holding the last value of a series see it drop out.
+// The pid table and all buffers are reused between ticks: each process keeps its stat file open,
+// so a tick costs one pread per process and allocates only for processes it has not seen
+// before. Beyond the open file limit the remaining processes are opened and closed per tick;
+// raise_fd_limit lifts the soft limit towards 65536 first.
+class LinuxProcessCollector : public CounterCollector {
+public:
+    explicit LinuxProcessCollector(std::size_t top, bool raise_fd_limit = false);
+
+    ~LinuxProcessCollector() override;
+
+    bool initialize() override;
+
+    void uninitialize() override;
+
+    bool collect() override;
+
+    [[nodiscard]] const std::vector<MonitoredCounterData> &get_counters() const override;
+
+    [[nodiscard]] std::size_t get_process_count() const;
+
+private:
+    struct Process {
+        std::string name;
+        std::uint64_t start_ticks = 0; // tells a reused pid apart
+        std::uint64_t cpu_ticks = 0;
+        std::uint64_t generation = 0;
+        int fd = -1;
+    };
+
+    struct Usage {
+        double cpu = 0.0;
+        double rss = 0.0;
+        std::uint64_t generation = 0;
+    };
+
+    using Ranked = std::pair<const std::string *, const Usage *>;
+
+    bool read_process(int pid, double seconds);
+
+    // Reads /proc/<pid>/stat into buffer_ through the process' kept fd, opening it if needed.
+    std::size_t read_stat(int pid, Process &process);
+
+    void close_fd(Process &process);
+
+    void report(std::size_t first, std::size_t ended_first, std::vector<std::string> &previous_top,
+                std::string_view prefix, double Usage::*field, double total);
+
+    std::size_t top_;
+    bool raise_fd_limit_;
+    std::vector<MonitoredCounterData> counters_{};
+    DIR *proc_ = nullptr;
+    std::vector<char> buffer_;
+    double ticks_per_second_ = 100.0;
+    double page_mb_ = 4096.0 / (1024 * 1024);
+    bool is_initialized_ = false;
+    std::size_t max_open_ = 0;
+    std::size_t open_ = 0;
+
+    std::uint64_t generation_ = 0;
+    std::chrono::steady_clock::time_point read_at_{};
+    std::unordered_map<int, Process> processes_;
+    std::unordered_map<std::string, Usage> usage_;
+    std::vector<Ranked> ranked_;
+    std::vector<std::string> reported_cpu_; // names in the top on the last tick
+    std::vector<std::string> reported_rss_;
+};
+
+#endif //LINUXPROCESSCOLLECTOR_H
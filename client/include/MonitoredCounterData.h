@@ -0,0 +1,26 @@
+#ifndef MONITOREDCOUNTERDATA_H
+#define MONITOREDCOUNTERDATA_H
+
+#include <chrono>
+#include <string>
+
+#include "CounterSummary.h"
+
+// One counter as PerformanceMonitor hands it out, whichever backend produced it.
+struct MonitoredCounterData {
+    std::string counter_name;
+    double counter_value = 0.0;
+    // False until the backend produced a value, and whenever the last read of it failed.
+    bool valid = false;
+    std::chrono::system_clock::time_point timestamp;
+    // Filled when PerformanceMonitor reduces fast samples over a report window; counter_value is
+    // then the window mean.
+    CounterSummary summary;
+
+    explicit MonitoredCounterData(std::string counter_name)
+        : counter_name(std::move(counter_name)),
+          timestamp(std::chrono::system_clock::now()) {
+    }
+};
+
+#endif //MONITOREDCOUNTERDATA_H
@@ -0,0 +1,35 @@
+#ifndef PDHCOLLECTOR_H
+#define PDHCOLLECTOR_H
+
+#include <pdh.h>
+#include <string>
+#include <vector>
+
+#include "CounterCollector.h"
+#include "MonitoredPdhCounterData.h"
+
+// Windows backend: one PDH query holding every counter added before initialize().
+class PdhCollector : public CounterCollector {
+public:
+    PdhCollector();
+
+    ~PdhCollector() override;
+
+    bool add_counter(const std::string &counter_name, const std::wstring &pdh_counter_path);
+
+    bool initialize() override;
+
+    void uninitialize() override;
+
+    bool collect() override;
+
+    [[nodiscard]] const std::vector<MonitoredCounterData> &get_counters() const override;
+
+private:
+    std::vector<MonitoredPdhCounterData> pdh_counters_{};
+    std::vector<MonitoredCounterData> counters_{};
+    HQUERY hQuery_;
+    bool is_initialized_;
+};
+
+#endif //PDHCOLLECTOR_H
@@ -6,21 +6,28 @@
 #define PERFORMANCEMONITOR_H
 
 #include <chrono>
-#include <pdh.h>
+#include <memory>
 #include <string>
 #include <thread>
 #include <functional>
 #include <atomic>
+#include <condition_variable>
+#include <map>
 #include <mutex>
 
-#include "MonitoredPdhCounterData.h"
+#include "CounterCollector.h"
 
 
+// Samples run on wall-clock aligned deadlines (multiples of the interval since the epoch), so
+// samples from different hosts line up and a slow tick does not push the following ones back;
+// ticks missed while collecting took too long are skipped. Samples are stamped with their
+// deadline.
 class PerformanceMonitor {
 public:
-    explicit PerformanceMonitor(std::chrono::milliseconds sampling_time);
-
-    bool add_counter(const std::string &counter_name, const std::wstring &pdh_counter_path);
+    // With a report_interval longer than sampling_time, counters are sampled every sampling_time
+    // and the callback gets one summary per counter every report_interval.
+    PerformanceMonitor(std::unique_ptr<CounterCollector> collector, std::chrono::milliseconds sampling_time,
+                       std::chrono::milliseconds report_interval = std::chrono::milliseconds(0));
 
     bool initialize();
 
@@ -30,27 +37,51 @@ public:
 
     void stop_monitoring();
 
-    void set_callback(const std::function<void(const std::vector<MonitoredPdhCounterData> &)> &callback_fn_);
+    void set_callback(const std::function<void(const std::vector<MonitoredCounterData> &)> &callback_fn_);
+
+    // Samples the named counter every interval instead of every sampling_time; a counter that is
+    // not due is passed to the callback as invalid. Must be set before start_monitoring().
+    void set_counter_interval(const std::string &counter_name, std::chrono::milliseconds interval);
 
-    [[nodiscard]] std::vector<MonitoredPdhCounterData> get_current_snapshot() const;
+    [[nodiscard]] std::vector<MonitoredCounterData> get_current_snapshot() const;
 
     ~PerformanceMonitor();
 
 private:
     void monitoring_loop();
 
-    bool collect_pdh_counter_data();
+    void schedule(std::chrono::system_clock::time_point now);
+
+    void accumulate(const std::vector<MonitoredCounterData> &counters, const std::vector<bool> &due);
+
+    std::vector<MonitoredCounterData> take_report(const std::vector<MonitoredCounterData> &counters);
 
-    std::function<void(const std::vector<MonitoredPdhCounterData> &)> callback_fn_;
+    std::function<void(const std::vector<MonitoredCounterData> &)> callback_fn_;
 
-    std::vector<MonitoredPdhCounterData> pdh_counters_{};
+    std::unique_ptr<CounterCollector> collector_;
     std::chrono::milliseconds sampling_time_;
-    HQUERY hQuery_;
+    std::chrono::milliseconds report_interval_;
+    std::map<std::string, std::chrono::milliseconds> counter_intervals_;
+
+    // schedule, only touched on the monitor thread
+    std::vector<std::chrono::milliseconds> intervals_;
+    std::vector<std::chrono::system_clock::time_point> next_due_;
+    std::vector<bool> due_;
+    std::chrono::system_clock::time_point next_report_;
+
+    // report window, only touched on the monitor thread
+    struct CounterWindow {
+        std::vector<double> values;
+        double sum = 0.0;
+    };
+    std::vector<CounterWindow> windows_;
     bool is_initialized_;
 
     std::thread monitor_thread_;
     std::atomic<bool> is_monitoring_;
-    mutable std::mutex pdh_counter_mutex_;
+    mutable std::mutex counter_mutex_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
 };
 
 
@@ -0,0 +1,39 @@
+#ifndef RECONNECTOPTIONS_H
+#define RECONNECTOPTIONS_H
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "CommandLine.h"
+
+struct ReconnectOptions {
+    bool enabled = true;
+    std::chrono::milliseconds initial_delay{500};
+    std::chrono::milliseconds max_delay{30000};
+    std::chrono::seconds stable_after{10}; // a connection that lasted this long resets the backoff
+
+    // Full jitter: uniform in [0, min(max_delay, initial_delay * 2^attempt)]. Clients that lost
+    // the same server spread their reconnects over the whole window instead of arriving in waves.
+    template<typename Rng>
+    [[nodiscard]] std::chrono::milliseconds delayFor(unsigned attempt, Rng &rng) const {
+        auto cap = initial_delay.count();
+        for (unsigned i = 0; i < attempt && cap < max_delay.count(); ++i) {
+            cap *= 2;
+        }
+        cap = std::min<long long>(cap, max_delay.count());
+        std::uniform_int_distribution<long long> distribution(0, std::max<long long>(0, cap));
+        return std::chrono::milliseconds(distribution(rng));
+    }
+
+    static ReconnectOptions fromCommandLine(const CommandLine &cl) {
+        ReconnectOptions options;
+        options.enabled = cl.getBool("reconnect", options.enabled);
+        options.initial_delay = std::chrono::milliseconds(
+            cl.getInt("reconnect-initial-ms", options.initial_delay.count()));
+        options.max_delay = std::chrono::milliseconds(cl.getInt("reconnect-max-ms", options.max_delay.count()));
+        return options;
+    }
+};
+
+#endif //RECONNECTOPTIONS_H
@@ -0,0 +1,68 @@
+#ifndef SAMPLEJSON_H
+#define SAMPLEJSON_H
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "CounterSummary.h"
+#include "Iso8601.h"
+
+// One sample message as the server ingests it:
+//   {"clientId": ..., "counters": [{"name": ..., "value": ...}, ...], "timestamp": ...,
+//    "max_silence_ms": ...}
+// max_silence is the longest the client goes without reporting a counter it still has; the
+// server treats a series as a gap once that passed. Left out when zero.
+inline std::string format_sample_json(const std::string &client_id, std::chrono::system_clock::time_point timestamp,
+                                      const std::vector<std::pair<std::string, double> > &counters,
+                                      std::chrono::milliseconds max_silence = {}) {
+    nlohmann::json counters_array = nlohmann::json::array();
+    for (const auto &[name, value]: counters) {
+        counters_array.push_back({
+            {"name", name},
+            {"value", value}
+        });
+    }
+
+    nlohmann::json j = {
+        {"clientId", client_id},
+        {"timestamp", format_iso8601(timestamp)},
+        {"counters", counters_array}
+    };
+    if (max_silence.count() > 0) {
+        j["max_silence_ms"] = max_silence.count();
+    }
+
+    return j.dump();
+}
+
+// Same message for counters reduced over a report window (see CounterSummary).
+inline std::string format_summary_sample_json(const std::string &client_id,
+                                              std::chrono::system_clock::time_point timestamp,
+                                              const std::vector<std::pair<std::string, CounterSummary> > &counters,
+                                              std::chrono::milliseconds max_silence = {}) {
+    nlohmann::json counters_array = nlohmann::json::array();
+    for (const auto &[name, summary]: counters) {
+        counters_array.push_back({
+            {"name", name},
+            {"value", summary.mean},
+            {"summary", summary}
+        });
+    }
+
+    nlohmann::json j = {
+        {"clientId", client_id},
+        {"timestamp", format_iso8601(timestamp)},
+        {"counters", counters_array}
+    };
+    if (max_silence.count() > 0) {
+        j["max_silence_ms"] = max_silence.count();
+    }
+
+    return j.dump();
+}
+
+#endif //SAMPLEJSON_H
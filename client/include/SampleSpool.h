@@ -0,0 +1,122 @@
+#ifndef SAMPLESPOOL_H
+#define SAMPLESPOOL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "CommandLine.h"
+
+struct SpoolOptions {
+    bool enabled = true;
+    std::string directory = "spool";
+    std::size_t max_bytes = 64 << 20;   // oldest segments are dropped beyond this
+    std::size_t segment_bytes = 1 << 20;
+    std::size_t batch_bytes = 256 << 10; // one drained frame, well below the server's message limit
+    std::chrono::milliseconds drain_interval{250};
+    std::chrono::seconds ack_timeout{10};
+    unsigned max_attempts = 5; // unacked resends before a batch goes to the dead-letter file
+
+    static SpoolOptions fromCommandLine(const CommandLine &cl) {
+        SpoolOptions options;
+        options.enabled = cl.getBool("spool", options.enabled);
+        options.directory = cl.getString("spool-dir", options.directory);
+        options.max_bytes = static_cast<std::size_t>(cl.getInt("spool-max-mb", 64)) << 20;
+        options.batch_bytes = static_cast<std::size_t>(cl.getInt("spool-batch-kb", 256)) << 10;
+        options.drain_interval = std::chrono::milliseconds(
+            cl.getInt("spool-drain-interval-ms", options.drain_interval.count()));
+        options.max_attempts = static_cast<unsigned>(std::max(1LL, cl.getInt("spool-max-attempts", 5)));
+        return options;
+    }
+};
+
+// Store-and-forward buffer for samples taken while the client is offline: an append-only
+// directory of newline-delimited JSON segments, bounded by dropping the oldest segment. Samples
+// leave the spool in batches (one JSON array frame) whose last sample carries an ack token;
+// the batch is only removed once the server acked it, so a batch lost to a disconnect is sent
+// again. A batch that is still not acked after max_attempts timeouts is moved to dead-letter.log
+// (one JSON array per line) so it cannot stall the drain. The read position survives restarts
+// in spool.pos.
+class SampleSpool {
+public:
+    struct Status {
+        std::uint64_t pending_bytes = 0;
+        std::uint64_t pending_samples = 0;
+        std::uint64_t dropped_samples = 0;
+        std::uint64_t dead_letter_samples = 0;
+    };
+
+    explicit SampleSpool(SpoolOptions options);
+
+    ~SampleSpool();
+
+    // Creates the directory and picks up segments left by a previous run.
+    bool open(std::string &error);
+
+    void append(const std::string &sample);
+
+    [[nodiscard]] bool empty() const;
+
+    // The next batch to send, or false if the spool is drained or a batch still waits for its
+    // ack. A batch not acked within ack_timeout is handed out again.
+    bool nextBatch(std::string &frame);
+
+    // Removes the in-flight batch if token is its ack token; returns whether it was.
+    bool acknowledge(std::uint64_t token);
+
+    // The connection dropped: hand the in-flight batch out again on the next call.
+    void requeueInFlight();
+
+    [[nodiscard]] Status getStatus() const;
+
+private:
+    struct Segment {
+        std::uint64_t seq = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t samples = 0;
+    };
+
+    [[nodiscard]] std::string segmentPath(std::uint64_t seq) const;
+
+    void startSegment();
+
+    void retireFront();
+
+    void dropOldest();
+
+    void savePosition();
+
+    // Moves the read position past the in-flight batch.
+    void completeBatch();
+
+    void deadLetterBatch();
+
+    SpoolOptions options_;
+    mutable std::mutex mutex_;
+    std::deque<Segment> segments_; // oldest first; the back one is being written
+    std::ofstream writer_;
+    std::uint64_t next_seq_ = 1;
+    std::uint64_t total_bytes_ = 0;
+    std::uint64_t total_samples_ = 0;
+    std::uint64_t dropped_samples_ = 0;
+    std::uint64_t dead_letter_samples_ = 0;
+
+    // Read position within the oldest segment.
+    std::uint64_t read_offset_ = 0;
+    std::uint64_t read_samples_ = 0;
+
+    // In-flight batch: read_offset_ + batch_bytes_ is where the next one starts.
+    std::string batch_;
+    std::uint64_t batch_token_ = 0;
+    std::uint64_t batch_bytes_ = 0;
+    std::uint64_t batch_samples_ = 0;
+    std::chrono::steady_clock::time_point batch_sent_{};
+    unsigned batch_timeouts_ = 0;
+    std::uint64_t next_token_ = 1;
+};
+
+#endif //SAMPLESPOOL_H
@@ -3,33 +3,81 @@
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <string>
 
+#include "CompressionOptions.h"
+#include "CompressionStats.h"
+#include "FlowControl.h"
+#include "ReconnectOptions.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+
+// Passed to the send callback once per written frame.
+struct SendReport {
+    boost::beast::error_code ec;
+    std::size_t bytes = 0;       // frame size before compression
+    std::size_t messages = 0;    // send() calls coalesced into the frame
+    std::size_t queue_depth = 0; // messages still waiting for the writer
+    std::chrono::nanoseconds queued{0}; // oldest message: send() -> write start
+    std::chrono::nanoseconds write{0};  // async_write duration
+};
+
 class WSClient {
 public:
-    WSClient(boost::asio::io_context &ioc, const std::string &host_, const std::string &port_);
+    WSClient(boost::asio::io_context &ioc, const std::string &host_, const std::string &port_,
+             CompressionOptions compression_options = {});
 
     ~WSClient();
 
     void connect();
 
+    // Also stops reconnecting.
     void disconnect();
 
-    void send(const std::string &message);
+    // Messages must be JSON values: while the server withholds credits or the connection is
+    // down they are queued and later sent as one JSON array frame. Messages that pile up behind
+    // a running write are coalesced the same way.
+    void send(std::string message);
+
+    void applyFlowControl(const FlowControlMessage &message);
+
+    void setMinimumResolution(std::chrono::milliseconds minimum_resolution);
+
+    void setMaxPendingMessages(std::size_t max_pending_messages);
+
+    // Messages queued while offline wait for the server's first credit grant after a reconnect.
+    // A server without flow control gets them as one coalesced frame per interval.
+    void setPendingDrainInterval(std::chrono::milliseconds interval);
+
+    // Largest frame built by coalescing queued messages; 0 writes every message as its own frame.
+    void setMaxCoalescedBytes(std::size_t max_coalesced_bytes);
+
+    // After a failed connect or a lost connection, connect again with a new stream. The connect
+    // callback then runs once per attempt.
+    void enableReconnect(const ReconnectOptions &options);
+
+    [[nodiscard]] std::size_t getDroppedCount() const;
 
     [[nodiscard]] bool isConnected() const;
 
+    [[nodiscard]] const CompressionStats &getCompressionStats() const;
+
+    // Called once per server message; batched array frames are split before delivery.
     void setOnMessageCallback(std::function<void(const std::string &)> on_message_callback);
 
     void setOnConnectCallback(std::function<void(const boost::beast::error_code &)> on_connect_callback);
 
-    void setOnSendCallback(std::function<void(const boost::beast::error_code &)> on_send_callback);
+    void setOnSendCallback(std::function<void(const SendReport &)> on_send_callback);
 
 private:
     std::function<void(const std::string &)> on_message_callback_;
     std::function<void(const boost::beast::error_code &)> on_connect_callback_;
-    std::function<void(const boost::beast::error_code &)> on_send_callback_;
+    std::function<void(const SendReport &)> on_send_callback_;
     std::mutex callbacks_mutex_;
 
     std::string host_;
@@ -37,14 +85,76 @@ private:
 
     boost::asio::ip::tcp::resolver resolver_;
     boost::asio::io_context &ioc_;
-    boost::beast::websocket::stream<boost::beast::tcp_stream> ws_;
+    CompressionOptions compression_options_;
+    CompressionStats compression_stats_;
+    std::unique_ptr<boost::beast::websocket::stream<MeteredTcpStream> > ws_;
     boost::beast::flat_buffer buffer_;
 
     std::atomic<bool> is_connected_{false};
+    bool batch_frames_ = false; // the server accepted BatchFrames::subprotocol
+
+    // reconnect state, only touched on the ioc_ thread; handlers of a replaced stream see a
+    // stale generation_ and return
+    ReconnectOptions reconnect_options_;
+    bool reconnect_ = false;
+    bool stopping_ = false;
+    bool reconnect_pending_ = false;
+    unsigned reconnect_attempt_ = 0;
+    std::uint64_t generation_ = 0;
+    std::chrono::steady_clock::time_point connected_at_{};
+    boost::asio::steady_timer reconnect_timer_;
+    std::mt19937 rng_{std::random_device{}()};
+    boost::asio::steady_timer drain_timer_;
+    std::chrono::milliseconds pending_drain_interval_{250};
+
+    // flow control state, only touched on the ioc_ thread
+    bool flow_active_ = false;
+    int credits_ = 0;
+    int throttle_ = 0;
+    std::deque<std::string> pending_;
+    std::chrono::steady_clock::time_point last_queued_{};
+    std::chrono::milliseconds minimum_resolution_{std::chrono::seconds(30)};
+    std::size_t max_pending_messages_ = 1024;
+    std::atomic<std::size_t> dropped_count_{0};
+
+    // Beast allows one async_write at a time; messages wait here. Only touched on the ioc_ thread.
+    struct QueuedMessage {
+        std::string payload;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    std::deque<QueuedMessage> write_queue_;
+    bool writing_ = false;
+    std::string in_flight_;
+    std::size_t in_flight_messages_ = 0;
+    std::chrono::steady_clock::time_point in_flight_queued_at_{};
+    std::chrono::steady_clock::time_point in_flight_started_{};
+    std::size_t max_coalesced_bytes_ = 256 * 1024;
 
     void fail(const boost::beast::error_code &ec, char const *what);
 
+    boost::asio::awaitable<void> do_connect();
+
+    void notify_connect(const boost::beast::error_code &ec);
+
     void read_loop();
+
+    void connection_lost();
+
+    void schedule_reconnect();
+
+    void reset_stream();
+
+    void write_frame(std::string &&frame);
+
+    void write_next();
+
+    void queue_pending(std::string &&message);
+
+    void flush_pending();
+
+    void schedule_pending_drain();
+
+    void write_pending_batch();
 };
 
 #endif // WSCLIENT_H
\ No newline at end of file
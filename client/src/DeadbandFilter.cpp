@@ -0,0 +1,79 @@
+#include "DeadbandFilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Logger.h"
+
+DeadbandOptions DeadbandOptions::fromCommandLine(const CommandLine &cl) {
+    DeadbandOptions options;
+    options.enabled = cl.getBool("deadband", options.enabled);
+    options.default_band.absolute = cl.getDouble("deadband-abs", options.default_band.absolute);
+    options.default_band.relative = cl.getDouble("deadband-pct", options.default_band.relative);
+    options.heartbeat = std::chrono::seconds(cl.getInt("deadband-heartbeat-s", options.heartbeat.count()));
+
+    for (const auto &[name, value]: cl.getMap("deadband-counters")) {
+        Band band;
+        try {
+            const auto colon = value.find(':');
+            band.absolute = std::stod(value.substr(0, colon));
+            if (colon != std::string::npos) {
+                band.relative = std::stod(value.substr(colon + 1));
+            }
+        } catch (const std::exception &) {
+            LOG_WARN("Deadband", "Ignoring deadband for \"", name, "\", expected absolute[:relative]");
+            continue;
+        }
+        options.counters[name] = band;
+    }
+    return options;
+}
+
+DeadbandFilter::DeadbandFilter(DeadbandOptions options): options_(std::move(options)) {
+}
+
+const std::vector<MonitoredCounterData> &DeadbandFilter::filter(const std::vector<MonitoredCounterData> &data) {
+    if (reset_requested_.exchange(false)) {
+        reported_.clear();
+    }
+
+    due_.clear();
+    for (const auto &dp: data) {
+        if (!dp.valid) {
+            continue;
+        }
+        if (!options_.enabled) {
+            due_.push_back(dp);
+            continue;
+        }
+
+        auto [it, first] = reported_.try_emplace(dp.counter_name);
+        auto &last = it->second;
+        if (!first) {
+            const auto &band = bandFor(dp.counter_name);
+            const auto threshold = std::max(band.absolute, band.relative / 100.0 * std::fabs(last.value));
+            const auto beyond = [&](double value) {
+                return threshold > 0.0 ? std::fabs(value - last.value) > threshold : value != last.value;
+            };
+            // A window summary also counts as moved when a spike inside the window left the band.
+            const bool moved = beyond(dp.counter_value) ||
+                               (dp.summary.count > 1 && (beyond(dp.summary.min) || beyond(dp.summary.max)));
+            if (!moved && dp.timestamp - last.at < options_.heartbeat) {
+                continue;
+            }
+        }
+        last.value = dp.counter_value;
+        last.at = dp.timestamp;
+        due_.push_back(dp);
+    }
+    return due_;
+}
+
+void DeadbandFilter::reset() {
+    reset_requested_ = true;
+}
+
+const DeadbandOptions::Band &DeadbandFilter::bandFor(const std::string &name) const {
+    const auto it = options_.counters.find(name);
+    return it == options_.counters.end() ? options_.default_band : it->second;
+}
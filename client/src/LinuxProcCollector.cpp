@@ -0,0 +1,368 @@
+#include "LinuxProcCollector.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+namespace {
+    constexpr const char *source_paths[] = {
+        "/proc/stat", "/proc/meminfo", "/proc/diskstats", "/proc/net/dev",
+        "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"
+    };
+
+    constexpr const char *counter_names[] = {
+        "CPU Usage", "CPU IO Wait", "Available RAM (MB)", "Memory Used (%)", "Swap Used (MB)",
+        "Disk Read (KB/s)", "Disk Write (KB/s)", "Disk Busy (%)", "Network Received (KB/s)", "Network Sent (KB/s)",
+        "CPU Pressure (%)", "Memory Pressure (%)", "IO Pressure (%)"
+    };
+
+    // Index into source_paths of the file each counter is parsed from, in Counter order.
+    constexpr std::size_t counter_sources[] = {
+        0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 4, 5, 6
+    };
+    static_assert(std::size(counter_sources) == std::size(counter_names));
+
+    // Large enough for /proc/diskstats and /proc/net/dev on hosts with hundreds of devices.
+    constexpr std::size_t buffer_size = 128 * 1024;
+
+    void skip_spaces(const char *&p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+    }
+
+    std::uint64_t parse_u64(const char *&p, const char *end) {
+        skip_spaces(p, end);
+        std::uint64_t value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + static_cast<std::uint64_t>(*p - '0');
+            ++p;
+        }
+        return value;
+    }
+
+    std::string_view parse_word(const char *&p, const char *end, char stop = ' ') {
+        skip_spaces(p, end);
+        const auto begin = p;
+        while (p < end && *p != stop && *p != ' ' && *p != '\n') {
+            ++p;
+        }
+        return {begin, static_cast<std::size_t>(p - begin)};
+    }
+
+    void next_line(const char *&p, const char *end) {
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+        if (p < end) {
+            ++p;
+        }
+    }
+
+    // Value of a "Key:   123 kB" line in /proc/meminfo.
+    bool find_kb(std::string_view text, std::string_view key, std::uint64_t &value) {
+        std::size_t pos = 0;
+        while ((pos = text.find(key, pos)) != std::string_view::npos) {
+            if (pos == 0 || text[pos - 1] == '\n') {
+                const char *p = text.data() + pos + key.size();
+                value = parse_u64(p, text.data() + text.size());
+                return true;
+            }
+            pos += key.size();
+        }
+        return false;
+    }
+
+    double delta(std::uint64_t now, std::uint64_t before) {
+        return now > before ? static_cast<double>(now - before) : 0.0;
+    }
+}
+
+LinuxProcCollector::LinuxProcCollector() {
+    fds_.fill(-1);
+    for (const auto *name: counter_names) {
+        counters_.emplace_back(name);
+    }
+}
+
+LinuxProcCollector::~LinuxProcCollector() {
+    uninitialize();
+}
+
+bool LinuxProcCollector::initialize() {
+    if (is_initialized_) {
+        std::cerr << "LinuxProcCollector is already initialized" << std::endl;
+        return true;
+    }
+
+    bool opened = false;
+    for (std::size_t i = 0; i < SOURCE_COUNT; ++i) {
+        fds_[i] = ::open(source_paths[i], O_RDONLY | O_CLOEXEC);
+        if (fds_[i] < 0) {
+            LOG_INFO("LinuxProcCollector", source_paths[i], " is not available, its counters are skipped");
+            continue;
+        }
+        opened = true;
+    }
+    if (!opened) {
+        std::cerr << "LinuxProcCollector could not open any /proc source" << std::endl;
+        return false;
+    }
+
+    // Whole disks only: partitions and virtual devices (loop, dm, md) would count the same IO twice.
+    disks_.clear();
+    std::error_code ec;
+    for (const auto &entry: std::filesystem::directory_iterator("/sys/block", ec)) {
+        if (std::filesystem::exists(entry.path() / "device", ec)) {
+            disks_.push_back({entry.path().filename().string()});
+        }
+    }
+
+    buffer_.resize(buffer_size);
+    read_at_.fill({});
+    is_initialized_ = true;
+    // Baseline for the rate counters; the first real tick then has values for all of them.
+    collect();
+    return true;
+}
+
+void LinuxProcCollector::uninitialize() {
+    for (auto &fd: fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    is_initialized_ = false;
+}
+
+bool LinuxProcCollector::collect() {
+    std::array<bool, SOURCE_COUNT> sources{};
+    sources.fill(true);
+    return collect_sources(sources);
+}
+
+bool LinuxProcCollector::collect(const std::vector<bool> &due) {
+    std::array<bool, SOURCE_COUNT> sources{};
+    for (std::size_t i = 0; i < COUNTER_COUNT && i < due.size(); ++i) {
+        if (due[i]) {
+            sources[counter_sources[i]] = true;
+        }
+    }
+    return collect_sources(sources);
+}
+
+bool LinuxProcCollector::collect_sources(const std::array<bool, SOURCE_COUNT> &sources) {
+    if (!is_initialized_) {
+        std::cerr << "LinuxProcCollector is not yet initialized" << std::endl;
+        return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto timestamp = std::chrono::system_clock::now();
+    for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+        if (sources[counter_sources[i]]) {
+            counters_[i].valid = false;
+            counters_[i].timestamp = timestamp;
+        }
+    }
+
+    const auto read = [this, &sources](Source source) {
+        return sources[source] ? read_source(source) : std::string_view{};
+    };
+
+    bool collected = false;
+    if (const auto text = read(STAT); !text.empty()) {
+        collect_cpu(text, elapsed(STAT, now));
+        collected = true;
+    }
+    if (const auto text = read(MEMINFO); !text.empty()) {
+        collect_memory(text);
+        collected = true;
+    }
+    if (const auto text = read(DISKSTATS); !text.empty()) {
+        collect_disks(text, elapsed(DISKSTATS, now));
+        collected = true;
+    }
+    if (const auto text = read(NET_DEV); !text.empty()) {
+        collect_network(text, elapsed(NET_DEV, now));
+        collected = true;
+    }
+    if (const auto text = read(PRESSURE_CPU); !text.empty()) {
+        collect_pressure(text, elapsed(PRESSURE_CPU, now), PRESSURE_CPU, CPU_PRESSURE);
+        collected = true;
+    }
+    if (const auto text = read(PRESSURE_MEMORY); !text.empty()) {
+        collect_pressure(text, elapsed(PRESSURE_MEMORY, now), PRESSURE_MEMORY, MEMORY_PRESSURE);
+        collected = true;
+    }
+    if (const auto text = read(PRESSURE_IO); !text.empty()) {
+        collect_pressure(text, elapsed(PRESSURE_IO, now), PRESSURE_IO, IO_PRESSURE);
+        collected = true;
+    }
+    return collected;
+}
+
+const std::vector<MonitoredCounterData> &LinuxProcCollector::get_counters() const {
+    return counters_;
+}
+
+std::string_view LinuxProcCollector::read_source(Source source) {
+    const auto fd = fds_[source];
+    if (fd < 0) {
+        return {};
+    }
+    std::size_t size = 0;
+    while (size < buffer_.size()) {
+        const auto n = ::pread(fd, buffer_.data() + size, buffer_.size() - size, static_cast<off_t>(size));
+        if (n <= 0) {
+            break;
+        }
+        size += static_cast<std::size_t>(n);
+    }
+    return {buffer_.data(), size};
+}
+
+double LinuxProcCollector::elapsed(Source source, std::chrono::steady_clock::time_point now) {
+    const auto previous = read_at_[source];
+    read_at_[source] = now;
+    if (previous == std::chrono::steady_clock::time_point{}) {
+        return 0.0;
+    }
+    return std::chrono::duration<double>(now - previous).count();
+}
+
+void LinuxProcCollector::set(Counter counter, double value) {
+    counters_[counter].counter_value = value;
+    counters_[counter].valid = true;
+}
+
+void LinuxProcCollector::collect_cpu(std::string_view text, double seconds) {
+    // "cpu  user nice system idle iowait irq softirq steal guest guest_nice"; guest time is
+    // already part of user.
+    if (!text.starts_with("cpu ")) {
+        return;
+    }
+    const char *p = text.data() + 4;
+    const char *end = text.data() + text.size();
+    std::uint64_t fields[8];
+    for (auto &field: fields) {
+        field = parse_u64(p, end);
+    }
+    std::uint64_t total = 0;
+    for (const auto field: fields) {
+        total += field;
+    }
+    const auto idle = fields[3] + fields[4];
+    const auto iowait = fields[4];
+
+    const auto total_delta = delta(total, cpu_total_);
+    if (seconds > 0 && total_delta > 0) {
+        set(CPU_USAGE, 100.0 * (total_delta - delta(idle, cpu_idle_)) / total_delta);
+        set(CPU_IOWAIT, 100.0 * delta(iowait, cpu_iowait_) / total_delta);
+    }
+    cpu_total_ = total;
+    cpu_idle_ = idle;
+    cpu_iowait_ = iowait;
+}
+
+void LinuxProcCollector::collect_memory(std::string_view text) {
+    std::uint64_t total_kb = 0, available_kb = 0, swap_total_kb = 0, swap_free_kb = 0;
+    if (find_kb(text, "MemTotal:", total_kb) && find_kb(text, "MemAvailable:", available_kb) && total_kb > 0) {
+        set(AVAILABLE_RAM, static_cast<double>(available_kb) / 1024.0);
+        set(MEMORY_USED, 100.0 * delta(total_kb, available_kb) / static_cast<double>(total_kb));
+    }
+    if (find_kb(text, "SwapTotal:", swap_total_kb) && find_kb(text, "SwapFree:", swap_free_kb)) {
+        set(SWAP_USED, delta(swap_total_kb, swap_free_kb) / 1024.0);
+    }
+}
+
+void LinuxProcCollector::collect_disks(std::string_view text, double seconds) {
+    // "major minor name reads merged sectors_read ms_reading writes merged sectors_written
+    //  ms_writing in_flight io_ticks ..."; sectors are always 512 bytes here.
+    const char *p = text.data();
+    const char *end = text.data() + text.size();
+    std::uint64_t sectors_read = 0, sectors_written = 0;
+    double busiest = 0.0;
+    while (p < end) {
+        parse_u64(p, end);
+        parse_u64(p, end);
+        const auto name = parse_word(p, end);
+        const auto disk = std::find_if(disks_.begin(), disks_.end(), [name](const DiskState &state) {
+            return state.name == name;
+        });
+        if (disk != disks_.end()) {
+            std::uint64_t fields[10];
+            for (auto &field: fields) {
+                field = parse_u64(p, end);
+            }
+            sectors_read += fields[2];
+            sectors_written += fields[6];
+            if (seconds > 0) {
+                busiest = std::max(busiest, delta(fields[9], disk->io_ticks_ms) / (seconds * 10.0));
+            }
+            disk->io_ticks_ms = fields[9];
+        }
+        next_line(p, end);
+    }
+
+    if (seconds > 0 && !disks_.empty()) {
+        set(DISK_READ, delta(sectors_read, disk_sectors_read_) * 512.0 / 1024.0 / seconds);
+        set(DISK_WRITE, delta(sectors_written, disk_sectors_written_) * 512.0 / 1024.0 / seconds);
+        set(DISK_BUSY, std::min(100.0, busiest));
+    }
+    disk_sectors_read_ = sectors_read;
+    disk_sectors_written_ = sectors_written;
+}
+
+void LinuxProcCollector::collect_network(std::string_view text, double seconds) {
+    // Two header lines, then "iface: rx_bytes packets errs drop fifo frame compressed multicast
+    // tx_bytes ..."; loopback traffic is not network traffic.
+    const char *p = text.data();
+    const char *end = text.data() + text.size();
+    next_line(p, end);
+    next_line(p, end);
+    std::uint64_t received = 0, sent = 0;
+    while (p < end) {
+        const auto name = parse_word(p, end, ':');
+        if (p < end && *p == ':') {
+            ++p;
+        }
+        std::uint64_t fields[9];
+        for (auto &field: fields) {
+            field = parse_u64(p, end);
+        }
+        if (name != "lo") {
+            received += fields[0];
+            sent += fields[8];
+        }
+        next_line(p, end);
+    }
+
+    if (seconds > 0) {
+        set(NET_RECEIVED, delta(received, net_received_) / 1024.0 / seconds);
+        set(NET_SENT, delta(sent, net_sent_) / 1024.0 / seconds);
+    }
+    net_received_ = received;
+    net_sent_ = sent;
+}
+
+void LinuxProcCollector::collect_pressure(std::string_view text, double seconds, Source source, Counter counter) {
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=<us>": share of wall time in which at
+    // least one task stalled, taken from the total so every tick covers exactly its own interval.
+    const auto pos = text.find("total=");
+    if (pos == std::string_view::npos) {
+        return;
+    }
+    const char *p = text.data() + pos + 6;
+    const auto total_us = parse_u64(p, text.data() + text.size());
+    if (seconds > 0) {
+        set(counter, std::min(100.0, delta(total_us, pressure_total_us_[source]) / (seconds * 1e4)));
+    }
+    pressure_total_us_[source] = total_us;
+}
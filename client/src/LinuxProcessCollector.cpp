@@ -0,0 +1,316 @@
+#include "LinuxProcessCollector.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+namespace {
+    constexpr std::string_view cpu_prefix = "Process CPU (%)/";
+    constexpr std::string_view rss_prefix = "Process RSS (MB)/";
+    constexpr std::string_view other_name = "(other)";
+
+    // File descriptors left for sockets and the spool when stat files are kept open.
+    constexpr rlim_t reserved_fds = 1024;
+    constexpr rlim_t wanted_fds = 65536;
+
+    // /proc/<pid>/stat is a single line well below this, the command name being at most 15 bytes.
+    constexpr std::size_t buffer_size = 4096;
+
+    bool parse_pid(const char *name, int &pid) {
+        pid = 0;
+        if (*name == '\0') {
+            return false;
+        }
+        for (; *name != '\0'; ++name) {
+            if (*name < '0' || *name > '9') {
+                return false;
+            }
+            pid = pid * 10 + (*name - '0');
+        }
+        return true;
+    }
+}
+
+LinuxProcessCollector::LinuxProcessCollector(const std::size_t top, const bool raise_fd_limit)
+    : top_(std::max<std::size_t>(1, top)), raise_fd_limit_(raise_fd_limit) {
+    for (const auto prefix: {cpu_prefix, rss_prefix}) {
+        for (std::size_t i = 0; i < top_; ++i) {
+            counters_.emplace_back(std::string(prefix) + "#" + std::to_string(i + 1));
+        }
+        counters_.emplace_back(std::string(prefix) + std::string(other_name));
+    }
+    for (const auto prefix: {cpu_prefix, rss_prefix}) {
+        for (std::size_t i = 0; i < top_; ++i) {
+            counters_.emplace_back(std::string(prefix) + "(ended)#" + std::to_string(i + 1));
+        }
+    }
+}
+
+LinuxProcessCollector::~LinuxProcessCollector() {
+    uninitialize();
+}
+
+bool LinuxProcessCollector::initialize() {
+    if (is_initialized_) {
+        std::cerr << "LinuxProcessCollector is already initialized" << std::endl;
+        return true;
+    }
+
+    proc_ = ::opendir("/proc");
+    if (proc_ == nullptr) {
+        std::cerr << "LinuxProcessCollector could not open /proc" << std::endl;
+        return false;
+    }
+    if (const auto ticks = ::sysconf(_SC_CLK_TCK); ticks > 0) {
+        ticks_per_second_ = static_cast<double>(ticks);
+    }
+    if (const auto page = ::sysconf(_SC_PAGESIZE); page > 0) {
+        page_mb_ = static_cast<double>(page) / (1024 * 1024);
+    }
+
+    // Keeping one stat file open per process needs more descriptors than the usual soft limit,
+    // but the limit is the whole client's, so it is only raised on request.
+    rlimit limit{};
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (raise_fd_limit_ && limit.rlim_cur < wanted_fds && limit.rlim_cur < limit.rlim_max) {
+            const auto previous = limit.rlim_cur;
+            limit.rlim_cur = std::min(wanted_fds, limit.rlim_max);
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+            ::getrlimit(RLIMIT_NOFILE, &limit);
+            LOG_INFO("LinuxProcessCollector", "Raised the open file limit from ", previous, " to ", limit.rlim_cur);
+        }
+        max_open_ = limit.rlim_cur > 2 * reserved_fds ? limit.rlim_cur - reserved_fds : limit.rlim_cur / 2;
+    }
+
+    buffer_.resize(buffer_size);
+    processes_.reserve(4096);
+    usage_.reserve(1024);
+    read_at_ = {};
+    is_initialized_ = true;
+    // Baseline for the CPU deltas; the first real tick then has CPU values for every process.
+    collect();
+    LOG_INFO("LinuxProcessCollector", "Tracking ", processes_.size(), " processes, reporting the top ", top_,
+             ", keeping up to ", max_open_, " stat files open");
+    return true;
+}
+
+void LinuxProcessCollector::uninitialize() {
+    for (auto &[pid, process]: processes_) {
+        close_fd(process);
+    }
+    processes_.clear();
+    reported_cpu_.clear();
+    reported_rss_.clear();
+    if (proc_ != nullptr) {
+        ::closedir(proc_);
+        proc_ = nullptr;
+    }
+    is_initialized_ = false;
+}
+
+bool LinuxProcessCollector::collect() {
+    if (!is_initialized_) {
+        std::cerr << "LinuxProcessCollector is not yet initialized" << std::endl;
+        return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto seconds = read_at_ == std::chrono::steady_clock::time_point{}
+                             ? 0.0
+                             : std::chrono::duration<double>(now - read_at_).count();
+    read_at_ = now;
+    ++generation_;
+
+    ::rewinddir(proc_);
+    while (const auto *entry = ::readdir(proc_)) {
+        int pid;
+        if (parse_pid(entry->d_name, pid)) {
+            read_process(pid, seconds);
+        }
+    }
+
+    // Processes that exited and names no process carries any more.
+    for (auto it = processes_.begin(); it != processes_.end();) {
+        if (it->second.generation == generation_) {
+            ++it;
+            continue;
+        }
+        close_fd(it->second);
+        it = processes_.erase(it);
+    }
+    std::erase_if(usage_, [this](const auto &entry) { return entry.second.generation != generation_; });
+
+    ranked_.clear();
+    double total_cpu = 0.0;
+    double total_rss = 0.0;
+    for (const auto &[name, usage]: usage_) {
+        ranked_.emplace_back(&name, &usage);
+        total_cpu += usage.cpu;
+        total_rss += usage.rss;
+    }
+
+    const auto timestamp = std::chrono::system_clock::now();
+    for (auto &counter: counters_) {
+        counter.valid = false;
+        counter.timestamp = timestamp;
+    }
+    // Without a previous tick there is no CPU delta yet.
+    const auto ended_first = 2 * (top_ + 1);
+    if (seconds > 0.0) {
+        report(0, ended_first, reported_cpu_, cpu_prefix, &Usage::cpu, total_cpu);
+    }
+    report(top_ + 1, ended_first + top_, reported_rss_, rss_prefix, &Usage::rss, total_rss);
+    return !processes_.empty();
+}
+
+const std::vector<MonitoredCounterData> &LinuxProcessCollector::get_counters() const {
+    return counters_;
+}
+
+std::size_t LinuxProcessCollector::get_process_count() const {
+    return processes_.size();
+}
+
+bool LinuxProcessCollector::read_process(const int pid, const double seconds) {
+    // A pid that fails to read keeps its old generation and is dropped after the scan.
+    auto [it, inserted] = processes_.try_emplace(pid);
+    auto &process = it->second;
+    const auto n = read_stat(pid, process);
+    if (n == 0) {
+        return false;
+    }
+
+    // "pid (comm) state ppid ..." where comm may itself contain spaces and parentheses.
+    const std::string_view text(buffer_.data(), n);
+    const auto open = text.find('(');
+    const auto close = text.rfind(')');
+    if (open == std::string_view::npos || close == std::string_view::npos || close < open) {
+        return false;
+    }
+    const auto name = text.substr(open + 1, close - open - 1);
+
+    // Fields are numbered from 1 as in proc(5); field 3 (state) follows the command name.
+    std::uint64_t utime = 0, stime = 0, start_ticks = 0, rss_pages = 0;
+    const char *p = text.data() + close + 1;
+    const char *end = text.data() + text.size();
+    for (int field = 3; field <= 24 && p < end; ++field) {
+        while (p < end && *p == ' ') {
+            ++p;
+        }
+        std::uint64_t value = 0;
+        for (; p < end && *p != ' ' && *p != '\n'; ++p) {
+            if (*p >= '0' && *p <= '9') {
+                value = value * 10 + static_cast<std::uint64_t>(*p - '0');
+            }
+        }
+        switch (field) {
+            case 14: utime = value;
+                break;
+            case 15: stime = value;
+                break;
+            case 22: start_ticks = value;
+                break;
+            case 24: rss_pages = value;
+                break;
+            default:
+                break;
+        }
+    }
+
+    const auto cpu_ticks = utime + stime;
+    double cpu = 0.0;
+    if (inserted || process.start_ticks != start_ticks) {
+        process.start_ticks = start_ticks;
+    } else if (seconds > 0.0 && cpu_ticks > process.cpu_ticks) {
+        cpu = static_cast<double>(cpu_ticks - process.cpu_ticks) / ticks_per_second_ / seconds * 100.0;
+    }
+    if (process.name != name) {
+        process.name.assign(name); // new pid, or the process called exec
+    }
+    process.cpu_ticks = cpu_ticks;
+    process.generation = generation_;
+
+    auto &usage = usage_[process.name];
+    if (usage.generation != generation_) {
+        usage = {0.0, 0.0, generation_};
+    }
+    usage.cpu += cpu;
+    usage.rss += static_cast<double>(rss_pages) * page_mb_;
+    return true;
+}
+
+std::size_t LinuxProcessCollector::read_stat(const int pid, Process &process) {
+    if (process.fd >= 0) {
+        if (const auto n = ::pread(process.fd, buffer_.data(), buffer_.size(), 0); n > 0) {
+            return static_cast<std::size_t>(n);
+        }
+        close_fd(process); // exited; if the pid was reused, the new process is opened below
+    }
+
+    char path[32];
+    std::snprintf(path, sizeof(path), "%d/stat", pid);
+    const auto fd = ::openat(::dirfd(proc_), path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0; // exited since readdir
+    }
+    const auto n = ::pread(fd, buffer_.data(), buffer_.size(), 0);
+    if (n > 0 && open_ < max_open_) {
+        process.fd = fd;
+        ++open_;
+    } else {
+        ::close(fd);
+    }
+    return n > 0 ? static_cast<std::size_t>(n) : 0;
+}
+
+void LinuxProcessCollector::close_fd(Process &process) {
+    if (process.fd >= 0) {
+        ::close(process.fd);
+        process.fd = -1;
+        --open_;
+    }
+}
+
+// Fills top_ slots from first on with the largest consumers by field, then the rest as one
+// "(other)" slot. Names from previous_top that left the top get a 0 in the slots from ended_first
+// on; previous_top then holds this tick's top.
+void LinuxProcessCollector::report(const std::size_t first, const std::size_t ended_first,
+                                   std::vector<std::string> &previous_top, const std::string_view prefix,
+                                   double Usage::*field, const double total) {
+    const auto n = std::min(top_, ranked_.size());
+    std::partial_sort(ranked_.begin(), ranked_.begin() + static_cast<std::ptrdiff_t>(n), ranked_.end(),
+                      [field](const Ranked &a, const Ranked &b) { return a.second->*field > b.second->*field; });
+
+    std::size_t ended = 0;
+    for (const auto &name: previous_top) {
+        const auto still_top = std::any_of(ranked_.begin(), ranked_.begin() + static_cast<std::ptrdiff_t>(n),
+                                           [&name](const Ranked &ranked) { return *ranked.first == name; });
+        if (!still_top) {
+            auto &counter = counters_[ended_first + ended++];
+            counter.counter_name.assign(prefix).append(name);
+            counter.counter_value = 0.0;
+            counter.valid = true;
+        }
+    }
+    previous_top.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        previous_top[i].assign(*ranked_[i].first);
+    }
+
+    double reported = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+        auto &counter = counters_[first + i];
+        counter.counter_name.assign(prefix).append(*ranked_[i].first);
+        counter.counter_value = ranked_[i].second->*field;
+        counter.valid = true;
+        reported += counter.counter_value;
+    }
+    auto &other = counters_[first + top_];
+    other.counter_value = std::max(0.0, total - reported);
+    other.valid = true;
+}
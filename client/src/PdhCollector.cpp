@@ -0,0 +1,135 @@
+#include "PdhCollector.h"
+
+#include <iostream>
+
+#include "Logger.h"
+
+
+PdhCollector::PdhCollector()
+    : hQuery_(nullptr),
+      is_initialized_(false) {
+}
+
+bool PdhCollector::add_counter(const std::string &counter_name, const std::wstring &pdh_counter_path) {
+    if (this->is_initialized_) {
+        std::cerr << "PdhCollector is already initialized, unable to add new counter" << std::endl;
+        return false;
+    }
+    this->pdh_counters_.emplace_back(counter_name, pdh_counter_path);
+    return true;
+}
+
+bool PdhCollector::initialize() {
+    if (this->is_initialized_) {
+        std::cerr << "PdhCollector is already initialized" << std::endl;
+        return true;
+    }
+
+    auto pdh_status = PdhOpenQueryW(nullptr, 0, &hQuery_);
+    if (pdh_status != ERROR_SUCCESS) {
+        std::cout << "PdhOpenQuery failed with 0x" << std::hex << pdh_status << std::endl;
+        this->hQuery_ = nullptr;
+        return false;
+    }
+
+    if (this->pdh_counters_.empty()) {
+        std::cout << "Warn: PdhCollector does not have any counters" << std::endl;
+    }
+
+    bool added_counter = false;
+    for (auto &counter: this->pdh_counters_) {
+        pdh_status = PdhAddCounterW(this->hQuery_, counter.pdh_counter_path.c_str(), 0, &counter.hCounter);
+        if (pdh_status != ERROR_SUCCESS) {
+            std::cerr << "PdhAddCounter failed with 0x" << std::hex << pdh_status << " for: " << counter.counter_name <<
+                    std::endl;
+            counter.hCounter = nullptr;
+        } else {
+            added_counter = true;
+        }
+    }
+
+    pdh_status = PdhCollectQueryData(this->hQuery_);
+    if (pdh_status != ERROR_SUCCESS) {
+        std::cerr << "Initial PdhCollectQueryData failed with 0x" << std::hex << pdh_status << std::endl;
+        this->uninitialize();
+        return false;
+    }
+
+    this->counters_.clear();
+    for (const auto &counter: this->pdh_counters_) {
+        this->counters_.emplace_back(counter.counter_name);
+    }
+
+    this->is_initialized_ = true;
+    if (!this->pdh_counters_.empty() && !added_counter) {
+        std::cerr << "Warning: PdhCollector initialized, but no defined counters were added successfully." <<
+                std::endl;
+    }
+    return true;
+}
+
+void PdhCollector::uninitialize() {
+    if (this->hQuery_ != nullptr) {
+        PdhCloseQuery(this->hQuery_);
+        this->hQuery_ = nullptr;
+    }
+
+    for (auto &counter: this->pdh_counters_) {
+        counter.hCounter = nullptr;
+    }
+
+    is_initialized_ = false;
+}
+
+bool PdhCollector::collect() {
+    if (!this->is_initialized_) {
+        std::cerr << "PdhCollector is not yet initialized" << std::endl;
+        return false;
+    }
+
+    auto pdh_status = PdhCollectQueryData(this->hQuery_);
+    auto current_sample_time = std::chrono::system_clock::now();
+
+    if (pdh_status != ERROR_SUCCESS) {
+        LOG_WARN("PdhCollector", "PdhCollectQueryData failed with ", LogHex{static_cast<unsigned long>(pdh_status)});
+        return false;
+    }
+
+    for (std::size_t i = 0; i < this->pdh_counters_.size(); ++i) {
+        auto &counter = this->pdh_counters_[i];
+        auto &out = this->counters_[i];
+        counter.timestamp = current_sample_time;
+        out.timestamp = current_sample_time;
+        out.valid = false;
+        PDH_FMT_COUNTERVALUE DisplayValue;
+        DWORD CounterType;
+
+        if (counter.hCounter == nullptr) {
+            continue;
+        }
+
+        counter.pdhStatus = PdhGetFormattedCounterValue(counter.hCounter,
+                                                        PDH_FMT_DOUBLE,
+                                                        &CounterType,
+                                                        &DisplayValue);
+
+        if (counter.pdhStatus != ERROR_SUCCESS) {
+            LOG_WARN("PdhCollector", "PdhGetFormattedCounterValue failed with ",
+                     LogHex{static_cast<unsigned long>(counter.pdhStatus)}, " for: ", counter.counter_name);
+            continue;
+        }
+        counter.counter_value = DisplayValue.doubleValue;
+        out.counter_value = DisplayValue.doubleValue;
+        out.valid = true;
+    }
+
+    return true;
+}
+
+const std::vector<MonitoredCounterData> &PdhCollector::get_counters() const {
+    return this->counters_;
+}
+
+PdhCollector::~PdhCollector() {
+    uninitialize();
+}
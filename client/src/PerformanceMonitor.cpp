@@ -1,26 +1,27 @@
 #include "PerformanceMonitor.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include "Logger.h"
 
-PerformanceMonitor::PerformanceMonitor(const std::chrono::milliseconds sampling_time)
-    : sampling_time_(sampling_time),
-      hQuery_(nullptr),
-      is_initialized_(false),
-      is_monitoring_(false) {
+namespace {
+    // The first multiple of interval since the epoch that is strictly after now.
+    std::chrono::system_clock::time_point next_aligned(std::chrono::system_clock::time_point now,
+                                                       std::chrono::milliseconds interval) {
+        const auto since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+        return std::chrono::system_clock::time_point((since_epoch / interval + 1) * interval);
+    }
 }
 
-bool PerformanceMonitor::add_counter(const std::string &counter_name, const std::wstring &pdh_counter_path) {
-    if (this->is_initialized_) {
-        std::cerr << "PerformanceMonitor is already initialized, unable to add new counter" << std::endl;
-        return false;
-    }
-    if (this->is_monitoring_.load() || this->monitor_thread_.joinable()) {
-        std::cerr << "PerformanceMonitor is Monitoring, unable to add new counter" << std::endl;
-        return false;
-    }
-    this->pdh_counters_.emplace_back(counter_name, pdh_counter_path);
-    return true;
+PerformanceMonitor::PerformanceMonitor(std::unique_ptr<CounterCollector> collector,
+                                       const std::chrono::milliseconds sampling_time,
+                                       const std::chrono::milliseconds report_interval)
+    : collector_(std::move(collector)),
+      sampling_time_(std::max(sampling_time, std::chrono::milliseconds(1))),
+      report_interval_(report_interval > sampling_time_ ? report_interval : std::chrono::milliseconds(0)),
+      is_initialized_(false),
+      is_monitoring_(false) {
 }
 
 bool PerformanceMonitor::initialize() {
@@ -29,42 +30,12 @@ bool PerformanceMonitor::initialize() {
         return true;
     }
 
-    auto pdh_status = PdhOpenQueryW(nullptr, 0, &hQuery_);
-    if (pdh_status != ERROR_SUCCESS) {
-        std::cout << "PdhOpenQuery failed with 0x" << std::hex << pdh_status << std::endl;
-        this->hQuery_ = nullptr;
-        return false;
-    }
-
-    if (this->pdh_counters_.empty()) {
-        std::cout << "Warn: PerformanceMonitor does not have any counters" << std::endl;
-    }
-
-    bool added_counter = false;
-    for (auto &counter: this->pdh_counters_) {
-        pdh_status = PdhAddCounterW(this->hQuery_, counter.pdh_counter_path.c_str(), 0, &counter.hCounter);
-        if (pdh_status != ERROR_SUCCESS) {
-            std::cerr << "PdhAddCounter failed with 0x" << std::hex << pdh_status << " for: " << counter.counter_name <<
-                    std::endl;
-            counter.hCounter = nullptr;
-        } else {
-            added_counter = true;
-        }
-    }
-
-    pdh_status = PdhCollectQueryData(this->hQuery_);
-    if (pdh_status != ERROR_SUCCESS) {
-        std::cerr << "Initial PdhCollectQueryData failed with 0x" << std::hex << pdh_status << std::endl;
-        this->uninitialize();
+    if (!this->collector_->initialize()) {
         return false;
     }
 
     this->is_initialized_ = true;
     std::cout << "PerformanceMonitor initialized successfully." << std::endl;
-    if (!this->pdh_counters_.empty() && !added_counter) {
-        std::cerr << "Warning: PerformanceMonitor initialized, but no defined counters were added successfully." <<
-                std::endl;
-    }
     return true;
 }
 
@@ -73,61 +44,16 @@ void PerformanceMonitor::uninitialize() {
         std::cerr << "PerformanceMonitor is Monitoring, unable unitialize counters" << std::endl;
         return;
     }
-    if (this->hQuery_ != nullptr) {
-        PdhCloseQuery(this->hQuery_);
-        this->hQuery_ = nullptr;
-    }
-
-    for (auto &counter: this->pdh_counters_) {
-        counter.hCounter = nullptr;
+    if (this->is_initialized_) {
+        this->collector_->uninitialize();
     }
-
     is_initialized_ = false;
 }
 
-bool PerformanceMonitor::collect_pdh_counter_data() {
-    if (!this->is_initialized_) {
-        std::cerr << "PerformanceMonitor is not yet initialized" << std::endl;
-        return false;
-    }
-
-    auto pdh_status = PdhCollectQueryData(this->hQuery_);
-    auto current_sample_time = std::chrono::system_clock::now();
-
-    if (pdh_status != ERROR_SUCCESS) {
-        std::cerr << "PdhCollectQueryData failed with 0x" << std::hex << pdh_status << std::endl;
-        return false;
-    }
-
-    for (auto &counter: this->pdh_counters_) {
-        counter.timestamp = current_sample_time;
-        PDH_FMT_COUNTERVALUE DisplayValue;
-        DWORD CounterType;
-
-        if (counter.hCounter == nullptr) {
-            continue;
-        }
-
-        counter.pdhStatus = PdhGetFormattedCounterValue(counter.hCounter,
-                                                        PDH_FMT_DOUBLE,
-                                                        &CounterType,
-                                                        &DisplayValue);
-
-        if (counter.pdhStatus != ERROR_SUCCESS) {
-            std::cerr << "PdhGetFormattedCounterValue failed with 0x" << std::hex << counter.pdhStatus << " for: "
-                    << counter.counter_name << std::endl;
-            continue;
-        }
-        counter.counter_value = DisplayValue.doubleValue;
-    }
-
-    return true;
-}
-
 // multithreading stuff
 
 void PerformanceMonitor::set_callback(
-    const std::function<void(const std::vector<MonitoredPdhCounterData> &)> &callback_fn_) {
+    const std::function<void(const std::vector<MonitoredCounterData> &)> &callback_fn_) {
     if (this->is_monitoring_.load() || this->monitor_thread_.joinable()) {
         std::cerr << "PerformanceMonitor is Monitoring, unable to set callback function" << std::endl;
         return;
@@ -135,15 +61,28 @@ void PerformanceMonitor::set_callback(
     this->callback_fn_ = callback_fn_;
 }
 
-std::vector<MonitoredPdhCounterData> PerformanceMonitor::get_current_snapshot() const {
+void PerformanceMonitor::set_counter_interval(const std::string &counter_name,
+                                              const std::chrono::milliseconds interval) {
+    if (this->is_monitoring_.load() || this->monitor_thread_.joinable()) {
+        std::cerr << "PerformanceMonitor is Monitoring, unable to set counter interval" << std::endl;
+        return;
+    }
+    if (interval.count() <= 0) {
+        std::cerr << "Ignoring non-positive interval for counter " << counter_name << std::endl;
+        return;
+    }
+    this->counter_intervals_[counter_name] = interval;
+}
+
+std::vector<MonitoredCounterData> PerformanceMonitor::get_current_snapshot() const {
     if (!this->is_initialized_) {
         std::cerr <<
                 "Performance Monitor is uninitialized, unable to get snapshot" << std::endl;
         return {};
     }
 
-    std::lock_guard lock(this->pdh_counter_mutex_);
-    return this->pdh_counters_;
+    std::lock_guard lock(this->counter_mutex_);
+    return this->collector_->get_counters();
 }
 
 void PerformanceMonitor::start_monitoring() {
@@ -165,34 +104,151 @@ void PerformanceMonitor::start_monitoring() {
 }
 
 void PerformanceMonitor::stop_monitoring() {
-    this->is_monitoring_.store(false);
+    {
+        std::lock_guard lock(this->wake_mutex_);
+        this->is_monitoring_.store(false);
+    }
+    this->wake_.notify_all();
     if (this->monitor_thread_.joinable()) {
         this->monitor_thread_.join();
     }
 }
 
 void PerformanceMonitor::monitoring_loop() {
-    std::cout << "Started monitoring PerformanceMonitor" << std::endl;
+    LOG_INFO("PerformanceMonitor", "Started monitoring");
+
+    std::size_t counter_count; {
+        std::lock_guard lock(this->counter_mutex_);
+        counter_count = this->collector_->get_counters().size();
+        this->intervals_.assign(counter_count, this->sampling_time_);
+        std::size_t matched = 0;
+        for (std::size_t i = 0; i < counter_count; ++i) {
+            const auto it = this->counter_intervals_.find(this->collector_->get_counters()[i].counter_name);
+            if (it != this->counter_intervals_.end()) {
+                this->intervals_[i] = it->second;
+                ++matched;
+            }
+        }
+        if (matched < this->counter_intervals_.size()) {
+            LOG_WARN("PerformanceMonitor", this->counter_intervals_.size() - matched,
+                     " counter interval(s) name no counter of this collector");
+        }
+    }
+    const auto now = std::chrono::system_clock::now();
+    this->next_due_.resize(counter_count);
+    for (std::size_t i = 0; i < counter_count; ++i) {
+        this->next_due_[i] = next_aligned(now, this->intervals_[i]);
+    }
+    if (this->report_interval_.count() > 0) {
+        this->next_report_ = next_aligned(now, this->report_interval_);
+    }
 
     while (this->is_monitoring_.load() == true) {
-        std::this_thread::sleep_for(this->sampling_time_);
+        auto deadline = this->report_interval_.count() > 0
+                            ? this->next_report_
+                            : next_aligned(std::chrono::system_clock::now(), this->sampling_time_);
+        for (const auto &due: this->next_due_) {
+            deadline = std::min(deadline, due);
+        }
+        {
+            // Waiting for a duration runs on the steady clock, so a wall clock step cannot stretch
+            // the sleep; schedule then realigns the deadlines to the stepped clock.
+            std::unique_lock lock(this->wake_mutex_);
+            this->wake_.wait_for(lock, std::max(deadline - std::chrono::system_clock::now(),
+                                                std::chrono::system_clock::duration::zero()),
+                                 [this] { return !this->is_monitoring_.load(); });
+        }
 
         if (this->is_monitoring_.load() == false) { break; }
 
-        if (!collect_pdh_counter_data()) {
-            std::cerr << "collect_pdh_counter_data while monitoring" << std::endl;
-        }
+        const auto tick = std::chrono::system_clock::now();
+        schedule(tick);
+        const bool any_due = std::find(this->due_.begin(), this->due_.end(), true) != this->due_.end();
 
+        std::vector<MonitoredCounterData> snapshot; {
+            std::lock_guard lock(this->counter_mutex_);
+            if (any_due && !this->collector_->collect(this->due_)) {
+                LOG_WARN("PerformanceMonitor", "collect failed while monitoring");
+            }
+            const auto &counters = this->collector_->get_counters();
+            if (this->report_interval_.count() > 0) {
+                accumulate(counters, this->due_);
+                if (this->next_report_ > tick) {
+                    continue;
+                }
+                snapshot = take_report(counters);
+                for (auto &counter: snapshot) {
+                    counter.timestamp = this->next_report_;
+                }
+                this->next_report_ = next_aligned(tick, this->report_interval_);
+            } else {
+                if (!any_due) {
+                    continue;
+                }
+                snapshot = counters;
+                for (std::size_t i = 0; i < snapshot.size(); ++i) {
+                    if (i >= this->due_.size() || !this->due_[i]) {
+                        snapshot[i].valid = false;
+                    } else {
+                        snapshot[i].timestamp = deadline;
+                    }
+                }
+            }
+        }
 
         if (this->callback_fn_ != nullptr) {
-            std::vector<MonitoredPdhCounterData> snapshot_pdh_counters; {
-                std::lock_guard lock(this->pdh_counter_mutex_);
-                snapshot_pdh_counters = this->pdh_counters_;
-            }
+            this->callback_fn_(snapshot);
+        }
+    }
+}
+
+// Marks the counters whose deadline passed as due and moves their deadlines to the next aligned
+// one after now, skipping any ticks that were missed. A deadline more than one interval ahead
+// means the wall clock stepped back; it is realigned to now instead of waiting for the old time.
+void PerformanceMonitor::schedule(const std::chrono::system_clock::time_point now) {
+    this->due_.assign(this->next_due_.size(), false);
+    for (std::size_t i = 0; i < this->next_due_.size(); ++i) {
+        if (this->next_due_[i] <= now) {
+            this->due_[i] = true;
+            this->next_due_[i] = next_aligned(now, this->intervals_[i]);
+        } else if (this->next_due_[i] > now + this->intervals_[i]) {
+            this->next_due_[i] = next_aligned(now, this->intervals_[i]);
+        }
+    }
+    if (this->report_interval_.count() > 0 && this->next_report_ > now + this->report_interval_) {
+        this->next_report_ = next_aligned(now, this->report_interval_);
+    }
+}
+
+void PerformanceMonitor::accumulate(const std::vector<MonitoredCounterData> &counters, const std::vector<bool> &due) {
+    if (this->windows_.size() != counters.size()) {
+        this->windows_.resize(counters.size());
+        const auto samples = static_cast<std::size_t>(this->report_interval_ / this->sampling_time_);
+        for (auto &window: this->windows_) {
+            window.values.reserve(samples);
+        }
+    }
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        if (counters[i].valid && i < due.size() && due[i]) {
+            this->windows_[i].values.push_back(counters[i].counter_value);
+            this->windows_[i].sum += counters[i].counter_value;
+        }
+    }
+}
 
-            this->callback_fn_(snapshot_pdh_counters);
+std::vector<MonitoredCounterData> PerformanceMonitor::take_report(const std::vector<MonitoredCounterData> &counters) {
+    std::vector<MonitoredCounterData> report = counters;
+    for (std::size_t i = 0; i < report.size() && i < this->windows_.size(); ++i) {
+        auto &window = this->windows_[i];
+        report[i].valid = !window.values.empty();
+        if (report[i].valid) {
+            report[i].summary = CounterSummary::fromValues(window.values, window.sum);
+            report[i].counter_value = report[i].summary.mean;
         }
+        window.values.clear();
+        window.sum = 0.0;
     }
+    return report;
 }
 
 PerformanceMonitor::~PerformanceMonitor() {
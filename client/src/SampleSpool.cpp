@@ -0,0 +1,309 @@
+#include "SampleSpool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <vector>
+
+#include "Logger.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::string_view segment_prefix = "spool-";
+    constexpr std::string_view segment_suffix = ".log";
+
+    template<typename T>
+    void append_number(std::string &out, T value) {
+        char buf[32];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+
+    bool parse_segment_seq(const std::string &name, std::uint64_t &seq) {
+        if (!name.starts_with(segment_prefix) || !name.ends_with(segment_suffix)) {
+            return false;
+        }
+        const auto first = name.data() + segment_prefix.size();
+        const auto last = name.data() + name.size() - segment_suffix.size();
+        const auto result = std::from_chars(first, last, seq);
+        return result.ec == std::errc() && result.ptr == last;
+    }
+
+    // Lines after offset, i.e. samples not read yet.
+    std::uint64_t count_lines(const std::string &path, std::uint64_t offset) {
+        std::ifstream in(path, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        std::uint64_t lines = 0;
+        char buf[64 * 1024];
+        while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+            lines += static_cast<std::uint64_t>(std::count(buf, buf + in.gcount(), '\n'));
+        }
+        return lines;
+    }
+}
+
+SampleSpool::SampleSpool(SpoolOptions options): options_(std::move(options)) {
+}
+
+SampleSpool::~SampleSpool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (writer_.is_open()) {
+        writer_.close();
+        if (!segments_.empty() && segments_.back().bytes == 0) {
+            std::error_code ec;
+            fs::remove(segmentPath(segments_.back().seq), ec);
+        }
+    }
+}
+
+bool SampleSpool::open(std::string &error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    fs::create_directories(options_.directory, ec);
+    if (ec) {
+        error = "could not create spool directory " + options_.directory + ": " + ec.message();
+        return false;
+    }
+
+    std::uint64_t position_seq = 0, position_offset = 0;
+    if (std::ifstream position(fs::path(options_.directory) / "spool.pos"); position) {
+        position >> position_seq >> position_offset;
+    }
+
+    std::vector<std::uint64_t> found;
+    for (const auto &entry: fs::directory_iterator(options_.directory, ec)) {
+        std::uint64_t seq = 0;
+        if (entry.is_regular_file(ec) && parse_segment_seq(entry.path().filename().string(), seq)) {
+            found.push_back(seq);
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    for (const auto seq: found) {
+        const auto path = segmentPath(seq);
+        const auto bytes = fs::file_size(path, ec);
+        // Segments before the saved position were sent but not yet deleted.
+        if (ec || bytes == 0 || seq < position_seq || (seq == position_seq && position_offset >= bytes)) {
+            fs::remove(path, ec);
+            continue;
+        }
+        const auto offset = segments_.empty() && seq == position_seq ? position_offset : 0;
+        if (segments_.empty()) {
+            read_offset_ = offset;
+        }
+        const auto samples = count_lines(path, offset);
+        segments_.push_back({seq, bytes, samples});
+        total_bytes_ += bytes;
+        total_samples_ += samples;
+    }
+    next_seq_ = segments_.empty() ? std::max<std::uint64_t>(1, position_seq + 1) : segments_.back().seq + 1;
+
+    if (total_samples_ > 0) {
+        LOG_INFO("SampleSpool", "Found ", total_samples_, " spooled samples from a previous run");
+    }
+    startSegment();
+    if (!writer_) {
+        error = "could not write to spool directory " + options_.directory;
+        return false;
+    }
+    return true;
+}
+
+void SampleSpool::append(const std::string &sample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!writer_.is_open()) {
+        return;
+    }
+
+    const auto line_bytes = sample.size() + 1;
+    while (total_bytes_ + line_bytes > options_.max_bytes && segments_.size() > 1) {
+        dropOldest();
+    }
+    if (total_bytes_ + line_bytes > options_.max_bytes) {
+        ++dropped_samples_;
+        return;
+    }
+    if (segments_.back().bytes > 0 && segments_.back().bytes + line_bytes > options_.segment_bytes) {
+        startSegment();
+    }
+
+    writer_ << sample << '\n';
+    writer_.flush();
+    segments_.back().bytes += line_bytes;
+    ++segments_.back().samples;
+    total_bytes_ += line_bytes;
+    ++total_samples_;
+}
+
+bool SampleSpool::empty() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_samples_ == read_samples_;
+}
+
+bool SampleSpool::nextBatch(std::string &frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    if (batch_token_ != 0) {
+        if (now - batch_sent_ < options_.ack_timeout) {
+            return false;
+        }
+        // A resend after a reconnect (batch_sent_ reset) is not a timeout.
+        if (batch_sent_ != std::chrono::steady_clock::time_point{} && ++batch_timeouts_ >= options_.max_attempts) {
+            deadLetterBatch();
+        } else {
+            frame = batch_;
+            batch_sent_ = now;
+            return true;
+        }
+    }
+
+    while (segments_.size() > 1 && read_offset_ >= segments_.front().bytes) {
+        retireFront();
+    }
+    if (read_offset_ >= segments_.front().bytes) {
+        return false;
+    }
+    // Never read the segment that is still being appended to.
+    if (segments_.size() == 1) {
+        startSegment();
+    }
+
+    std::ifstream in(segmentPath(segments_.front().seq), std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(read_offset_));
+    batch_.clear();
+    batch_bytes_ = 0;
+    batch_samples_ = 0;
+
+    std::string line;
+    std::vector<std::string> lines;
+    while (batch_bytes_ < options_.batch_bytes && std::getline(in, line)) {
+        if (in.eof()) {
+            // Torn final line from a crash mid-append; skip it.
+            batch_bytes_ += line.size();
+            break;
+        }
+        batch_bytes_ += line.size() + 1;
+        lines.push_back(std::move(line));
+    }
+
+    if (lines.empty()) {
+        if (batch_bytes_ == 0) {
+            LOG_WARN("SampleSpool", "Could not read spool segment ", segments_.front().seq, ", dropping it");
+            dropOldest();
+        } else {
+            read_offset_ += batch_bytes_;
+            savePosition();
+        }
+        return false;
+    }
+
+    batch_samples_ = lines.size();
+    batch_token_ = next_token_++;
+    batch_timeouts_ = 0;
+    batch_.reserve(batch_bytes_ + 32);
+    batch_.push_back('[');
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        if (i != 0) {
+            batch_.push_back(',');
+        }
+        if (i + 1 == lines.size() && lines[i].starts_with("{\"")) {
+            batch_ += "{\"ack\":";
+            append_number(batch_, batch_token_);
+            batch_.push_back(',');
+            batch_.append(lines[i], 1);
+        } else {
+            batch_ += lines[i];
+        }
+    }
+    batch_.push_back(']');
+
+    frame = batch_;
+    batch_sent_ = now;
+    return true;
+}
+
+bool SampleSpool::acknowledge(std::uint64_t token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (token == 0 || token != batch_token_) {
+        return false;
+    }
+    completeBatch();
+    return true;
+}
+
+void SampleSpool::requeueInFlight() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch_sent_ = {};
+}
+
+SampleSpool::Status SampleSpool::getStatus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {total_bytes_ - read_offset_, total_samples_ - read_samples_, dropped_samples_, dead_letter_samples_};
+}
+
+std::string SampleSpool::segmentPath(std::uint64_t seq) const {
+    std::string name(segment_prefix);
+    append_number(name, seq);
+    name += segment_suffix;
+    return (fs::path(options_.directory) / name).string();
+}
+
+void SampleSpool::startSegment() {
+    if (writer_.is_open()) {
+        writer_.close();
+    }
+    const auto seq = next_seq_++;
+    writer_.open(segmentPath(seq), std::ios::binary | std::ios::app);
+    segments_.push_back({seq, 0, 0});
+}
+
+void SampleSpool::retireFront() {
+    const auto &front = segments_.front();
+    std::error_code ec;
+    fs::remove(segmentPath(front.seq), ec);
+    total_bytes_ -= front.bytes;
+    total_samples_ -= front.samples;
+    segments_.pop_front();
+    read_offset_ = 0;
+    read_samples_ = 0;
+}
+
+void SampleSpool::dropOldest() {
+    const auto seq = segments_.front().seq;
+    dropped_samples_ += segments_.front().samples - read_samples_;
+    retireFront();
+    batch_.clear();
+    batch_token_ = 0;
+    if (segments_.empty()) {
+        startSegment();
+    }
+    savePosition();
+    LOG_WARN("SampleSpool", "Dropped spool segment ", seq);
+}
+
+void SampleSpool::completeBatch() {
+    read_offset_ += batch_bytes_;
+    read_samples_ += batch_samples_;
+    batch_.clear();
+    batch_token_ = 0;
+
+    if (read_offset_ >= segments_.front().bytes && segments_.size() > 1) {
+        retireFront();
+    }
+    savePosition();
+}
+
+void SampleSpool::deadLetterBatch() {
+    std::ofstream dead_letter(fs::path(options_.directory) / "dead-letter.log", std::ios::binary | std::ios::app);
+    dead_letter << batch_ << '\n';
+    dead_letter_samples_ += batch_samples_;
+    LOG_WARN("SampleSpool", "Batch of ", batch_samples_, " samples not acked after ", batch_timeouts_,
+             " attempts, moved to dead-letter.log");
+    completeBatch();
+}
+
+void SampleSpool::savePosition() {
+    std::ofstream position(fs::path(options_.directory) / "spool.pos", std::ios::trunc);
+    position << segments_.front().seq << ' ' << read_offset_ << '\n';
+}
@@ -1,77 +1,198 @@
 #include "WSClient.h"
 
-#include <iostream>
+#include "BatchFrames.h"
+#include "Logger.h"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <nlohmann/json.hpp>
 #include <utility>
+#include <algorithm>
+
+namespace {
+    // Appends one queued message to a JSON array frame; array messages are spliced in.
+    void append_element(std::string &frame, const std::string &message) {
+        std::string_view element(message);
+        if (element.size() >= 2 && element.front() == '[' && element.back() == ']') {
+            element = element.substr(1, element.size() - 2);
+            if (element.find_first_not_of(" \t\r\n") == std::string_view::npos) {
+                return;
+            }
+        }
+        if (frame.size() > 1) {
+            frame.push_back(',');
+        }
+        frame.append(element);
+    }
+}
 
 
-WSClient::WSClient(boost::asio::io_context &ioc_, const std::string &host_, const std::string &port_): host_(host_),
-    port_(port_), resolver_(ioc_), ioc_(ioc_), ws_(ioc_) {
+WSClient::WSClient(boost::asio::io_context &ioc_, const std::string &host_, const std::string &port_,
+                   CompressionOptions compression_options): host_(host_),
+                                                            port_(port_), resolver_(ioc_), ioc_(ioc_),
+                                                            compression_options_(compression_options),
+                                                            reconnect_timer_(ioc_), drain_timer_(ioc_) {
+    reset_stream();
 }
 
 WSClient::~WSClient() {
 }
 
 void WSClient::connect() {
-    boost::asio::spawn(this->ioc_, [this](boost::asio::yield_context yield) {
-        boost::beast::error_code ec;
+    boost::asio::co_spawn(this->ioc_, do_connect(), boost::asio::detached);
+}
 
-        const auto results = this->resolver_.async_resolve(this->host_, this->port_, yield[ec]);
-        if (ec) {
-            std::lock_guard<std::mutex> lock(callbacks_mutex_);
-            on_connect_callback_(ec);
-            return fail(ec, "resolve");
-        }
-        boost::beast::get_lowest_layer(this->ws_).expires_after(std::chrono::seconds(30));
+boost::asio::awaitable<void> WSClient::do_connect() {
+    boost::beast::error_code ec;
+    auto await_ec = boost::asio::redirect_error(boost::asio::use_awaitable, ec);
 
-        const auto ep = boost::beast::get_lowest_layer(this->ws_).async_connect(results, yield[ec]);
-        if (ec) {
-            std::lock_guard<std::mutex> lock(callbacks_mutex_);
-            on_connect_callback_(ec);
-            return fail(ec, "connect");
-        }
+    const auto results = co_await this->resolver_.async_resolve(this->host_, this->port_, await_ec);
+    if (ec) {
+        notify_connect(ec);
+        fail(ec, "resolve");
+        connection_lost();
+        co_return;
+    }
+    boost::beast::get_lowest_layer(*this->ws_).expires_after(std::chrono::seconds(30));
+
+    const auto ep = co_await boost::beast::get_lowest_layer(*this->ws_).async_connect(results, await_ec);
+    if (ec) {
+        notify_connect(ec);
+        fail(ec, "connect");
+        connection_lost();
+        co_return;
+    }
 
-        std::string host_with_port = this->host_ + ':' + std::to_string(ep.port());
+    std::string host_with_port = this->host_ + ':' + std::to_string(ep.port());
 
-        boost::beast::get_lowest_layer(this->ws_).expires_never();
+    boost::beast::get_lowest_layer(*this->ws_).expires_never();
 
-        this->ws_.set_option(
-            boost::beast::websocket::stream_base::timeout::suggested(
-                boost::beast::role_type::client));
+    this->ws_->set_option(
+        boost::beast::websocket::stream_base::timeout::suggested(
+            boost::beast::role_type::client));
 
-        this->ws_.set_option(boost::beast::websocket::stream_base::decorator(
-            [](boost::beast::websocket::request_type &req) {
-                req.set(boost::beast::http::field::user_agent,
-                        std::string(BOOST_BEAST_VERSION_STRING) +
-                        " websocket-client-coro");
-            }));
+    this->ws_->set_option(boost::beast::websocket::stream_base::decorator(
+        [](boost::beast::websocket::request_type &req) {
+            req.set(boost::beast::http::field::user_agent,
+                    std::string(BOOST_BEAST_VERSION_STRING) +
+                    " websocket-client-coro");
+            req.set(boost::beast::http::field::sec_websocket_protocol, BatchFrames::subprotocol);
+        }));
 
-        this->ws_.async_handshake(host_with_port, "/", yield[ec]);
-        if (ec) {
-            std::lock_guard<std::mutex> lock(callbacks_mutex_);
-            on_connect_callback_(ec);
-            return fail(ec, "handshake");
-        }
+    this->ws_->set_option(this->compression_options_.toPermessageDeflate());
 
-        this->is_connected_.store(true);
-        std::cout << "Connected to: " << host_with_port << std::endl;
-        read_loop();
+    boost::beast::websocket::response_type response;
+    co_await this->ws_->async_handshake(response, host_with_port, "/", await_ec);
+    if (ec) {
+        notify_connect(ec);
+        fail(ec, "handshake");
+        connection_lost();
+        co_return;
+    }
+    this->batch_frames_ = response[boost::beast::http::field::sec_websocket_protocol] == BatchFrames::subprotocol;
 
-        if (this->on_connect_callback_) {
-            std::lock_guard<std::mutex> lock(callbacks_mutex_);
-            this->on_connect_callback_({});
-        }
-    });
+    if (this->stopping_) {
+        boost::beast::get_lowest_layer(*this->ws_).close();
+        co_return;
+    }
+
+    this->connected_at_ = std::chrono::steady_clock::now();
+
+    this->is_connected_.store(true);
+    LOG_INFO("WSClient", "Connected to: ", host_with_port);
+    notify_connect({});
+    read_loop();
+    // The backlog waits for the first credit grant; servers without flow control get it one
+    // batch per drain tick instead of all at once.
+    flush_pending();
+    schedule_pending_drain();
 }
 
-void WSClient::disconnect() {
-    if (!this->is_connected_.load()) {
+void WSClient::connection_lost() {
+    this->is_connected_ = false;
+    // Messages handed to send() that were not written, or whose write never completed, go back
+    // ahead of the ones queued while offline; the server replaces points it already stored.
+    std::deque<std::string> unsent;
+    if (this->writing_) {
+        unsent.push_back(std::move(this->in_flight_));
+    }
+    for (auto &message: this->write_queue_) {
+        unsent.push_back(std::move(message.payload));
+    }
+    for (auto &message: this->pending_) {
+        unsent.push_back(std::move(message));
+    }
+    while (unsent.size() > this->max_pending_messages_) {
+        unsent.pop_front();
+        ++this->dropped_count_;
+    }
+    this->pending_ = std::move(unsent);
+    this->write_queue_.clear();
+    this->writing_ = false;
+    // The next session grants its own credits if the server does flow control.
+    this->flow_active_ = false;
+    this->credits_ = 0;
+    this->throttle_ = 0;
+    schedule_reconnect();
+}
+
+void WSClient::schedule_reconnect() {
+    if (!this->reconnect_ || this->stopping_ || this->reconnect_pending_) {
         return;
     }
 
+    const auto now = std::chrono::steady_clock::now();
+    if (this->connected_at_ != std::chrono::steady_clock::time_point{} &&
+        now - this->connected_at_ >= this->reconnect_options_.stable_after) {
+        this->reconnect_attempt_ = 0;
+    }
+    this->connected_at_ = {};
+
+    // Abort whatever still runs on the old stream; its handlers are ignored from here on.
+    ++this->generation_;
+    boost::beast::get_lowest_layer(*this->ws_).close();
+
+    const auto delay = this->reconnect_options_.delayFor(this->reconnect_attempt_++, this->rng_);
+    LOG_INFO("WSClient", "Reconnecting in ", delay.count(), " ms (attempt ", this->reconnect_attempt_, ")");
+    this->reconnect_pending_ = true;
+    this->reconnect_timer_.expires_after(delay);
+    this->reconnect_timer_.async_wait([this](const boost::beast::error_code &ec) {
+        this->reconnect_pending_ = false;
+        if (ec || this->stopping_) {
+            return;
+        }
+        reset_stream();
+        boost::asio::co_spawn(this->ioc_, do_connect(), boost::asio::detached);
+    });
+}
+
+void WSClient::reset_stream() {
+    // A websocket stream cannot be reused after a failed or closed connection.
+    ++this->generation_;
+    this->ws_ = std::make_unique<boost::beast::websocket::stream<MeteredTcpStream> >(this->ioc_);
+    boost::beast::get_lowest_layer(*this->ws_).rate_policy().attach(&this->compression_stats_);
+    this->buffer_.consume(this->buffer_.size());
+}
+
+void WSClient::notify_connect(const boost::beast::error_code &ec) {
+    std::lock_guard<std::mutex> lock(callbacks_mutex_);
+    if (this->on_connect_callback_) {
+        this->on_connect_callback_(ec);
+    }
+}
 
+void WSClient::disconnect() {
     // change to ioc_ thread (which is created from connect fn)
     boost::asio::post(this->ioc_, [this]() {
-        this->ws_.async_close(boost::beast::websocket::close_code::normal, [this](auto ec) {
+        this->stopping_ = true;
+        this->reconnect_timer_.cancel();
+        this->drain_timer_.cancel();
+        if (!this->is_connected_.load()) {
+            return;
+        }
+        this->ws_->async_close(boost::beast::websocket::close_code::normal, [this](auto ec) {
             this->is_connected_.store(false);
             if (ec) {
                 if (ec && ec != boost::asio::error::not_connected) { return fail(ec, "close"); }
@@ -80,50 +201,247 @@ void WSClient::disconnect() {
     });
 }
 
-void WSClient::send(const std::string &message) {
-    const auto shared_message = std::make_shared<std::string>(message);
+void WSClient::send(std::string message) {
+    boost::asio::post(this->ioc_, [this, message = std::move(message)]() mutable {
+        if (!this->is_connected_) {
+            queue_pending(std::move(message));
+            return;
+        }
+
+        if (!this->flow_active_) {
+            write_frame(std::move(message));
+            return;
+        }
+
+        // Live samples take the next credit; queued ones follow with whatever credits are left.
+        if (this->credits_ > 0) {
+            --this->credits_;
+            write_frame(std::move(message));
+            flush_pending();
+            return;
+        }
+
+        queue_pending(std::move(message));
+    });
+}
+
+void WSClient::applyFlowControl(const FlowControlMessage &message) {
+    boost::asio::post(this->ioc_, [this, message]() {
+        this->flow_active_ = true;
+        this->credits_ = message.credits;
+        this->throttle_ = message.throttle;
+        flush_pending();
+    });
+}
+
+void WSClient::setMinimumResolution(std::chrono::milliseconds minimum_resolution) {
+    boost::asio::post(this->ioc_, [this, minimum_resolution]() {
+        this->minimum_resolution_ = minimum_resolution;
+    });
+}
+
+void WSClient::setMaxPendingMessages(std::size_t max_pending_messages) {
+    boost::asio::post(this->ioc_, [this, max_pending_messages]() {
+        this->max_pending_messages_ = std::max<std::size_t>(1, max_pending_messages);
+    });
+}
+
+void WSClient::setPendingDrainInterval(std::chrono::milliseconds interval) {
+    boost::asio::post(this->ioc_, [this, interval]() {
+        this->pending_drain_interval_ = std::max(interval, std::chrono::milliseconds(1));
+    });
+}
+
+void WSClient::setMaxCoalescedBytes(std::size_t max_coalesced_bytes) {
+    boost::asio::post(this->ioc_, [this, max_coalesced_bytes]() {
+        this->max_coalesced_bytes_ = max_coalesced_bytes;
+    });
+}
+
+void WSClient::enableReconnect(const ReconnectOptions &options) {
+    boost::asio::post(this->ioc_, [this, options]() {
+        this->reconnect_options_ = options;
+        this->reconnect_ = options.enabled;
+    });
+}
+
+std::size_t WSClient::getDroppedCount() const {
+    return this->dropped_count_.load();
+}
+
+void WSClient::write_frame(std::string &&frame) {
+    this->write_queue_.push_back({std::move(frame), std::chrono::steady_clock::now()});
+    if (!this->writing_) {
+        write_next();
+    }
+}
+
+void WSClient::write_next() {
+    if (this->write_queue_.empty()) {
+        this->writing_ = false;
+        return;
+    }
+    this->writing_ = true;
+    this->in_flight_queued_at_ = this->write_queue_.front().queued_at;
+
+    // Messages that queued up behind the previous write go out together as one array frame.
+    if (this->write_queue_.size() == 1 || this->max_coalesced_bytes_ == 0 ||
+        this->write_queue_.front().payload.size() >= this->max_coalesced_bytes_) {
+        this->in_flight_ = std::move(this->write_queue_.front().payload);
+        this->write_queue_.pop_front();
+        this->in_flight_messages_ = 1;
+    } else {
+        this->in_flight_.clear();
+        this->in_flight_.push_back('[');
+        this->in_flight_messages_ = 0;
+        while (!this->write_queue_.empty() &&
+               (this->in_flight_messages_ == 0 ||
+                this->in_flight_.size() + this->write_queue_.front().payload.size() < this->max_coalesced_bytes_)) {
+            append_element(this->in_flight_, this->write_queue_.front().payload);
+            this->write_queue_.pop_front();
+            ++this->in_flight_messages_;
+        }
+        this->in_flight_.push_back(']');
+    }
+    this->in_flight_started_ = std::chrono::steady_clock::now();
+
+    this->ws_->async_write(
+        boost::asio::buffer(this->in_flight_),
+        [this, generation = this->generation_](auto ec, auto) {
+            if (generation != this->generation_) {
+                return;
+            }
+            if (!ec) {
+                this->compression_stats_.recordWrite(this->in_flight_, this->compression_options_);
+            }
 
-    boost::asio::post(this->ioc_, [this, shared_message]() {
-        this->ws_.async_write(
-            boost::asio::buffer(*shared_message),
-            [this, shared_message](auto ec, auto) {
+            {
+                std::lock_guard<std::mutex> lock(callbacks_mutex_);
                 if (this->on_send_callback_) {
-                    std::lock_guard<std::mutex> lock(callbacks_mutex_);
-                    on_send_callback_(ec);
+                    const auto now = std::chrono::steady_clock::now();
+                    this->on_send_callback_({
+                        ec, this->in_flight_.size(), this->in_flight_messages_, this->write_queue_.size(),
+                        this->in_flight_started_ - this->in_flight_queued_at_, now - this->in_flight_started_
+                    });
                 }
+            }
 
-                if (ec) {
-                    return fail(ec, "write");
-                }
-            });
+            if (ec) {
+                fail(ec, "write");
+                return connection_lost();
+            }
+            write_next();
+        });
+}
+
+void WSClient::queue_pending(std::string &&message) {
+    const auto now = std::chrono::steady_clock::now();
+
+    // Overloaded server: keep at most one sample per minimum resolution interval.
+    if (this->throttle_ >= 2 && !this->pending_.empty() && now - this->last_queued_ < this->minimum_resolution_) {
+        ++this->dropped_count_;
+        return;
+    }
+
+    if (this->pending_.size() >= this->max_pending_messages_) {
+        this->pending_.pop_front();
+        ++this->dropped_count_;
+    }
+    this->pending_.push_back(std::move(message));
+    this->last_queued_ = now;
+}
+
+void WSClient::flush_pending() {
+    while (this->credits_ > 0 && !this->pending_.empty()) {
+        --this->credits_;
+        write_pending_batch();
+    }
+}
+
+void WSClient::schedule_pending_drain() {
+    this->drain_timer_.expires_after(this->pending_drain_interval_);
+    this->drain_timer_.async_wait([this, generation = this->generation_](const boost::beast::error_code &ec) {
+        // Once credits arrive, flush_pending drains the backlog instead.
+        if (ec || generation != this->generation_ || this->stopping_ || this->flow_active_ ||
+            !this->is_connected_) {
+            return;
+        }
+        write_pending_batch();
+        if (!this->pending_.empty()) {
+            schedule_pending_drain();
+        }
     });
 }
 
+// One array frame from the front of pending_, at most max_coalesced_bytes_ unless a single
+// message is larger: a spool drain can hold several 256 KiB batches, more than the server
+// accepts in one message.
+void WSClient::write_pending_batch() {
+    if (this->pending_.empty()) {
+        return;
+    }
+
+    std::string frame;
+    frame.push_back('[');
+    std::size_t messages = 0;
+    while (!this->pending_.empty() &&
+           (messages == 0 || frame.size() + this->pending_.front().size() + 2 <= this->max_coalesced_bytes_)) {
+        append_element(frame, this->pending_.front());
+        this->pending_.pop_front();
+        ++messages;
+    }
+    frame.push_back(']');
+    write_frame(std::move(frame));
+}
+
 void WSClient::read_loop() {
     // does not need boost::asio::post because it is only called from connect
     // which is already in the thread
-    this->ws_.async_read(this->buffer_, [this](auto ec, auto) {
+    this->ws_->async_read(this->buffer_, [this, generation = this->generation_](auto ec, auto) {
+        if (generation != this->generation_) {
+            return;
+        }
+
         if (ec == boost::beast::websocket::error::closed) {
+            LOG_INFO("WSClient", "Connection closed by peer.");
+            return connection_lost();
+        }
+
+        // Our own disconnect() aborts the pending read.
+        if (ec == boost::asio::error::operation_aborted) {
             is_connected_ = false;
-            std::cout << "Connection closed by peer." << std::endl;
             return;
         }
 
         if (ec) {
-            return fail(ec, "read");
+            fail(ec, "read");
+            return connection_lost();
         }
 
+        this->compression_stats_.recordRead(this->buffer_.size());
+
         std::function<void(const std::string &)> handler_copy; {
             std::lock_guard<std::mutex> lock(callbacks_mutex_);
             handler_copy = on_message_callback_;
         }
 
         if (handler_copy) {
-            handler_copy(boost::beast::buffers_to_string(buffer_.data()));
-        }
-
-        if (this->on_message_callback_) {
-            handler_copy(boost::beast::buffers_to_string(this->buffer_.data()));
+            auto message = boost::beast::buffers_to_string(this->buffer_.data());
+
+            // With the batch subprotocol the server gathers queued frames into one JSON array
+            // message; hand them to the callback one by one.
+            if (this->batch_frames_ && !message.empty() && message.front() == '[') {
+                const auto batch = nlohmann::json::parse(message, nullptr, false);
+                if (batch.is_array()) {
+                    for (const auto &element: batch) {
+                        handler_copy(element.dump());
+                    }
+                } else {
+                    handler_copy(message);
+                }
+            } else {
+                handler_copy(message);
+            }
         }
 
         this->buffer_.consume(this->buffer_.size());
@@ -137,6 +455,10 @@ bool WSClient::isConnected() const {
     return this->is_connected_.load();
 }
 
+const CompressionStats &WSClient::getCompressionStats() const {
+    return this->compression_stats_;
+}
+
 void WSClient::setOnMessageCallback(std::function<void(const std::string &)> on_message_callback) {
     std::lock_guard<std::mutex> lock(callbacks_mutex_);
     this->on_message_callback_ = std::move(on_message_callback);
@@ -147,11 +469,11 @@ void WSClient::setOnConnectCallback(std::function<void(const boost::beast::error
     this->on_connect_callback_ = std::move(on_connect_callback);
 }
 
-void WSClient::setOnSendCallback(std::function<void(const boost::beast::error_code &)> on_send_callback) {
+void WSClient::setOnSendCallback(std::function<void(const SendReport &)> on_send_callback) {
     std::lock_guard<std::mutex> lock(callbacks_mutex_);
     this->on_send_callback_ = std::move(on_send_callback);
 }
 
 void WSClient::fail(const boost::beast::error_code &ec, char const *what) {
-    std::cerr << what << ": " << ec.message() << "\n";
+    LOG_ERROR("WSClient", what, ": ", ec.message());
 }
\ No newline at end of file
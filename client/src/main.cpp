@@ -1,55 +1,77 @@
 #include "WSClient.h"
 #include "PerformanceMonitor.h"
+#ifdef _WIN32
+#include "PdhCollector.h"
+#else
+#include "LinuxProcCollector.h"
+#include "LinuxProcessCollector.h"
+#endif
+#include "DeadbandFilter.h"
+#include "SampleJson.h"
+#include "SampleSpool.h"
+#include "CommandLine.h"
+#include "Logger.h"
 
 #include <nlohmann/json.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <chrono>
 #include <thread>
 #include <functional>
+#include <memory>
 #include <atomic>
 #include <csignal>
+#include <cstdlib>
 #include <sstream>
 #include <iomanip>
 
 using json = nlohmann::json;
 
-std::string format_timestamp_iso8601(const std::chrono::system_clock::time_point &tp) {
-    auto time_t = std::chrono::system_clock::to_time_t(tp);
-    std::tm tm_utc;
-    gmtime_s(&tm_utc, &time_t);
-    std::stringstream ss;
-    ss << std::put_time(&tm_utc, "%Y-%m-%dT%H:%M:%SZ");
-    return ss.str();
-}
-
-std::string format_data_to_json(const std::string &client_id, const std::vector<MonitoredPdhCounterData> &data_points) {
+std::string format_data_to_json(const std::string &client_id, const std::vector<MonitoredCounterData> &data_points,
+                                std::chrono::milliseconds max_silence) {
     auto timestamp = std::chrono::system_clock::now();
     for (const auto &dp: data_points) {
-        if (dp.hCounter != nullptr && dp.pdhStatus == ERROR_SUCCESS) {
+        if (dp.valid) {
             timestamp = dp.timestamp;
             break;
         }
     }
 
-    json counters_array = json::array();
+    if (std::any_of(data_points.begin(), data_points.end(), [](const auto &dp) { return dp.summary.count > 0; })) {
+        std::vector<std::pair<std::string, CounterSummary> > summaries;
+        summaries.reserve(data_points.size());
+        for (const auto &dp: data_points) {
+            if (!dp.valid) continue;
+            summaries.emplace_back(dp.counter_name, dp.summary);
+        }
+        return format_summary_sample_json(client_id, timestamp, summaries, max_silence);
+    }
+
+    std::vector<std::pair<std::string, double> > counters;
+    counters.reserve(data_points.size());
     for (const auto &dp: data_points) {
-        if (dp.hCounter == nullptr || dp.pdhStatus != ERROR_SUCCESS) continue;
-        counters_array.push_back({
-            {"name", dp.counter_name},
-            {"value", dp.counter_value}
-        });
+        if (!dp.valid) continue;
+        counters.emplace_back(dp.counter_name, dp.counter_value);
     }
 
-    json j = {
-        {"clientId", client_id},
-        {"timestamp", format_timestamp_iso8601(timestamp)},
-        {"counters", counters_array}
-    };
+    return format_sample_json(client_id, timestamp, counters, max_silence);
+}
 
-    return j.dump();
+std::unique_ptr<CounterCollector> make_collector() {
+#ifdef _WIN32
+    auto collector = std::make_unique<PdhCollector>();
+    collector->add_counter("CPU Usage",
+        L"\\Processor Information(_Total)\\% Processor Utility");
+    collector->add_counter("Available RAM (MB)",
+        L"\\Memory\\Available MBytes");
+    return collector;
+#else
+    return std::make_unique<LinuxProcCollector>();
+#endif
 }
 
 std::string get_user_input(const std::string &prompt, const std::string &default_value = "") {
@@ -70,6 +92,9 @@ std::string get_user_input(const std::string &prompt, const std::string &default
 
 int main(int argc, char *argv[]) {
     std::cout << "--- WebSocket Performance Monitor Client ---\n";
+    const CommandLine cl(argc, argv);
+    Logger::configure(LogOptions::fromCommandLine(cl));
+    const auto compression = CompressionOptions::fromCommandLine(cl);
     std::string host = get_user_input("Enter server host (IP address)", "127.0.0.1");
     std::string port = get_user_input("Enter server port", "6969");
     std::string client_id = get_user_input("Enter a unique Client ID");
@@ -82,60 +107,211 @@ int main(int argc, char *argv[]) {
     std::cout << "\nConfiguration set:" << std::endl;
     std::cout << "  - Client ID:   " << client_id << std::endl;
     std::cout << "  - Server:      " << host << ":" << port << std::endl;
+    std::cout << "  - Compression: " << (compression.enabled ? "permessage-deflate" : "off") << std::endl;
     std::cout << "-------------------------------------------\n" << std::endl;
 
     boost::asio::io_context ioc;
-    WSClient client(ioc, host, port);
-    PerformanceMonitor pdh_monitor(std::chrono::seconds(5));
+    WSClient client(ioc, host, port, compression);
+    // Sampling faster than reporting sends one min/max/mean/quantile summary per counter per
+    // report interval instead of a single value.
+    const auto report_interval = std::chrono::milliseconds(cl.getInt("report-interval-ms", 5000));
+    const auto sample_interval = std::chrono::milliseconds(cl.getInt("sample-interval-ms", report_interval.count()));
+    PerformanceMonitor monitor(make_collector(), sample_interval, report_interval);
+    // --counter-intervals="Swap Used (MB)=60000;Disk Busy (%)=1000" samples single counters at
+    // their own rate; unparsable intervals are rejected by the monitor.
+    auto longest_interval = std::max(report_interval, sample_interval);
+    for (const auto &[name, interval]: cl.getMap("counter-intervals")) {
+        const auto counter_interval = std::chrono::milliseconds(std::strtoll(interval.c_str(), nullptr, 10));
+        monitor.set_counter_interval(name, counter_interval);
+        longest_interval = std::max(longest_interval, counter_interval);
+    }
 
-    pdh_monitor.set_callback([&](const std::vector<MonitoredPdhCounterData> &data_snapshot) {
-        if (!client.isConnected()) {
-            std::cout << "PDH Callback: WebSocket not connected. Skipping send." << std::endl;
+    const auto spool_options = SpoolOptions::fromCommandLine(cl);
+    SampleSpool spool(spool_options);
+    bool spooling = false;
+    if (spool_options.enabled) {
+        std::string error;
+        if (spool.open(error)) {
+            spooling = true;
+        } else {
+            LOG_WARN("Main", "Spool disabled: ", error);
+        }
+    }
+    std::atomic<int> server_throttle{0};
+    std::atomic<bool> spooling_offline{false};
+
+    const auto deadband_options = DeadbandOptions::fromCommandLine(cl);
+    DeadbandFilter deadband(deadband_options);
+    // The server stops holding a value once the counter was silent for longer than this: one
+    // heartbeat plus a reporting interval, and one more interval of slack.
+    const auto max_silence = (deadband_options.enabled
+                                  ? std::chrono::duration_cast<std::chrono::milliseconds>(deadband_options.heartbeat)
+                                  : std::chrono::milliseconds(0)) + 2 * longest_interval;
+
+    // Called from the monitor threads with connected as checked before building the payload.
+    const auto publish = [&](std::string json_payload, const bool connected) {
+        if (!connected) {
+            if (!spooling_offline.exchange(true)) {
+                LOG_WARN("Monitor", "WebSocket not connected. Spooling samples to ", spool_options.directory);
+            }
+            spool.append(json_payload);
             return;
         }
-        if (data_snapshot.empty()) {
+        spooling_offline = false;
+        LOG_INFO("Monitor", "Sending performance data... [", client.getCompressionStats().summary(), "]");
+        client.send(std::move(json_payload));
+    };
+
+    // Samples WSClient or the spool dropped never reach the server, so once the count grows the
+    // deadband reports every counter again. Only touched on the monitor thread.
+    std::uint64_t lost_samples = 0;
+    monitor.set_callback([&](const std::vector<MonitoredCounterData> &data_snapshot) {
+        const bool connected = client.isConnected();
+        if (!connected && !spooling) {
+            LOG_WARN("Monitor", "WebSocket not connected. Skipping send.");
             return;
         }
-        std::string json_payload = format_data_to_json(client_id, data_snapshot);
-        std::cout << "PDH: Sending performance data..." << std::endl;
-        client.send(json_payload);
+        const auto spool_status = spool.getStatus();
+        const auto lost = client.getDroppedCount() + spool_status.dropped_samples + spool_status.dead_letter_samples;
+        if (lost != lost_samples) {
+            lost_samples = lost;
+            deadband.reset();
+        }
+        // Filter only what is actually sent or spooled; anything lost after that is caught by
+        // the count above on the next tick.
+        const auto &due = deadband.filter(data_snapshot);
+        if (due.empty()) {
+            return;
+        }
+        publish(format_data_to_json(client_id, due, max_silence), connected);
     });
 
+    // Top-N processes run as a second monitor at their own interval. They bypass the deadband:
+    // the slots change names whenever the ranking changes.
+    std::unique_ptr<PerformanceMonitor> process_monitor;
+#ifdef _WIN32
+    if (cl.getBool("processes", false)) {
+        LOG_WARN("Main", "Per-process counters are only collected on Linux");
+    }
+#else
+    if (const auto process_options = ProcessOptions::fromCommandLine(cl); process_options.enabled) {
+        process_monitor = std::make_unique<PerformanceMonitor>(
+            std::make_unique<LinuxProcessCollector>(process_options.top, process_options.raise_fd_limit),
+            process_options.interval);
+        const auto process_silence = 2 * process_options.interval;
+        process_monitor->set_callback([&, process_silence](const std::vector<MonitoredCounterData> &data_snapshot) {
+            const bool connected = client.isConnected();
+            if (connected || spooling) {
+                publish(format_data_to_json(client_id, data_snapshot, process_silence), connected);
+            }
+        });
+    }
+#endif
+
+    const auto reconnect = ReconnectOptions::fromCommandLine(cl);
+    client.enableReconnect(reconnect);
+
+    // Monitoring keeps running across reconnects; samples taken while offline go to the spool.
     client.setOnConnectCallback([&](boost::system::error_code ec) {
         if (ec) {
-            std::cerr << "WebSocket: Failed to connect: " << ec.message() << std::endl;
-            ioc.stop();
+            if (!reconnect.enabled) {
+                LOG_ERROR("WebSocket", "Failed to connect: ", ec.message());
+                ioc.stop();
+            }
             return;
         }
-        std::cout << "WebSocket: Connection successful!" << std::endl;
-        std::cout << "Main: Starting performance monitoring." << std::endl;
-        pdh_monitor.start_monitoring();
+        LOG_INFO("WebSocket", "Connection successful!");
+        spool.requeueInFlight();
+        deadband.reset();
+    });
+
+    client.setOnSendCallback([](const SendReport &report) {
+        if (!report.ec) {
+            LOG_DEBUG("WebSocket", "Sent ", report.messages, " message(s), ", report.bytes, " B, queued ",
+                      std::chrono::duration<double, std::milli>(report.queued).count(), " ms, write ",
+                      std::chrono::duration<double, std::milli>(report.write).count(), " ms, ",
+                      report.queue_depth, " waiting");
+        }
     });
 
-    client.setOnMessageCallback([](const std::string &message) {
-        std::cout << "WebSocket: Message received: " << message << std::endl;
+    client.setMinimumResolution(std::chrono::milliseconds(cl.getInt("min-resolution-ms", 30000)));
+    client.setMaxPendingMessages(static_cast<std::size_t>(cl.getInt("max-pending", 1024)));
+    client.setPendingDrainInterval(spool_options.drain_interval);
+
+    client.setOnMessageCallback([&](const std::string &message) {
+        FlowControlMessage flow;
+        if (FlowControlMessage::fromJson(message, flow)) {
+            client.applyFlowControl(flow);
+            if (server_throttle.exchange(flow.throttle) != flow.throttle) {
+                LOG_INFO("WebSocket", "Server throttle level ", flow.throttle, " (credits ", flow.credits,
+                         ", dropped ", client.getDroppedCount(), ")");
+            }
+            return;
+        }
+        const auto parsed = json::parse(message, nullptr, false);
+        if (parsed.is_object() && parsed.value("type", "") == "ack") {
+            if (const auto rejected = parsed.value("rejected", std::uint64_t{0}); rejected > 0) {
+                LOG_WARN("Spool", "Server rejected ", rejected, " spooled sample(s)");
+            }
+            if (spool.acknowledge(parsed.value("ack", std::uint64_t{0})) && spool.empty()) {
+                LOG_INFO("Spool", "Spool drained");
+            }
+            return;
+        }
+        LOG_INFO("WebSocket", "Message received: ", message);
     });
 
+    // Spooled samples go out one batch at a time, only while connected and the server is not
+    // throttling, so a backlog never crowds out live samples.
+    boost::asio::steady_timer drain_timer(ioc);
+    std::function<void()> schedule_drain = [&]() {
+        drain_timer.expires_after(spool_options.drain_interval);
+        drain_timer.async_wait([&](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            std::string frame;
+            if (client.isConnected() && server_throttle == 0 && spool.nextBatch(frame)) {
+                const auto status = spool.getStatus();
+                LOG_DEBUG("Spool", "Sending spooled batch, ", status.pending_samples, " samples pending");
+                client.send(std::move(frame));
+            }
+            schedule_drain();
+        });
+    };
+    if (spooling) {
+        schedule_drain();
+    }
+
     boost::asio::signal_set signals(ioc, SIGINT, SIGTERM);
     signals.async_wait([&](boost::system::error_code /*ec*/, int /*signum*/) {
-        std::cout << "\nSignal received. Initiating shutdown..." << std::endl;
-        pdh_monitor.stop_monitoring();
+        LOG_INFO("Main", "Signal received. Initiating shutdown...");
+        monitor.stop_monitoring();
+        if (process_monitor) {
+            process_monitor->stop_monitoring();
+        }
+        drain_timer.cancel();
         if (client.isConnected()) {
-            std::cout << "Main: Disconnecting WebSocket..." << std::endl;
-            client.disconnect();
+            LOG_INFO("Main", "Disconnecting WebSocket...");
         }
+        client.disconnect();
     });
 
-    pdh_monitor.add_counter("CPU Usage",
-        L"\\Processor Information(_Total)\\% Processor Utility");
-    pdh_monitor.add_counter("Available RAM (MB)",
-        L"\\Memory\\Available MBytes");
-
-    if (!pdh_monitor.initialize()) {
+    if (!monitor.initialize()) {
         std::cerr << "Main: Failed to initialize PerformanceMonitor. Exiting." << std::endl;
         return 1;
     }
 
+    if (process_monitor && !process_monitor->initialize()) {
+        LOG_WARN("Main", "Per-process counters disabled, /proc could not be read");
+        process_monitor.reset();
+    }
+
+    LOG_INFO("Main", "Starting performance monitoring.");
+    monitor.start_monitoring();
+    if (process_monitor) {
+        process_monitor->start_monitoring();
+    }
     client.connect();
 
     std::thread asio_thread([&ioc]() {
@@ -146,6 +322,7 @@ int main(int argc, char *argv[]) {
 
     asio_thread.join();
 
+    Logger::shutdown();
     std::cout << "Main: Shutdown complete. Exiting." << std::endl;
     return 0;
 }
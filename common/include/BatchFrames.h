@@ -0,0 +1,35 @@
+#ifndef BATCHFRAMES_H
+#define BATCHFRAMES_H
+
+#include <string_view>
+
+// WebSocket subprotocol under which the server may gather several queued JSON frames into one
+// JSON array message. Only clients that offer it in Sec-WebSocket-Protocol, and get it echoed
+// back, have to split such arrays; every other client receives one message per frame.
+struct BatchFrames {
+    static constexpr const char *subprotocol = "perfmon.batch";
+
+    // Whether a comma separated Sec-WebSocket-Protocol list offers the subprotocol.
+    static bool offered(std::string_view protocols) {
+        while (!protocols.empty()) {
+            const auto comma = protocols.find(',');
+            auto token = protocols.substr(0, comma);
+            while (!token.empty() && (token.front() == ' ' || token.front() == '\t')) {
+                token.remove_prefix(1);
+            }
+            while (!token.empty() && (token.back() == ' ' || token.back() == '\t')) {
+                token.remove_suffix(1);
+            }
+            if (token == std::string_view(subprotocol)) {
+                return true;
+            }
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            protocols.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+};
+
+#endif //BATCHFRAMES_H
@@ -0,0 +1,108 @@
+#ifndef CAPTUREFORMAT_H
+#define CAPTUREFORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// Traffic capture file: an 8 byte magic, the capture start as little-endian u64 nanoseconds
+// since the Unix epoch, then one record per inbound WebSocket message:
+//   varint time since the previous record (ns), varint session id, varint length, payload.
+// Records are in arrival order across all sessions.
+struct CaptureFormat {
+    static constexpr char magic[8] = {'P', 'M', 'C', 'A', 'P', '0', '0', '1'};
+    static constexpr std::size_t header_size = sizeof(magic) + 8;
+
+    static void appendVarint(std::string &out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static std::string header(std::uint64_t start_unix_ns) {
+        std::string out(magic, sizeof(magic));
+        for (int i = 0; i < 8; ++i) {
+            out.push_back(static_cast<char>((start_unix_ns >> (8 * i)) & 0xff));
+        }
+        return out;
+    }
+};
+
+struct CaptureRecord {
+    std::uint64_t time_ns = 0; // since the capture start
+    std::uint64_t session_id = 0;
+    std::string payload;
+};
+
+class CaptureReader {
+public:
+    bool open(const std::string &path) {
+        in_.open(path, std::ios::binary);
+        char buf[CaptureFormat::header_size];
+        if (!in_ || !in_.read(buf, sizeof(buf)) ||
+            std::memcmp(buf, CaptureFormat::magic, sizeof(CaptureFormat::magic)) != 0) {
+            return false;
+        }
+        start_unix_ns_ = 0;
+        for (int i = 0; i < 8; ++i) {
+            const auto byte = static_cast<unsigned char>(buf[sizeof(CaptureFormat::magic) + i]);
+            start_unix_ns_ |= static_cast<std::uint64_t>(byte) << (8 * i);
+        }
+        in_.seekg(0, std::ios::end);
+        file_size_ = static_cast<std::uint64_t>(in_.tellg());
+        in_.seekg(CaptureFormat::header_size);
+        time_ns_ = 0;
+        return static_cast<bool>(in_);
+    }
+
+    // False at the end of the file or on a truncated or corrupt record (a capture cut off
+    // mid-write); a length past the end of the file stops the replay instead of allocating it.
+    bool next(CaptureRecord &record) {
+        std::uint64_t delta, session, length;
+        if (!readVarint(delta) || !readVarint(session) || !readVarint(length)) {
+            return false;
+        }
+        const auto position = in_.tellg();
+        if (position < 0 || length > file_size_ - static_cast<std::uint64_t>(position)) {
+            return false;
+        }
+        record.payload.resize(static_cast<std::size_t>(length));
+        if (length != 0 && !in_.read(record.payload.data(), static_cast<std::streamsize>(length))) {
+            return false;
+        }
+        time_ns_ += delta;
+        record.time_ns = time_ns_;
+        record.session_id = session;
+        return true;
+    }
+
+    [[nodiscard]] std::uint64_t startUnixNs() const {
+        return start_unix_ns_;
+    }
+
+private:
+    bool readVarint(std::uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const auto c = in_.get();
+            if (c == std::char_traits<char>::eof()) {
+                return false;
+            }
+            value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::ifstream in_;
+    std::uint64_t file_size_ = 0;
+    std::uint64_t start_unix_ns_ = 0;
+    std::uint64_t time_ns_ = 0;
+};
+
+#endif //CAPTUREFORMAT_H
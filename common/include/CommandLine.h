@@ -0,0 +1,78 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <map>
+#include <string>
+
+// Minimal "--key=value" / "--flag" parser shared by the executables.
+class CommandLine {
+public:
+    CommandLine(int argc, char *argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                continue;
+            }
+            arg.erase(0, 2);
+            const auto eq = arg.find('=');
+            if (eq == std::string::npos) {
+                options_[arg] = "true";
+            } else {
+                options_[arg.substr(0, eq)] = arg.substr(eq + 1);
+            }
+        }
+    }
+
+    [[nodiscard]] bool has(const std::string &key) const {
+        return options_.count(key) != 0;
+    }
+
+    [[nodiscard]] std::string getString(const std::string &key, const std::string &default_value = "") const {
+        const auto it = options_.find(key);
+        return it == options_.end() ? default_value : it->second;
+    }
+
+    [[nodiscard]] long long getInt(const std::string &key, long long default_value) const {
+        const auto it = options_.find(key);
+        return it == options_.end() ? default_value : std::stoll(it->second);
+    }
+
+    // "name=value;name=value" lists for per-name settings (names may contain spaces and '=';
+    // the last '=' splits). Entries without a '=' are skipped.
+    [[nodiscard]] std::map<std::string, std::string> getMap(const std::string &key) const {
+        std::map<std::string, std::string> entries;
+        const auto spec = getString(key);
+        std::size_t begin = 0;
+        while (begin < spec.size()) {
+            auto end = spec.find(';', begin);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            const auto entry = spec.substr(begin, end - begin);
+            begin = end + 1;
+            const auto eq = entry.rfind('=');
+            if (eq != std::string::npos && eq > 0) {
+                entries[entry.substr(0, eq)] = entry.substr(eq + 1);
+            }
+        }
+        return entries;
+    }
+
+    [[nodiscard]] double getDouble(const std::string &key, double default_value) const {
+        const auto it = options_.find(key);
+        return it == options_.end() ? default_value : std::stod(it->second);
+    }
+
+    [[nodiscard]] bool getBool(const std::string &key, bool default_value) const {
+        const auto it = options_.find(key);
+        if (it == options_.end()) {
+            return default_value;
+        }
+        return it->second == "true" || it->second == "1" || it->second == "on" || it->second == "yes";
+    }
+
+private:
+    std::map<std::string, std::string> options_;
+};
+
+#endif //COMMANDLINE_H
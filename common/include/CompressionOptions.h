@@ -0,0 +1,48 @@
+#ifndef COMPRESSIONOPTIONS_H
+#define COMPRESSIONOPTIONS_H
+
+#include <boost/beast/websocket/option.hpp>
+#include <cstddef>
+
+#include "CommandLine.h"
+
+// permessage-deflate settings shared by the server Session and WSClient.
+struct CompressionOptions {
+    bool enabled = true;
+    int window_bits = 15;           // 9..15, applied to both directions
+    int level = 6;                  // deflate level 0..9
+    int mem_level = 4;              // deflate memory level 1..9
+    bool context_takeover = true;   // false sends *_no_context_takeover
+    std::size_t min_message_size = 256; // frames smaller than this are sent uncompressed
+    unsigned cost_sample_interval = 32; // time one outbound compression every N messages, 0 disables
+
+    [[nodiscard]] boost::beast::websocket::permessage_deflate toPermessageDeflate() const {
+        boost::beast::websocket::permessage_deflate pmd;
+        pmd.server_enable = enabled;
+        pmd.client_enable = enabled;
+        pmd.server_max_window_bits = window_bits;
+        pmd.client_max_window_bits = window_bits;
+        pmd.server_no_context_takeover = !context_takeover;
+        pmd.client_no_context_takeover = !context_takeover;
+        pmd.compLevel = level;
+        pmd.memLevel = mem_level;
+        pmd.msg_size_threshold = min_message_size;
+        return pmd;
+    }
+
+    static CompressionOptions fromCommandLine(const CommandLine &cl) {
+        CompressionOptions options;
+        options.enabled = cl.getBool("deflate", options.enabled);
+        options.window_bits = static_cast<int>(cl.getInt("deflate-window-bits", options.window_bits));
+        options.level = static_cast<int>(cl.getInt("deflate-level", options.level));
+        options.mem_level = static_cast<int>(cl.getInt("deflate-mem-level", options.mem_level));
+        options.context_takeover = cl.getBool("deflate-context-takeover", options.context_takeover);
+        options.min_message_size = static_cast<std::size_t>(cl.getInt("deflate-min-size",
+                                                                       static_cast<long long>(options.min_message_size)));
+        options.cost_sample_interval = static_cast<unsigned>(cl.getInt("deflate-sample-interval",
+                                                                       options.cost_sample_interval));
+        return options;
+    }
+};
+
+#endif //COMPRESSIONOPTIONS_H
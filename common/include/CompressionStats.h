@@ -0,0 +1,166 @@
+#ifndef COMPRESSIONSTATS_H
+#define COMPRESSIONSTATS_H
+
+#include <boost/beast/core/basic_stream.hpp>
+#include <boost/beast/core/rate_policy.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/zlib/deflate_stream.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CompressionOptions.h"
+
+// Byte counters for one WebSocket connection. "payload" is the message size seen by the
+// application, "wire" is what actually crossed the socket (frames, handshake, deflated data).
+// Written from the connection's IO thread, read from the CLI/monitor threads.
+struct CompressionStats {
+    std::atomic<std::uint64_t> payload_bytes_in{0};
+    std::atomic<std::uint64_t> payload_bytes_out{0};
+    std::atomic<std::uint64_t> wire_bytes_in{0};
+    std::atomic<std::uint64_t> wire_bytes_out{0};
+    std::atomic<std::uint64_t> messages_out{0};
+
+    // One outbound message in cost_sample_interval is deflated a second time with the negotiated
+    // settings and timed, which gives the CPU cost per KiB without instrumenting Beast itself.
+    // This runs inline on the writing thread after the write completed, so the interval bounds
+    // the overhead (0 disables it).
+    std::atomic<std::uint64_t> sampled_bytes{0};
+    std::atomic<std::uint64_t> sampled_compressed_bytes{0};
+    std::atomic<std::uint64_t> sampled_ns{0};
+
+    void recordRead(std::size_t payload_size) {
+        payload_bytes_in.fetch_add(payload_size, std::memory_order_relaxed);
+    }
+
+    void recordWrite(const std::string &payload, const CompressionOptions &options) {
+        payload_bytes_out.fetch_add(payload.size(), std::memory_order_relaxed);
+        const auto n = messages_out.fetch_add(1, std::memory_order_relaxed);
+
+        if (!options.enabled || options.cost_sample_interval == 0 || payload.size() < options.min_message_size) {
+            return;
+        }
+        if (n % options.cost_sample_interval != 0) {
+            return;
+        }
+        sampleCost(payload, options);
+    }
+
+    [[nodiscard]] static double ratio(std::uint64_t payload, std::uint64_t wire) {
+        return wire == 0 ? 0.0 : static_cast<double>(payload) / static_cast<double>(wire);
+    }
+
+    [[nodiscard]] double ratioIn() const {
+        return ratio(payload_bytes_in.load(std::memory_order_relaxed), wire_bytes_in.load(std::memory_order_relaxed));
+    }
+
+    [[nodiscard]] double ratioOut() const {
+        return ratio(payload_bytes_out.load(std::memory_order_relaxed), wire_bytes_out.load(std::memory_order_relaxed));
+    }
+
+    [[nodiscard]] double nsPerKiB() const {
+        const auto bytes = sampled_bytes.load(std::memory_order_relaxed);
+        return bytes == 0 ? 0.0 : static_cast<double>(sampled_ns.load(std::memory_order_relaxed)) * 1024.0 / bytes;
+    }
+
+    [[nodiscard]] std::string summary() const {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+                << "in " << payload_bytes_in.load() << " B / wire " << wire_bytes_in.load() << " B (" << ratioIn() << "x)"
+                << ", out " << payload_bytes_out.load() << " B / wire " << wire_bytes_out.load() << " B (" << ratioOut() << "x)"
+                << ", deflate cost " << nsPerKiB() << " ns/KiB";
+        return ss.str();
+    }
+
+private:
+    // Shared by every connection the thread writes for: a context per connection would double
+    // each connection's deflate memory for a measurement.
+    struct Sampler {
+        boost::beast::zlib::deflate_stream stream;
+        std::vector<unsigned char> buffer;
+        int level = -1;
+        int window_bits = 0;
+        int mem_level = 0;
+    };
+
+    static Sampler &threadSampler() {
+        thread_local Sampler sampler;
+        return sampler;
+    }
+
+    void sampleCost(const std::string &payload, const CompressionOptions &options) {
+        namespace zlib = boost::beast::zlib;
+
+        // Kept across samples like Beast's own deflate context, so the sliding window is warm
+        // and the window allocation is not billed to every sample.
+        auto &sampler = threadSampler();
+        if (sampler.level != options.level || sampler.window_bits != options.window_bits ||
+            sampler.mem_level != options.mem_level) {
+            sampler.stream.reset(options.level, options.window_bits, options.mem_level, zlib::Strategy::normal);
+            sampler.level = options.level;
+            sampler.window_bits = options.window_bits;
+            sampler.mem_level = options.mem_level;
+        } else if (!options.context_takeover) {
+            sampler.stream.reset();
+        }
+        sampler.buffer.resize(sampler.stream.upper_bound(payload.size()) + 16);
+
+        zlib::z_params zs;
+        zs.next_in = payload.data();
+        zs.avail_in = payload.size();
+        zs.next_out = sampler.buffer.data();
+        zs.avail_out = sampler.buffer.size();
+
+        boost::beast::error_code ec;
+        const auto start = std::chrono::steady_clock::now();
+        sampler.stream.write(zs, zlib::Flush::sync, ec);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        if (ec && ec != zlib::error::end_of_stream) {
+            return;
+        }
+
+        sampled_bytes.fetch_add(payload.size(), std::memory_order_relaxed);
+        sampled_compressed_bytes.fetch_add(zs.total_out, std::memory_order_relaxed);
+        sampled_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                             std::memory_order_relaxed);
+    }
+};
+
+// Rate policy for beast::basic_stream that never throttles but feeds the socket byte counts
+// into a CompressionStats, so the compression ratio is measured on real wire traffic.
+class MeteredRatePolicy {
+public:
+    void attach(CompressionStats *stats) { stats_ = stats; }
+
+private:
+    friend class boost::beast::rate_policy_access;
+
+    static constexpr std::size_t all = (std::numeric_limits<std::size_t>::max)();
+
+    [[nodiscard]] std::size_t available_read_bytes() const noexcept { return all; }
+
+    [[nodiscard]] std::size_t available_write_bytes() const noexcept { return all; }
+
+    void transfer_read_bytes(std::size_t n) const noexcept {
+        if (stats_) stats_->wire_bytes_in.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void transfer_write_bytes(std::size_t n) const noexcept {
+        if (stats_) stats_->wire_bytes_out.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void on_timer() const noexcept {
+    }
+
+    CompressionStats *stats_ = nullptr;
+};
+
+using MeteredTcpStream = boost::beast::basic_stream<boost::asio::ip::tcp, boost::asio::any_io_executor, MeteredRatePolicy>;
+
+#endif //COMPRESSIONSTATS_H
@@ -0,0 +1,69 @@
+#ifndef COUNTERSUMMARY_H
+#define COUNTERSUMMARY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// One counter reduced over a report window of fast samples. On the wire it rides along a normal
+// counter entry, whose "value" is the window mean:
+//   {"name": ..., "value": <mean>, "summary": {"count", "min", "max", "last", "p50", "p90", "p99"}}
+struct CounterSummary {
+    std::uint32_t count = 0; // samples in the window; 0 means the counter is a plain sample
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double last = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+
+    // values is reordered; it must not be empty.
+    static CounterSummary fromValues(std::vector<double> &values, double sum) {
+        CounterSummary summary;
+        summary.count = static_cast<std::uint32_t>(values.size());
+        summary.last = values.back();
+        summary.mean = sum / static_cast<double>(values.size());
+        const auto [min, max] = std::minmax_element(values.begin(), values.end());
+        summary.min = *min;
+        summary.max = *max;
+        // Nearest-rank quantiles, ascending so each nth_element only partitions the upper part.
+        std::size_t partitioned = 0;
+        const auto rank = [&values, &partitioned](double q) {
+            const auto n = static_cast<double>(values.size());
+            const auto index = std::max(partitioned,
+                                        static_cast<std::size_t>(std::max(0.0, std::ceil(q * n) - 1.0)));
+            std::nth_element(values.begin() + static_cast<std::ptrdiff_t>(partitioned),
+                             values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+            partitioned = index;
+            return values[index];
+        };
+        summary.p50 = rank(0.50);
+        summary.p90 = rank(0.90);
+        summary.p99 = rank(0.99);
+        return summary;
+    }
+};
+
+inline void to_json(nlohmann::json &j, const CounterSummary &s) {
+    j = nlohmann::json{
+        {"count", s.count}, {"min", s.min}, {"max", s.max}, {"last", s.last},
+        {"p50", s.p50}, {"p90", s.p90}, {"p99", s.p99}
+    };
+}
+
+// mean is not on the wire; the caller takes it from the counter's "value".
+inline void from_json(const nlohmann::json &j, CounterSummary &s) {
+    j.at("count").get_to(s.count);
+    j.at("min").get_to(s.min);
+    j.at("max").get_to(s.max);
+    j.at("last").get_to(s.last);
+    j.at("p50").get_to(s.p50);
+    j.at("p90").get_to(s.p90);
+    j.at("p99").get_to(s.p99);
+}
+
+#endif //COUNTERSUMMARY_H
@@ -0,0 +1,35 @@
+#ifndef FLOWCONTROL_H
+#define FLOWCONTROL_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Server -> client control message. "credits" is the number of data frames the client may send
+// before the next grant (absolute, not additive), "throttle" is the server load level:
+//   0 - normal, send as sampled
+//   1 - busy, batch samples while out of credits
+//   2 - overloaded, batch and drop down to the client's minimum resolution
+struct FlowControlMessage {
+    int credits = 0;
+    int throttle = 0;
+
+    [[nodiscard]] std::string toJson() const {
+        return "{\"type\":\"flow\",\"credits\":" + std::to_string(credits) +
+               ",\"throttle\":" + std::to_string(throttle) + "}";
+    }
+
+    static bool fromJson(const std::string &message, FlowControlMessage &out) {
+        if (message.find("\"flow\"") == std::string::npos) {
+            return false;
+        }
+        const auto j = nlohmann::json::parse(message, nullptr, false);
+        if (j.is_discarded() || !j.is_object() || j.value("type", "") != "flow") {
+            return false;
+        }
+        out.credits = j.value("credits", 0);
+        out.throttle = j.value("throttle", 0);
+        return true;
+    }
+};
+
+#endif //FLOWCONTROL_H
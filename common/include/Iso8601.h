@@ -0,0 +1,32 @@
+#ifndef ISO8601_H
+#define ISO8601_H
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// Whole-second UTC timestamps as exchanged between client and server ("2025-06-13T08:00:00Z").
+
+inline std::string format_iso8601(const std::chrono::system_clock::time_point &tp) {
+    const auto time_t_value = std::chrono::system_clock::to_time_t(tp);
+    std::tm tm_utc{};
+#ifdef _WIN32
+    gmtime_s(&tm_utc, &time_t_value);
+#else
+    gmtime_r(&time_t_value, &tm_utc);
+#endif
+    std::stringstream ss;
+    ss << std::put_time(&tm_utc, "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+inline std::chrono::system_clock::time_point parse_iso8601(const std::string &iso_str) {
+    std::tm tm = {};
+    std::stringstream ss(iso_str);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+    return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+}
+
+#endif //ISO8601_H
@@ -0,0 +1,95 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Log-linear latency histogram in the spirit of HdrHistogram: 16 sub-buckets per power of two,
+// so any recorded value is reported within ~6% using a fixed 8 KiB of counters.
+class LatencyHistogram {
+public:
+    static constexpr std::size_t sub_bucket_bits = 4;
+    static constexpr std::size_t sub_buckets = std::size_t{1} << sub_bucket_bits;
+    static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    using Counts = std::array<std::uint64_t, bucket_count>;
+
+    // Single writer: the owning thread bumps with plain load/store, readers only need atomicity.
+    void record(std::uint64_t value) {
+        auto &count = counts_[bucketIndex(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void addTo(Counts &out) const {
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            out[i] += counts_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    static std::size_t bucketIndex(std::uint64_t value) {
+        if (value < sub_buckets) {
+            return static_cast<std::size_t>(value);
+        }
+        const auto exponent = static_cast<std::size_t>(63 - __builtin_clzll(value));
+        const auto shift = exponent - sub_bucket_bits;
+        const auto sub = static_cast<std::size_t>(value >> shift) & (sub_buckets - 1);
+        return (shift + 1) * sub_buckets + sub;
+    }
+
+    // Largest value that maps to the bucket.
+    static std::uint64_t bucketUpperBound(std::size_t index) {
+        if (index < sub_buckets) {
+            return index;
+        }
+        const auto shift = index / sub_buckets - 1;
+        const auto sub = index % sub_buckets;
+        return ((sub_buckets + sub + 1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> counts_{};
+};
+
+struct LatencySummary {
+    std::uint64_t count = 0;
+    std::uint64_t p50 = 0;
+    std::uint64_t p90 = 0;
+    std::uint64_t p99 = 0;
+    std::uint64_t p999 = 0;
+    std::uint64_t max = 0;
+
+    static LatencySummary fromCounts(const LatencyHistogram::Counts &counts);
+};
+
+inline LatencySummary LatencySummary::fromCounts(const LatencyHistogram::Counts &counts) {
+    LatencySummary summary;
+    for (const auto count: counts) {
+        summary.count += count;
+    }
+    if (summary.count == 0) {
+        return summary;
+    }
+
+    const auto rank = [&summary](double quantile) {
+        return static_cast<std::uint64_t>(quantile * static_cast<double>(summary.count - 1)) + 1;
+    };
+    const std::uint64_t ranks[] = {rank(0.50), rank(0.90), rank(0.99), rank(0.999)};
+    std::uint64_t *targets[] = {&summary.p50, &summary.p90, &summary.p99, &summary.p999};
+
+    std::uint64_t seen = 0;
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        seen += counts[i];
+        while (next < 4 && seen >= ranks[next]) {
+            *targets[next++] = LatencyHistogram::bucketUpperBound(i);
+        }
+        summary.max = LatencyHistogram::bucketUpperBound(i);
+    }
+    return summary;
+}
+
+#endif //LATENCYHISTOGRAM_H
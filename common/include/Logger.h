@@ -0,0 +1,178 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "CommandLine.h"
+
+// Levels are PascalCase because ERROR/DEBUG are commonly predefined macros (wingdi.h, -DDEBUG).
+enum class LogLevel : std::uint8_t { Trace, Debug, Info, Warn, Error, Off };
+
+// Calls below this level compile to nothing. Override with -DLOG_COMPILE_LEVEL=<0..5>.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 1
+#endif
+
+struct LogOptions {
+    enum class Format { TEXT, JSON, BINARY };
+
+    LogLevel level = LogLevel::Info;
+    bool console = true;
+    std::string file_path;              // empty disables the file sink
+    Format file_format = Format::TEXT;
+    std::uintmax_t max_file_bytes = 16 * 1024 * 1024;
+    unsigned max_files = 4;             // rotated files kept next to file_path (.1, .2, ...)
+    unsigned rate_limit_per_second = 20; // per call site, 0 disables
+    std::chrono::milliseconds flush_interval{50};
+
+    static LogLevel parseLevel(const std::string &name, LogLevel default_level);
+
+    static LogOptions fromCommandLine(const CommandLine &cl);
+};
+
+// Fixed-size record passed from the logging thread to the flusher. The component is always a
+// string literal, so only its pointer is stored.
+struct LogRecord {
+    std::int64_t timestamp_ns;
+    LogLevel level;
+    std::uint32_t suppressed;
+    const char *component;
+    std::uint16_t length;
+    char text[222];
+};
+
+// Per call site state for the rate limiter; one static instance per LOG_* expansion.
+class LogSite {
+public:
+    bool admit(std::uint32_t &suppressed_out);
+
+private:
+    std::atomic<std::int64_t> window_{0};
+    std::atomic<std::uint32_t> count_{0};
+    std::atomic<std::uint32_t> suppressed_{0};
+};
+
+// Wrap an integer to log it as 0x-prefixed hex, e.g. PDH/HRESULT status codes.
+struct LogHex {
+    unsigned long long value;
+};
+
+// Builds a record's text in place without iostreams for the common argument types. Text that
+// does not fit is cut at a character boundary and ends in "…".
+class LogLineWriter {
+public:
+    explicit LogLineWriter(LogRecord &record) : record_(record) {
+    }
+
+    void append(std::string_view sv) {
+        if (truncated_) {
+            return;
+        }
+        const std::size_t room = sizeof(record_.text) - record_.length;
+        if (sv.size() <= room) {
+            std::memcpy(record_.text + record_.length, sv.data(), sv.size());
+            record_.length = static_cast<std::uint16_t>(record_.length + sv.size());
+            return;
+        }
+
+        appendTruncated(sv);
+    }
+
+    void append(const char *s) { append(std::string_view(s ? s : "(null)")); }
+
+    void append(const std::string &s) { append(std::string_view(s)); }
+
+    void append(char c) { append(std::string_view(&c, 1)); }
+
+    void append(bool b) { append(std::string_view(b ? "true" : "false")); }
+
+    void append(LogHex hex) {
+        char buf[24] = {'0', 'x'};
+        const auto result = std::to_chars(buf + 2, buf + sizeof(buf), hex.value, 16);
+        append(std::string_view(buf, static_cast<std::size_t>(result.ptr - buf)));
+    }
+
+    template<typename T>
+    void append(const T &value) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            char buf[32];
+            const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+            append(std::string_view(buf, static_cast<std::size_t>(result.ptr - buf)));
+        } else {
+            std::ostringstream ss;
+            ss << value;
+            append(ss.str());
+        }
+    }
+
+private:
+    // Out of line: the rare overflow path stays out of every inlined LOG_* call.
+    void appendTruncated(std::string_view sv);
+
+    LogRecord &record_;
+    bool truncated_ = false;
+};
+
+class Logger {
+public:
+    static void configure(const LogOptions &options);
+
+    static void shutdown();
+
+    static void setLevel(LogLevel level);
+
+    [[nodiscard]] static bool isEnabled(LogLevel level) {
+        return static_cast<std::uint8_t>(level) >= runtime_level_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static std::uint64_t droppedCount();
+
+    template<typename... Args>
+    static void write(LogLevel level, const char *component, std::uint32_t suppressed, const Args &... args) {
+        LogRecord record;
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record.level = level;
+        record.suppressed = suppressed;
+        record.component = component;
+        record.length = 0;
+
+        LogLineWriter writer(record);
+        (writer.append(args), ...);
+        submit(record);
+    }
+
+private:
+    static void submit(const LogRecord &record);
+
+    static std::atomic<std::uint8_t> runtime_level_;
+};
+
+#define LOG_AT(lvl, component, ...)                                                        \
+    do {                                                                                   \
+        if constexpr (static_cast<int>(lvl) >= LOG_COMPILE_LEVEL) {                        \
+            if (Logger::isEnabled(lvl)) {                                                  \
+                static LogSite log_site_;                                                  \
+                std::uint32_t log_suppressed_ = 0;                                         \
+                if (log_site_.admit(log_suppressed_)) {                                    \
+                    Logger::write(lvl, component, log_suppressed_, __VA_ARGS__);           \
+                }                                                                          \
+            }                                                                              \
+        }                                                                                  \
+    } while (0)
+
+#define LOG_TRACE(component, ...) LOG_AT(LogLevel::Trace, component, __VA_ARGS__)
+#define LOG_DEBUG(component, ...) LOG_AT(LogLevel::Debug, component, __VA_ARGS__)
+#define LOG_INFO(component, ...) LOG_AT(LogLevel::Info, component, __VA_ARGS__)
+#define LOG_WARN(component, ...) LOG_AT(LogLevel::Warn, component, __VA_ARGS__)
+#define LOG_ERROR(component, ...) LOG_AT(LogLevel::Error, component, __VA_ARGS__)
+
+#endif //LOGGER_H
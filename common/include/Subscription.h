@@ -0,0 +1,72 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Label selector for one dimension of a series: "*" matches anything, "prefix*" matches by
+// prefix, anything else must match exactly.
+struct LabelSelector {
+    std::string pattern = "*";
+
+    [[nodiscard]] bool isExact() const {
+        return pattern.empty() || pattern.back() != '*';
+    }
+
+    [[nodiscard]] bool matches(const std::string &value) const {
+        if (isExact()) {
+            return value == pattern;
+        }
+        return value.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+    }
+};
+
+// Client -> server request on the metrics endpoint:
+//   {"type":"subscribe","id":"cpu","client":"web-*","metric":"CPU Usage","interval_ms":1000}
+//   {"type":"unsubscribe","id":"cpu"}
+// While subscribed the server sends at most one frame per interval with the latest value of
+// every matching series that changed since the previous frame:
+//   {"type":"update","id":"cpu","series":[{"client":"web-1","metric":"CPU Usage","t":<epoch ms>,"value":12.5}]}
+// Rejected requests are answered with {"type":"error","id":"...","message":"..."}.
+struct SubscriptionRequest {
+    enum class Action { SUBSCRIBE, UNSUBSCRIBE };
+
+    Action action = Action::SUBSCRIBE;
+    std::string id;
+    LabelSelector client;
+    LabelSelector metric;
+    int interval_ms = 1000;
+
+    [[nodiscard]] std::string toJson() const {
+        nlohmann::json j;
+        j["type"] = action == Action::SUBSCRIBE ? "subscribe" : "unsubscribe";
+        j["id"] = id;
+        if (action == Action::SUBSCRIBE) {
+            j["client"] = client.pattern;
+            j["metric"] = metric.pattern;
+            j["interval_ms"] = interval_ms;
+        }
+        return j.dump();
+    }
+
+    static bool fromJson(const nlohmann::json &j, SubscriptionRequest &out) {
+        if (!j.is_object()) {
+            return false;
+        }
+        const auto type = j.value("type", "");
+        if (type == "subscribe") {
+            out.action = Action::SUBSCRIBE;
+        } else if (type == "unsubscribe") {
+            out.action = Action::UNSUBSCRIBE;
+        } else {
+            return false;
+        }
+        out.id = j.value("id", "");
+        out.client.pattern = j.value("client", "*");
+        out.metric.pattern = j.value("metric", "*");
+        out.interval_ms = j.value("interval_ms", 1000);
+        return true;
+    }
+};
+
+#endif //SUBSCRIPTION_H
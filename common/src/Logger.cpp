@@ -0,0 +1,432 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr std::size_t kThreadBufferCapacity = 256;
+
+    // Single-producer (the owning thread) / single-consumer (the flusher) ring.
+    struct ThreadBuffer {
+        LogRecord records[kThreadBufferCapacity];
+        std::atomic<std::size_t> head{0}; // next slot to write, owned by the producer
+        std::atomic<std::size_t> tail{0}; // next slot to read, owned by the flusher
+        std::atomic<bool> orphaned{false};
+
+        bool push(const LogRecord &record) {
+            const auto h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= kThreadBufferCapacity) {
+                return false;
+            }
+            records[h % kThreadBufferCapacity] = record;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        template<typename Fn>
+        void drain(Fn &&fn) {
+            auto t = tail.load(std::memory_order_relaxed);
+            const auto h = head.load(std::memory_order_acquire);
+            for (; t != h; ++t) {
+                fn(records[t % kThreadBufferCapacity]);
+            }
+            tail.store(t, std::memory_order_release);
+        }
+
+        [[nodiscard]] bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+    };
+
+    const char *level_name(LogLevel level) {
+        switch (level) {
+            case LogLevel::Trace: return "TRACE";
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info: return "INFO";
+            case LogLevel::Warn: return "WARN";
+            case LogLevel::Error: return "ERROR";
+            case LogLevel::Off: return "OFF";
+        }
+        return "?";
+    }
+
+    std::string format_timestamp(std::int64_t timestamp_ns) {
+        const std::time_t seconds = static_cast<std::time_t>(timestamp_ns / 1000000000);
+        const int millis = static_cast<int>((timestamp_ns / 1000000) % 1000);
+        std::tm tm_utc{};
+#ifdef _WIN32
+        gmtime_s(&tm_utc, &seconds);
+#else
+        gmtime_r(&seconds, &tm_utc);
+#endif
+        char buf[32];
+        const auto n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm_utc);
+        std::snprintf(buf + n, sizeof(buf) - n, ".%03dZ", millis);
+        return buf;
+    }
+
+    void append_json_escaped(std::string &out, std::string_view s) {
+        for (const char c: s) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        out += buf;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+    }
+
+    class LoggerState {
+    public:
+        ~LoggerState() {
+            stop();
+        }
+
+        void configure(const LogOptions &options) {
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                options_ = options;
+                file_.close();
+                if (!options_.file_path.empty()) {
+                    open_file();
+                }
+            }
+            rate_limit_.store(options.rate_limit_per_second, std::memory_order_relaxed);
+            flush_interval_ms_.store(options.flush_interval.count(), std::memory_order_relaxed);
+            start();
+        }
+
+        void start() {
+            std::lock_guard<std::mutex> lock(thread_mutex_);
+            stopped_ = false;
+            if (running_) {
+                return;
+            }
+            running_ = true;
+            flusher_ = std::thread(&LoggerState::flush_loop, this);
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(thread_mutex_);
+                stopped_ = true;
+                if (!running_) {
+                    return;
+                }
+                running_ = false;
+            }
+            wake_.notify_all();
+            if (flusher_.joinable()) {
+                flusher_.join();
+            }
+            flush_once();
+        }
+
+        void submit(const LogRecord &record) {
+            thread_local ThreadBufferHolder holder(*this);
+            if (stopped_) {
+                // No flusher after shutdown (destructors, late callbacks): write through instead.
+                if (!holder.buffer->push(record)) {
+                    flush_once();
+                    holder.buffer->push(record);
+                }
+                flush_once();
+                return;
+            }
+            if (!holder.buffer->push(record)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (stopped_) {
+                // stop() may have taken its final flush before this push landed.
+                flush_once();
+            } else if (!started_.load(std::memory_order_relaxed)) {
+                started_.store(true, std::memory_order_relaxed);
+                start();
+            }
+        }
+
+        std::atomic<unsigned> rate_limit_{20};
+        std::atomic<std::uint64_t> dropped_{0};
+        std::atomic<long long> flush_interval_ms_{50};
+
+    private:
+        struct ThreadBufferHolder {
+            explicit ThreadBufferHolder(LoggerState &state) : buffer(std::make_shared<ThreadBuffer>()) {
+                std::lock_guard<std::mutex> lock(state.buffers_mutex_);
+                state.buffers_.push_back(buffer);
+            }
+
+            ~ThreadBufferHolder() {
+                buffer->orphaned.store(true, std::memory_order_release);
+            }
+
+            std::shared_ptr<ThreadBuffer> buffer;
+        };
+
+        void flush_loop() {
+            std::unique_lock<std::mutex> lock(thread_mutex_);
+            while (running_) {
+                wake_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_.load(std::memory_order_relaxed)));
+                lock.unlock();
+                flush_once();
+                lock.lock();
+            }
+        }
+
+        // Serialised by flush_mutex_: the buffers are single-consumer, and after shutdown any
+        // logging thread may flush.
+        void flush_once() {
+            std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+            std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+            {
+                std::lock_guard<std::mutex> lock(buffers_mutex_);
+                buffers = buffers_;
+            }
+
+            batch_.clear();
+            for (auto &buffer: buffers) {
+                buffer->drain([this](const LogRecord &record) { batch_.push_back(record); });
+            }
+            std::stable_sort(batch_.begin(), batch_.end(), [](const LogRecord &a, const LogRecord &b) {
+                return a.timestamp_ns < b.timestamp_ns;
+            });
+
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                for (const auto &record: batch_) {
+                    write_record(record);
+                }
+                if (!batch_.empty()) {
+                    std::cout.flush();
+                    if (file_.is_open()) {
+                        file_.flush();
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(buffers_mutex_);
+            buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(), [](const auto &buffer) {
+                return buffer->orphaned.load(std::memory_order_acquire) && buffer->empty();
+            }), buffers_.end());
+        }
+
+        void write_record(const LogRecord &record) {
+            const std::string_view text(record.text, record.length);
+
+            if (options_.console) {
+                auto &os = record.level >= LogLevel::Warn ? std::cerr : std::cout;
+                os << format_timestamp(record.timestamp_ns) << ' ' << level_name(record.level)
+                        << " [" << record.component << "] " << text;
+                if (record.suppressed > 0) {
+                    os << " (" << record.suppressed << " similar suppressed)";
+                }
+                os << '\n';
+            }
+
+            if (!file_.is_open()) {
+                return;
+            }
+
+            switch (options_.file_format) {
+                case LogOptions::Format::TEXT: {
+                    file_ << format_timestamp(record.timestamp_ns) << ' ' << level_name(record.level)
+                            << " [" << record.component << "] " << text;
+                    if (record.suppressed > 0) {
+                        file_ << " (" << record.suppressed << " similar suppressed)";
+                    }
+                    file_ << '\n';
+                    break;
+                }
+                case LogOptions::Format::JSON: {
+                    std::string line = "{\"ts\":\"" + format_timestamp(record.timestamp_ns) +
+                                       "\",\"level\":\"" + level_name(record.level) + "\",\"component\":\"";
+                    append_json_escaped(line, record.component);
+                    line += "\",\"msg\":\"";
+                    append_json_escaped(line, text);
+                    line += "\"";
+                    if (record.suppressed > 0) {
+                        line += ",\"suppressed\":" + std::to_string(record.suppressed);
+                    }
+                    line += "}\n";
+                    file_ << line;
+                    break;
+                }
+                case LogOptions::Format::BINARY: {
+                    // [i64 ts_ns][u8 level][u32 suppressed][u16 n][component][u16 n][text], host endianness
+                    const auto component_length = static_cast<std::uint16_t>(std::strlen(record.component));
+                    const auto level = static_cast<std::uint8_t>(record.level);
+                    file_.write(reinterpret_cast<const char *>(&record.timestamp_ns), sizeof(record.timestamp_ns));
+                    file_.write(reinterpret_cast<const char *>(&level), sizeof(level));
+                    file_.write(reinterpret_cast<const char *>(&record.suppressed), sizeof(record.suppressed));
+                    file_.write(reinterpret_cast<const char *>(&component_length), sizeof(component_length));
+                    file_.write(record.component, component_length);
+                    file_.write(reinterpret_cast<const char *>(&record.length), sizeof(record.length));
+                    file_.write(record.text, record.length);
+                    break;
+                }
+            }
+
+            if (static_cast<std::uintmax_t>(file_.tellp()) >= options_.max_file_bytes) {
+                rotate();
+            }
+        }
+
+        void open_file() {
+            const auto mode = options_.file_format == LogOptions::Format::BINARY
+                                  ? std::ios::binary | std::ios::app
+                                  : std::ios::app;
+            file_.open(options_.file_path, mode);
+            if (!file_) {
+                std::cerr << "Logger: could not open " << options_.file_path << std::endl;
+            }
+        }
+
+        void rotate() {
+            namespace fs = std::filesystem;
+            file_.close();
+
+            std::error_code ec;
+            const fs::path base(options_.file_path);
+            if (options_.max_files == 0) {
+                fs::remove(base, ec);
+            } else {
+                for (unsigned i = options_.max_files; i > 1; --i) {
+                    fs::rename(base.string() + "." + std::to_string(i - 1), base.string() + "." + std::to_string(i), ec);
+                }
+                fs::rename(base, base.string() + ".1", ec);
+            }
+            open_file();
+        }
+
+        LogOptions options_;
+        std::ofstream file_;
+        std::mutex sink_mutex_;
+
+        std::vector<std::shared_ptr<ThreadBuffer> > buffers_;
+        std::mutex buffers_mutex_;
+        std::vector<LogRecord> batch_;
+        std::mutex flush_mutex_;
+
+        std::thread flusher_;
+        std::mutex thread_mutex_;
+        std::condition_variable wake_;
+        bool running_ = false;
+        std::atomic<bool> stopped_{false}; // after shutdown(), until the next configure()
+        std::atomic<bool> started_{false};
+    };
+
+    LoggerState &state() {
+        static LoggerState instance;
+        return instance;
+    }
+}
+
+std::atomic<std::uint8_t> Logger::runtime_level_{static_cast<std::uint8_t>(LogLevel::Info)};
+
+LogLevel LogOptions::parseLevel(const std::string &name, LogLevel default_level) {
+    if (name == "trace") return LogLevel::Trace;
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    return default_level;
+}
+
+LogOptions LogOptions::fromCommandLine(const CommandLine &cl) {
+    LogOptions options;
+    options.level = parseLevel(cl.getString("log-level"), options.level);
+    options.console = cl.getBool("log-console", options.console);
+    options.file_path = cl.getString("log-file");
+    const auto format = cl.getString("log-format", "text");
+    if (format == "json") {
+        options.file_format = Format::JSON;
+    } else if (format == "binary") {
+        options.file_format = Format::BINARY;
+    }
+    options.max_file_bytes = static_cast<std::uintmax_t>(cl.getInt("log-max-bytes",
+                                                                   static_cast<long long>(options.max_file_bytes)));
+    options.max_files = static_cast<unsigned>(cl.getInt("log-max-files", options.max_files));
+    options.rate_limit_per_second = static_cast<unsigned>(cl.getInt("log-rate-limit", options.rate_limit_per_second));
+    return options;
+}
+
+bool LogSite::admit(std::uint32_t &suppressed_out) {
+    const auto limit = state().rate_limit_.load(std::memory_order_relaxed);
+    if (limit == 0) {
+        return true;
+    }
+
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto window = window_.load(std::memory_order_relaxed);
+    if (window != now && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+        suppressed_out = suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+
+    if (count_.fetch_add(1, std::memory_order_relaxed) >= limit) {
+        suppressed_.fetch_add(1 + suppressed_out, std::memory_order_relaxed);
+        suppressed_out = 0;
+        return false;
+    }
+    return true;
+}
+
+void LogLineWriter::appendTruncated(std::string_view sv) {
+    static constexpr std::string_view ellipsis = "\xE2\x80\xA6"; // U+2026 in UTF-8
+    const std::size_t room = sizeof(record_.text) - record_.length;
+    std::size_t end = sizeof(record_.text) - ellipsis.size();
+    if (room > ellipsis.size()) {
+        std::memcpy(record_.text + record_.length, sv.data(), room - ellipsis.size());
+    }
+    // Drop a multi-byte character the cut went through: back up while the first byte cut off is
+    // a UTF-8 continuation byte.
+    auto cut = static_cast<unsigned char>(end >= record_.length ? sv[end - record_.length] : record_.text[end]);
+    while (end > 0 && (cut & 0xC0) == 0x80) {
+        --end;
+        cut = static_cast<unsigned char>(record_.text[end]);
+    }
+    std::memcpy(record_.text + end, ellipsis.data(), ellipsis.size());
+    record_.length = static_cast<std::uint16_t>(end + ellipsis.size());
+    truncated_ = true;
+}
+
+void Logger::configure(const LogOptions &options) {
+    setLevel(options.level);
+    state().configure(options);
+}
+
+void Logger::shutdown() {
+    state().stop();
+}
+
+void Logger::setLevel(LogLevel level) {
+    runtime_level_.store(static_cast<std::uint8_t>(level), std::memory_order_relaxed);
+}
+
+std::uint64_t Logger::droppedCount() {
+    return state().dropped_.load(std::memory_order_relaxed);
+}
+
+void Logger::submit(const LogRecord &record) {
+    state().submit(record);
+}
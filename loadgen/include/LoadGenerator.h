@@ -0,0 +1,161 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CommandLine.h"
+#include "CompressionOptions.h"
+#include "LatencyHistogram.h"
+#include "WSClient.h"
+
+struct LoadgenOptions {
+    enum class Encoding { OBJECT, ARRAY };
+
+    std::string host = "127.0.0.1";
+    std::string port = "6969";
+    int clients = 1000;
+    int counters = 8;
+    double rate = 1.0; // samples per second per client
+    // OBJECT sends every sample as its own frame, ARRAY sends `batch` samples as one JSON array.
+    Encoding encoding = Encoding::OBJECT;
+    int batch = 10;
+    bool ack = true;
+    int threads = 0;
+    std::chrono::seconds duration{30};
+    std::chrono::seconds ramp_up{5};
+    std::chrono::seconds drain{2};
+    std::chrono::seconds report_interval{1};
+    std::string client_prefix = "loadgen-";
+    CompressionOptions compression;
+    // Connection scaling: --idle connects without sending samples. With the pid of a server on
+    // this host its resident memory is read before connecting and at the end of the run, and
+    // the growth per connection is checked against max_connection_kb (0 = report only).
+    bool idle = false;
+    int server_pid = 0;
+    double max_connection_kb = 0.0;
+
+    static LoadgenOptions fromCommandLine(const CommandLine &cl) {
+        LoadgenOptions options;
+        options.host = cl.getString("host", options.host);
+        options.port = cl.getString("port", options.port);
+        options.clients = static_cast<int>(std::max(1LL, cl.getInt("clients", options.clients)));
+        options.counters = static_cast<int>(std::max(1LL, cl.getInt("counters", options.counters)));
+        options.rate = cl.getDouble("rate", options.rate);
+        if (options.rate <= 0) {
+            options.rate = 1.0;
+        }
+        options.encoding = cl.getString("encoding", "object") == "array" ? Encoding::ARRAY : Encoding::OBJECT;
+        options.batch = static_cast<int>(std::max(1LL, cl.getInt("batch", options.batch)));
+        options.ack = cl.getBool("ack", options.ack);
+        options.threads = static_cast<int>(cl.getInt("threads", options.threads));
+        if (options.threads <= 0) {
+            options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        options.duration = std::chrono::seconds(cl.getInt("duration", options.duration.count()));
+        options.ramp_up = std::chrono::seconds(cl.getInt("ramp-up", options.ramp_up.count()));
+        options.drain = std::chrono::seconds(cl.getInt("drain", options.drain.count()));
+        options.report_interval = std::chrono::seconds(std::max(1LL, cl.getInt("report-interval", 1)));
+        options.client_prefix = cl.getString("client-prefix", options.client_prefix);
+        options.compression = CompressionOptions::fromCommandLine(cl);
+        options.idle = cl.getBool("idle", options.idle);
+        options.server_pid = static_cast<int>(cl.getInt("server-pid", options.server_pid));
+        options.max_connection_kb = cl.getDouble("max-conn-kb", options.max_connection_kb);
+        return options;
+    }
+};
+
+// Simulates many monitoring clients against one server. Every worker thread runs its own
+// io_context with a slice of the clients; counters and latency histograms live in per-worker
+// slots that only the worker writes. With acks on, each sample carries its generation time
+// (steady clock, ns) as the ack token: the server's stored_ns gives the one-way ingest latency,
+// the arrival of the ack the round trip.
+class LoadGenerator {
+public:
+    explicit LoadGenerator(LoadgenOptions options);
+
+    ~LoadGenerator();
+
+    // Ramps up, generates load for the configured duration while printing interval reports,
+    // then drains outstanding acks and prints the final report. Returns false if the server's
+    // memory per connection exceeded --max-conn-kb.
+    bool run();
+
+private:
+    struct alignas(64) WorkerStats {
+        std::atomic<std::uint64_t> connected{0};
+        std::atomic<std::uint64_t> connect_failed{0};
+        std::atomic<std::uint64_t> disconnected{0};
+        std::atomic<std::uint64_t> samples{0};
+        std::atomic<std::uint64_t> frames{0};
+        std::atomic<std::uint64_t> acks{0};
+        LatencyHistogram ingest_ns;
+        LatencyHistogram ack_ns;
+    };
+
+    struct Worker {
+        boost::asio::io_context ioc{1};
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{ioc.get_executor()};
+        std::thread thread;
+        WorkerStats stats;
+    };
+
+    struct SimClient {
+        SimClient(Worker &worker, const LoadgenOptions &options, std::string id);
+
+        Worker &worker;
+        WSClient ws;
+        boost::asio::steady_timer timer;
+        std::string id;
+        std::uint64_t rng;
+        std::string frame;
+        int frame_samples = 0;
+    };
+
+    struct Totals {
+        std::uint64_t connected = 0;
+        std::uint64_t connect_failed = 0;
+        std::uint64_t disconnected = 0;
+        std::uint64_t samples = 0;
+        std::uint64_t frames = 0;
+        std::uint64_t acks = 0;
+        std::uint64_t wire_bytes_out = 0;
+        std::unique_ptr<LatencyHistogram::Counts> ingest_ns;
+        std::unique_ptr<LatencyHistogram::Counts> ack_ns;
+    };
+
+    boost::asio::awaitable<void> runClient(SimClient &client, std::chrono::steady_clock::duration delay);
+
+    boost::asio::awaitable<void> sampleLoop(SimClient &client);
+
+    void appendSample(SimClient &client, std::chrono::steady_clock::time_point generated);
+
+    void onMessage(SimClient &client, const std::string &message);
+
+    [[nodiscard]] Totals collect() const;
+
+    void report(const Totals &now, const Totals &previous, double seconds, bool final) const;
+
+    // Resident set of the --server-pid process in bytes, 0 if it cannot be read.
+    [[nodiscard]] std::uint64_t serverResidentBytes() const;
+
+    bool reportMemory(std::uint64_t before, std::uint64_t after, std::uint64_t connections) const;
+
+    LoadgenOptions options_;
+    std::vector<std::unique_ptr<Worker> > workers_;
+    std::vector<std::unique_ptr<SimClient> > clients_;
+    std::atomic<bool> stopping_{false};
+};
+
+#endif //LOADGENERATOR_H
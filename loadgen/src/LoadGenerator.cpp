@@ -0,0 +1,398 @@
+#include "LoadGenerator.h"
+
+#include "FlowControl.h"
+#include "Logger.h"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <nlohmann/json.hpp>
+
+#include <charconv>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace net = boost::asio;
+
+namespace {
+    void bump(std::atomic<std::uint64_t> &counter, std::uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::int64_t steady_ns(std::chrono::steady_clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    }
+
+    std::uint64_t next_random(std::uint64_t &state) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    template<typename T>
+    void append_number(std::string &out, T value) {
+        char buf[32];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+
+    // Whole-second ISO 8601, the resolution the server parses; cached per thread.
+    const std::string &iso8601_now() {
+        thread_local std::time_t cached_second = 0;
+        thread_local std::string cached;
+        const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        if (now != cached_second) {
+            std::tm tm_utc{};
+#ifdef _WIN32
+            gmtime_s(&tm_utc, &now);
+#else
+            gmtime_r(&now, &tm_utc);
+#endif
+            char buf[32];
+            cached.assign(buf, std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm_utc));
+            cached_second = now;
+        }
+        return cached;
+    }
+
+    std::string format_ms(std::uint64_t ns) {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3) << static_cast<double>(ns) / 1e6 << " ms";
+        return ss.str();
+    }
+
+    void print_latency(const char *label, const LatencySummary &summary) {
+        std::cout << "  " << label << ": n=" << summary.count
+                << " p50=" << format_ms(summary.p50) << " p90=" << format_ms(summary.p90)
+                << " p99=" << format_ms(summary.p99) << " p99.9=" << format_ms(summary.p999)
+                << " max=" << format_ms(summary.max) << std::endl;
+    }
+}
+
+LoadGenerator::SimClient::SimClient(Worker &worker, const LoadgenOptions &options, std::string id): worker(worker),
+    ws(worker.ioc, options.host, options.port, options.compression),
+    timer(worker.ioc),
+    id(std::move(id)),
+    rng(std::hash<std::string>{}(this->id) | 1) {
+    // Frames are shaped by --encoding and --batch; keep them that way on the wire.
+    ws.setMaxCoalescedBytes(0);
+}
+
+LoadGenerator::LoadGenerator(LoadgenOptions options): options_(std::move(options)) {
+    for (int i = 0; i < options_.threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    clients_.reserve(static_cast<std::size_t>(options_.clients));
+    for (int i = 0; i < options_.clients; ++i) {
+        std::stringstream id;
+        id << options_.client_prefix << std::setw(5) << std::setfill('0') << i;
+        auto &worker = *workers_[static_cast<std::size_t>(i) % workers_.size()];
+        clients_.push_back(std::make_unique<SimClient>(worker, options_, id.str()));
+    }
+}
+
+LoadGenerator::~LoadGenerator() {
+    stopping_ = true;
+    for (auto &worker: workers_) {
+        worker->work.reset();
+        worker->ioc.stop();
+    }
+    for (auto &worker: workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    // Sockets and timers go before the io_contexts they are registered with.
+    clients_.clear();
+}
+
+bool LoadGenerator::run() {
+    const auto memory_before = serverResidentBytes();
+    const auto ramp_step = options_.ramp_up / std::max(1, options_.clients);
+    for (std::size_t i = 0; i < clients_.size(); ++i) {
+        auto &client = *clients_[i];
+        client.ws.setOnConnectCallback([this, &client](const boost::beast::error_code &ec) {
+            if (ec) {
+                bump(client.worker.stats.connect_failed);
+                return;
+            }
+            bump(client.worker.stats.connected);
+            if (!options_.idle) {
+                net::co_spawn(client.worker.ioc, sampleLoop(client), net::detached);
+            }
+        });
+        client.ws.setOnMessageCallback([this, &client](const std::string &message) {
+            onMessage(client, message);
+        });
+        const auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(ramp_step) * static_cast<double>(i));
+        net::co_spawn(client.worker.ioc, runClient(client, delay), net::detached);
+    }
+    for (auto &worker: workers_) {
+        worker->thread = std::thread([&ioc = worker->ioc]() { ioc.run(); });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto steady_from = start + options_.ramp_up;
+    const auto end = steady_from + options_.duration;
+
+    std::cout << "Ramping up " << options_.clients << " clients over " << options_.ramp_up.count() << " s, then "
+            << options_.duration.count() << " s of load." << std::endl;
+
+    auto previous = collect();
+    auto previous_time = start;
+    Totals steady_state;
+    auto steady_time = steady_from;
+    auto next_report = start + options_.report_interval;
+    while (next_report <= end) {
+        std::this_thread::sleep_until(next_report);
+        auto now = collect();
+        report(now, previous, std::chrono::duration<double>(next_report - previous_time).count(), false);
+        if (!steady_state.ingest_ns && next_report >= steady_from) {
+            steady_state = collect();
+            steady_time = next_report;
+        }
+        previous = std::move(now);
+        previous_time = next_report;
+        next_report += options_.report_interval;
+    }
+    std::this_thread::sleep_until(end);
+    if (!steady_state.ingest_ns) {
+        steady_state = collect();
+        steady_time = end;
+    }
+    const auto memory_after = serverResidentBytes();
+    const auto open = collect();
+    const auto connections = open.connected - std::min(open.connected, open.disconnected);
+
+    stopping_ = true;
+    std::this_thread::sleep_for(options_.drain);
+    report(collect(), steady_state, std::chrono::duration<double>(end - steady_time).count(), true);
+
+    const bool passed = reportMemory(memory_before, memory_after, connections);
+
+    for (auto &client: clients_) {
+        client->ws.disconnect();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    return passed;
+}
+
+net::awaitable<void> LoadGenerator::runClient(SimClient &client, std::chrono::steady_clock::duration delay) {
+    boost::system::error_code ec;
+    client.timer.expires_after(delay);
+    co_await client.timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+    if (ec || stopping_) {
+        co_return;
+    }
+    client.ws.connect();
+}
+
+net::awaitable<void> LoadGenerator::sampleLoop(SimClient &client) {
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / options_.rate));
+    // A random phase keeps thousands of clients from sampling in lockstep.
+    auto next = std::chrono::steady_clock::now() + std::chrono::steady_clock::duration(
+                    static_cast<std::chrono::steady_clock::rep>(next_random(client.rng) %
+                                                                static_cast<std::uint64_t>(period.count() + 1)));
+    boost::system::error_code ec;
+    for (;;) {
+        client.timer.expires_at(next);
+        co_await client.timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+        if (ec || stopping_) {
+            co_return;
+        }
+        if (!client.ws.isConnected()) {
+            bump(client.worker.stats.disconnected);
+            co_return;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        appendSample(client, now);
+        if (options_.encoding == LoadgenOptions::Encoding::OBJECT || client.frame_samples >= options_.batch) {
+            if (options_.encoding == LoadgenOptions::Encoding::ARRAY) {
+                client.frame.push_back(']');
+            }
+            client.ws.send(std::move(client.frame));
+            bump(client.worker.stats.samples, static_cast<std::uint64_t>(client.frame_samples));
+            bump(client.worker.stats.frames);
+            client.frame.clear();
+            client.frame_samples = 0;
+        }
+
+        // Fixed schedule; after a stall the missed ticks are skipped instead of sent in a burst.
+        next += period;
+        if (next < now) {
+            next = now + period;
+        }
+    }
+}
+
+void LoadGenerator::appendSample(SimClient &client, std::chrono::steady_clock::time_point generated) {
+    auto &frame = client.frame;
+    if (options_.encoding == LoadgenOptions::Encoding::ARRAY) {
+        frame.push_back(client.frame_samples == 0 ? '[' : ',');
+    }
+    frame += "{\"clientId\":\"";
+    frame += client.id;
+    frame += "\",\"timestamp\":\"";
+    frame += iso8601_now();
+    frame += '"';
+    if (options_.ack) {
+        frame += ",\"ack\":";
+        append_number(frame, steady_ns(generated));
+    }
+    frame += ",\"counters\":[";
+    for (int i = 0; i < options_.counters; ++i) {
+        if (i != 0) {
+            frame.push_back(',');
+        }
+        frame += "{\"name\":\"Counter ";
+        append_number(frame, i);
+        frame += "\",\"value\":";
+        append_number(frame, static_cast<double>(next_random(client.rng) % 10000) / 100.0);
+        frame.push_back('}');
+    }
+    frame += "]}";
+    ++client.frame_samples;
+}
+
+void LoadGenerator::onMessage(SimClient &client, const std::string &message) {
+    FlowControlMessage flow;
+    if (FlowControlMessage::fromJson(message, flow)) {
+        client.ws.applyFlowControl(flow);
+        return;
+    }
+    if (message.find("\"ack\"") == std::string::npos) {
+        return;
+    }
+
+    const auto received = steady_ns(std::chrono::steady_clock::now());
+    const auto j = nlohmann::json::parse(message, nullptr, false);
+    if (j.is_discarded() || !j.is_object() || j.value("type", "") != "ack") {
+        return;
+    }
+    const auto generated = j.value("ack", std::int64_t{0});
+    const auto stored = j.value("stored_ns", std::int64_t{0});
+
+    auto &stats = client.worker.stats;
+    bump(stats.acks);
+    stats.ingest_ns.record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, stored - generated)));
+    stats.ack_ns.record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, received - generated)));
+}
+
+LoadGenerator::Totals LoadGenerator::collect() const {
+    Totals totals;
+    totals.ingest_ns = std::make_unique<LatencyHistogram::Counts>();
+    totals.ack_ns = std::make_unique<LatencyHistogram::Counts>();
+    totals.ingest_ns->fill(0);
+    totals.ack_ns->fill(0);
+
+    for (const auto &worker: workers_) {
+        const auto &stats = worker->stats;
+        totals.connected += stats.connected.load(std::memory_order_relaxed);
+        totals.connect_failed += stats.connect_failed.load(std::memory_order_relaxed);
+        totals.disconnected += stats.disconnected.load(std::memory_order_relaxed);
+        totals.samples += stats.samples.load(std::memory_order_relaxed);
+        totals.frames += stats.frames.load(std::memory_order_relaxed);
+        totals.acks += stats.acks.load(std::memory_order_relaxed);
+        stats.ingest_ns.addTo(*totals.ingest_ns);
+        stats.ack_ns.addTo(*totals.ack_ns);
+    }
+    for (const auto &client: clients_) {
+        totals.wire_bytes_out += client->ws.getCompressionStats().wire_bytes_out.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void LoadGenerator::report(const Totals &now, const Totals &previous, double seconds, bool final) const {
+    const auto rate = [seconds](std::uint64_t current, std::uint64_t before) {
+        return seconds > 0 && current > before ? static_cast<double>(current - before) / seconds : 0.0;
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    if (!final) {
+        auto ingest = *now.ingest_ns;
+        auto ack = *now.ack_ns;
+        for (std::size_t i = 0; i < ingest.size(); ++i) {
+            ingest[i] -= (*previous.ingest_ns)[i];
+            ack[i] -= (*previous.ack_ns)[i];
+        }
+        const auto ingest_summary = LatencySummary::fromCounts(ingest);
+        const auto ack_summary = LatencySummary::fromCounts(ack);
+        std::cout << "clients " << now.connected - now.disconnected << "/" << options_.clients
+                << " | samples " << rate(now.samples, previous.samples) << "/s"
+                << ", acks " << rate(now.acks, previous.acks) << "/s"
+                << ", wire out " << rate(now.wire_bytes_out, previous.wire_bytes_out) / 1024.0 << " KiB/s"
+                << " | ingest p99 " << format_ms(ingest_summary.p99)
+                << ", ack p50 " << format_ms(ack_summary.p50) << " p99 " << format_ms(ack_summary.p99)
+                << std::endl;
+        std::cout << std::defaultfloat;
+        return;
+    }
+
+    std::cout << "\n--- Load generator results ---\n"
+            << "clients: " << now.connected << " connected, " << now.connect_failed << " failed to connect, "
+            << now.disconnected << " lost\n"
+            << "sent: " << now.samples << " samples in " << now.frames << " frames, "
+            << options_.counters << " counters each ("
+            << (options_.encoding == LoadgenOptions::Encoding::ARRAY ? "array" : "object") << " encoding, deflate "
+            << (options_.compression.enabled ? "on" : "off") << ")\n"
+            << "throughput over the " << seconds << " s after ramp-up: "
+            << rate(now.samples, previous.samples) << " samples/s, "
+            << rate(now.frames, previous.frames) << " frames/s, "
+            << rate(now.wire_bytes_out, previous.wire_bytes_out) / 1024.0 << " KiB/s on the wire\n";
+    if (options_.ack) {
+        std::cout << "acked: " << now.acks << " (" << (now.samples > now.acks ? now.samples - now.acks : 0)
+                << " missing)\n";
+        std::cout << "latency since start:" << std::endl;
+        print_latency("ingest (sample -> stored)", LatencySummary::fromCounts(*now.ingest_ns));
+        print_latency("ack (sample -> ack received)", LatencySummary::fromCounts(*now.ack_ns));
+    }
+    std::cout << std::defaultfloat << std::flush;
+}
+
+std::uint64_t LoadGenerator::serverResidentBytes() const {
+    if (options_.server_pid <= 0) {
+        return 0;
+    }
+    // "VmRSS:    12345 kB" in /proc/<pid>/status; Linux only, like the rest of the measurement.
+    std::ifstream status("/proc/" + std::to_string(options_.server_pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+bool LoadGenerator::reportMemory(std::uint64_t before, std::uint64_t after, std::uint64_t connections) const {
+    if (options_.server_pid <= 0) {
+        return true;
+    }
+    if (before == 0 || after == 0 || connections == 0) {
+        std::cout << "Server memory: could not read /proc/" << options_.server_pid << "/status" << std::endl;
+        return options_.max_connection_kb <= 0;
+    }
+
+    const auto grown = after > before ? after - before : 0;
+    const auto per_connection_kb = static_cast<double>(grown) / static_cast<double>(connections) / 1024.0;
+    std::cout << "Server memory: " << std::fixed << std::setprecision(1)
+            << static_cast<double>(before) / (1024 * 1024) << " MB -> " << static_cast<double>(after) / (1024 * 1024)
+            << " MB for " << connections << " connections, " << std::setprecision(2) << per_connection_kb
+            << " KB per connection";
+    if (options_.max_connection_kb <= 0) {
+        std::cout << std::endl;
+        return true;
+    }
+    const bool passed = per_connection_kb <= options_.max_connection_kb;
+    std::cout << (passed ? " (within " : " (EXCEEDS ") << options_.max_connection_kb << " KB)" << std::endl;
+    return passed;
+}
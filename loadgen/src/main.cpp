@@ -0,0 +1,60 @@
+#include "LoadGenerator.h"
+#include "CommandLine.h"
+#include "Logger.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Thousands of simulated clients need as many sockets; raise the soft limit as far as allowed.
+void raise_open_file_limit() {
+#ifndef _WIN32
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    std::cout << "--- WebSocket Performance Monitor Load Generator ---\n";
+    const CommandLine cl(argc, argv);
+    auto log_options = LogOptions::fromCommandLine(cl);
+    if (!cl.has("log-level")) {
+        log_options.level = LogLevel::Warn;
+    }
+    Logger::configure(log_options);
+    raise_open_file_limit();
+
+    const auto options = LoadgenOptions::fromCommandLine(cl);
+    std::cout << "\nConfiguration set:" << std::endl;
+    std::cout << "  - Server:        " << options.host << ":" << options.port << std::endl;
+    std::cout << "  - Clients:       " << options.clients << " on " << options.threads << " threads" << std::endl;
+    std::cout << "  - Samples:       " << options.rate << "/s per client, " << options.counters << " counters" << std::endl;
+    std::cout << "  - Encoding:      "
+            << (options.encoding == LoadgenOptions::Encoding::ARRAY
+                    ? "array of " + std::to_string(options.batch)
+                    : std::string("object"))
+            << (options.compression.enabled ? ", permessage-deflate" : "") << std::endl;
+    std::cout << "  - Acks:          " << (options.ack ? "on" : "off") << std::endl;
+    if (options.idle) {
+        std::cout << "  - Idle:          connections only, no samples" << std::endl;
+    }
+    std::cout << "-------------------------------------------\n" << std::endl;
+
+    bool passed = true;
+    try {
+        LoadGenerator generator(options);
+        passed = generator.run();
+    } catch (const std::exception &e) {
+        std::cerr << "Fatal Error: " << e.what() << std::endl;
+        Logger::shutdown();
+        return 1;
+    }
+
+    Logger::shutdown();
+    return passed ? 0 : 2;
+}
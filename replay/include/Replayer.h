@@ -0,0 +1,140 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CommandLine.h"
+#include "CompressionOptions.h"
+#include "LatencyHistogram.h"
+#include "WSClient.h"
+
+struct ReplayOptions {
+    std::string capture_path;
+    std::string host = "127.0.0.1";
+    std::string port = "6969";
+    int connections = 100;
+    double speed = 1.0; // 0 replays as fast as possible
+    bool ack = true;
+    int threads = 0;
+    std::chrono::seconds drain{2};
+    std::chrono::seconds report_interval{1};
+    CompressionOptions compression;
+
+    static ReplayOptions fromCommandLine(const CommandLine &cl) {
+        ReplayOptions options;
+        options.capture_path = cl.getString("capture");
+        options.host = cl.getString("host", options.host);
+        options.port = cl.getString("port", options.port);
+        options.connections = static_cast<int>(std::max(1LL, cl.getInt("connections", options.connections)));
+        const auto speed = cl.getString("speed", "1");
+        options.speed = speed == "max" ? 0.0 : std::max(0.0, std::stod(speed));
+        options.ack = cl.getBool("ack", options.ack);
+        options.threads = static_cast<int>(cl.getInt("threads", options.threads));
+        if (options.threads <= 0) {
+            options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        options.drain = std::chrono::seconds(cl.getInt("drain", options.drain.count()));
+        options.report_interval = std::chrono::seconds(std::max(1LL, cl.getInt("report-interval", 1)));
+        options.compression = CompressionOptions::fromCommandLine(cl);
+        return options;
+    }
+};
+
+// Sends a capture recorded by the server (`record start <file>` or --record) back to a server.
+// Recorded sessions are spread round-robin over the connections, so per-session ordering is
+// kept; the dispatcher paces every frame to its recorded offset divided by the speed. With acks
+// on, the first sample of every frame gets the send time as its ack token, which yields the same
+// ingest/ack latencies the load generator reports.
+class Replayer {
+public:
+    explicit Replayer(ReplayOptions options);
+
+    ~Replayer();
+
+    // Loads the capture; returns false with error set if it cannot be read.
+    bool load(std::string &error);
+
+    void run();
+
+private:
+    struct Frame {
+        std::uint64_t time_ns = 0;
+        std::size_t connection = 0;
+        std::string payload;
+        // Where the ack token goes: ack_length characters at ack_offset are replaced (an existing
+        // token), or "\"ack\":<token>," is inserted there when ack_length is 0.
+        std::size_t ack_offset = std::string::npos;
+        std::size_t ack_length = 0;
+    };
+
+    struct alignas(64) WorkerStats {
+        std::atomic<std::uint64_t> connected{0};
+        std::atomic<std::uint64_t> connect_failed{0};
+        std::atomic<std::uint64_t> acks{0};
+        LatencyHistogram ingest_ns;
+        LatencyHistogram ack_ns;
+    };
+
+    struct Worker {
+        boost::asio::io_context ioc{1};
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{ioc.get_executor()};
+        std::thread thread;
+        WorkerStats stats;
+    };
+
+    struct Connection {
+        Connection(Worker &worker, const ReplayOptions &options);
+
+        Worker &worker;
+        WSClient ws;
+    };
+
+    // Written by the dispatcher thread only.
+    struct alignas(64) DispatchStats {
+        std::atomic<std::uint64_t> frames{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> acked_frames{0};
+        LatencyHistogram lag_ns; // how late frames left compared to the scaled schedule
+    };
+
+    struct Totals {
+        std::uint64_t frames = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t acked_frames = 0;
+        std::uint64_t acks = 0;
+        std::unique_ptr<LatencyHistogram::Counts> lag_ns;
+        std::unique_ptr<LatencyHistogram::Counts> ingest_ns;
+        std::unique_ptr<LatencyHistogram::Counts> ack_ns;
+    };
+
+    bool connectAll();
+
+    void dispatch(Frame &frame);
+
+    void onMessage(Connection &connection, const std::string &message);
+
+    [[nodiscard]] Totals collect() const;
+
+    void report(const Totals &now, const Totals &previous, double seconds, bool final) const;
+
+    ReplayOptions options_;
+    std::vector<Frame> frames_;
+    std::size_t sessions_ = 0;
+    std::uint64_t capture_span_ns_ = 0;
+    std::vector<std::unique_ptr<Worker> > workers_;
+    std::vector<std::unique_ptr<Connection> > connections_;
+    DispatchStats dispatch_stats_;
+    std::int64_t replay_start_ns_ = 0;
+};
+
+#endif //REPLAYER_H
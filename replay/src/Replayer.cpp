@@ -0,0 +1,340 @@
+#include "Replayer.h"
+
+#include "CaptureFormat.h"
+#include "Logger.h"
+
+#include <boost/asio/post.hpp>
+#include <nlohmann/json.hpp>
+
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+    void bump(std::atomic<std::uint64_t> &counter, std::uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::int64_t steady_ns(std::chrono::steady_clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    }
+
+    template<typename T>
+    void append_number(std::string &out, T value) {
+        char buf[32];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+
+    std::string format_ms(std::uint64_t ns) {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3) << static_cast<double>(ns) / 1e6 << " ms";
+        return ss.str();
+    }
+
+    void print_latency(const char *label, const LatencySummary &summary) {
+        std::cout << "  " << label << ": n=" << summary.count
+                << " p50=" << format_ms(summary.p50) << " p90=" << format_ms(summary.p90)
+                << " p99=" << format_ms(summary.p99) << " p99.9=" << format_ms(summary.p999)
+                << " max=" << format_ms(summary.max) << std::endl;
+    }
+
+    std::string speed_label(double speed) {
+        if (speed <= 0) {
+            return "max speed";
+        }
+        std::stringstream ss;
+        ss << speed << "x";
+        return ss.str();
+    }
+
+    LatencySummary interval_summary(const LatencyHistogram::Counts &now, const LatencyHistogram::Counts &before) {
+        auto counts = now;
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            counts[i] -= before[i];
+        }
+        return LatencySummary::fromCounts(counts);
+    }
+}
+
+Replayer::Connection::Connection(Worker &worker, const ReplayOptions &options): worker(worker),
+    ws(worker.ioc, options.host, options.port, options.compression) {
+    // Replay the recorded framing as is.
+    ws.setMaxCoalescedBytes(0);
+}
+
+Replayer::Replayer(ReplayOptions options): options_(std::move(options)) {
+    for (int i = 0; i < options_.threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    connections_.reserve(static_cast<std::size_t>(options_.connections));
+    for (int i = 0; i < options_.connections; ++i) {
+        auto &worker = *workers_[static_cast<std::size_t>(i) % workers_.size()];
+        connections_.push_back(std::make_unique<Connection>(worker, options_));
+    }
+}
+
+Replayer::~Replayer() {
+    for (auto &worker: workers_) {
+        worker->work.reset();
+        worker->ioc.stop();
+    }
+    for (auto &worker: workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    connections_.clear();
+}
+
+bool Replayer::load(std::string &error) {
+    CaptureReader reader;
+    if (!reader.open(options_.capture_path)) {
+        error = "could not read capture " + options_.capture_path;
+        return false;
+    }
+
+    // The whole capture is read up front so disk reads never disturb the pacing.
+    std::unordered_map<std::uint64_t, std::size_t> connection_of;
+    CaptureRecord record;
+    while (reader.next(record)) {
+        const auto [it, inserted] = connection_of.try_emplace(
+            record.session_id, connection_of.size() % connections_.size());
+
+        Frame frame;
+        frame.time_ns = record.time_ns;
+        frame.connection = it->second;
+        frame.payload = std::move(record.payload);
+        if (options_.ack) {
+            const auto existing = frame.payload.find("\"ack\":");
+            if (existing != std::string::npos) {
+                // Recorded from a load generator run: reuse its token slot.
+                const auto begin = existing + 6;
+                const auto end = std::min(frame.payload.find_first_not_of("-0123456789", begin), frame.payload.size());
+                if (end > begin) {
+                    frame.ack_offset = begin;
+                    frame.ack_length = end - begin;
+                }
+            } else if (frame.payload.starts_with("{\"")) {
+                frame.ack_offset = 1;
+            } else if (frame.payload.starts_with("[{\"")) {
+                frame.ack_offset = 2;
+            }
+        }
+        frames_.push_back(std::move(frame));
+    }
+    if (frames_.empty()) {
+        error = "capture " + options_.capture_path + " contains no frames";
+        return false;
+    }
+    sessions_ = connection_of.size();
+    capture_span_ns_ = frames_.back().time_ns;
+    return true;
+}
+
+bool Replayer::connectAll() {
+    for (auto &connection: connections_) {
+        connection->ws.setOnConnectCallback([&connection = *connection](const boost::beast::error_code &ec) {
+            bump(ec ? connection.worker.stats.connect_failed : connection.worker.stats.connected);
+        });
+        connection->ws.setOnMessageCallback([this, &connection = *connection](const std::string &message) {
+            onMessage(connection, message);
+        });
+        connection->ws.connect();
+    }
+    for (auto &worker: workers_) {
+        worker->thread = std::thread([&ioc = worker->ioc]() { ioc.run(); });
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    for (;;) {
+        std::uint64_t connected = 0, failed = 0;
+        for (const auto &worker: workers_) {
+            connected += worker->stats.connected.load(std::memory_order_relaxed);
+            failed += worker->stats.connect_failed.load(std::memory_order_relaxed);
+        }
+        if (connected + failed == connections_.size() || std::chrono::steady_clock::now() > deadline) {
+            std::cout << "Connected " << connected << "/" << connections_.size() << " connections";
+            if (failed > 0) {
+                std::cout << " (" << failed << " failed)";
+            }
+            std::cout << std::endl;
+            return connected == connections_.size();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+void Replayer::run() {
+    if (!connectAll()) {
+        std::cerr << "Not every connection could be opened; aborting the replay." << std::endl;
+        return;
+    }
+
+    std::cout << "Replaying " << frames_.size() << " frames from " << sessions_ << " sessions ("
+            << std::fixed << std::setprecision(1) << static_cast<double>(capture_span_ns_) / 1e9
+            << " s recorded) at " << std::defaultfloat << speed_label(options_.speed) << std::endl;
+
+    const auto start = std::chrono::steady_clock::now();
+    replay_start_ns_ = steady_ns(start);
+    auto previous = collect();
+    auto previous_time = start;
+    auto next_report = start + options_.report_interval;
+
+    for (auto &frame: frames_) {
+        auto due = start;
+        if (options_.speed > 0) {
+            due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::nano>(static_cast<double>(frame.time_ns) / options_.speed));
+        }
+        for (;;) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_report) {
+                auto totals = collect();
+                report(totals, previous, std::chrono::duration<double>(now - previous_time).count(), false);
+                previous = std::move(totals);
+                previous_time = now;
+                next_report += options_.report_interval;
+            }
+            if (now >= due) {
+                dispatch_stats_.lag_ns.record(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count()));
+                break;
+            }
+            std::this_thread::sleep_until(std::min(due, next_report));
+        }
+        dispatch(frame);
+    }
+
+    // Throughput counts until the server acked the last frame, not until it was handed to a socket.
+    const auto sent = std::chrono::steady_clock::now();
+    const auto drain_until = sent + options_.drain;
+    auto finished = sent;
+    while (options_.ack && finished < drain_until) {
+        const auto totals = collect();
+        if (totals.acks >= totals.acked_frames) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        finished = std::chrono::steady_clock::now();
+    }
+    std::cout << "\nDispatched in " << std::chrono::duration<double>(sent - start).count() << " s, done after "
+            << std::chrono::duration<double>(finished - start).count() << " s" << std::endl;
+    report(collect(), {}, std::chrono::duration<double>(finished - start).count(), true);
+
+    for (auto &connection: connections_) {
+        connection->ws.disconnect();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+void Replayer::dispatch(Frame &frame) {
+    auto &connection = *connections_[frame.connection];
+    std::string message;
+    if (frame.ack_offset == std::string::npos) {
+        message = frame.payload;
+    } else {
+        message.reserve(frame.payload.size() + 32);
+        message.append(frame.payload, 0, frame.ack_offset);
+        if (frame.ack_length == 0) {
+            message += "\"ack\":";
+        }
+        append_number(message, steady_ns(std::chrono::steady_clock::now()));
+        if (frame.ack_length == 0) {
+            message.push_back(',');
+        }
+        message.append(frame.payload, frame.ack_offset + frame.ack_length);
+        bump(dispatch_stats_.acked_frames);
+    }
+    connection.ws.send(std::move(message));
+    bump(dispatch_stats_.frames);
+    bump(dispatch_stats_.bytes, frame.payload.size());
+}
+
+void Replayer::onMessage(Connection &connection, const std::string &message) {
+    // Flow-control credits are not applied: WSClient writes one frame at a time, so the
+    // server's read-side backpressure already paces the replay.
+    if (message.find("\"ack\"") == std::string::npos) {
+        return;
+    }
+
+    const auto received = steady_ns(std::chrono::steady_clock::now());
+    const auto j = nlohmann::json::parse(message, nullptr, false);
+    if (j.is_discarded() || !j.is_object() || j.value("type", "") != "ack") {
+        return;
+    }
+    const auto sent = j.value("ack", std::int64_t{0});
+    const auto stored = j.value("stored_ns", std::int64_t{0});
+    // Tokens from the original run (further samples of a recorded array frame) are not ours.
+    if (sent < replay_start_ns_) {
+        return;
+    }
+
+    auto &stats = connection.worker.stats;
+    bump(stats.acks);
+    stats.ingest_ns.record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, stored - sent)));
+    stats.ack_ns.record(static_cast<std::uint64_t>(std::max<std::int64_t>(0, received - sent)));
+}
+
+Replayer::Totals Replayer::collect() const {
+    Totals totals;
+    totals.lag_ns = std::make_unique<LatencyHistogram::Counts>();
+    totals.ingest_ns = std::make_unique<LatencyHistogram::Counts>();
+    totals.ack_ns = std::make_unique<LatencyHistogram::Counts>();
+    totals.lag_ns->fill(0);
+    totals.ingest_ns->fill(0);
+    totals.ack_ns->fill(0);
+
+    totals.frames = dispatch_stats_.frames.load(std::memory_order_relaxed);
+    totals.bytes = dispatch_stats_.bytes.load(std::memory_order_relaxed);
+    totals.acked_frames = dispatch_stats_.acked_frames.load(std::memory_order_relaxed);
+    dispatch_stats_.lag_ns.addTo(*totals.lag_ns);
+    for (const auto &worker: workers_) {
+        totals.acks += worker->stats.acks.load(std::memory_order_relaxed);
+        worker->stats.ingest_ns.addTo(*totals.ingest_ns);
+        worker->stats.ack_ns.addTo(*totals.ack_ns);
+    }
+    return totals;
+}
+
+void Replayer::report(const Totals &now, const Totals &previous, double seconds, bool final) const {
+    const auto rate = [seconds](std::uint64_t current, std::uint64_t before) {
+        return seconds > 0 && current > before ? static_cast<double>(current - before) / seconds : 0.0;
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    if (!final) {
+        const auto lag = interval_summary(*now.lag_ns, *previous.lag_ns);
+        const auto ingest = interval_summary(*now.ingest_ns, *previous.ingest_ns);
+        const auto ack = interval_summary(*now.ack_ns, *previous.ack_ns);
+        std::cout << "frames " << now.frames << "/" << frames_.size()
+                << " | " << rate(now.frames, previous.frames) << " frames/s"
+                << ", " << rate(now.bytes, previous.bytes) / 1024.0 << " KiB/s"
+                << ", acks " << rate(now.acks, previous.acks) << "/s"
+                << " | lag p99 " << format_ms(lag.p99)
+                << " | ingest p99 " << format_ms(ingest.p99)
+                << ", ack p50 " << format_ms(ack.p50) << " p99 " << format_ms(ack.p99)
+                << std::endl;
+        std::cout << std::defaultfloat;
+        return;
+    }
+
+    std::cout << "--- Replay results ---\n"
+            << "capture: " << options_.capture_path << ", " << frames_.size() << " frames from " << sessions_
+            << " sessions over " << connections_.size() << " connections\n"
+            << "sent: " << now.frames << " frames, " << static_cast<double>(now.bytes) / 1024.0 << " KiB in "
+            << seconds << " s (recorded span " << static_cast<double>(capture_span_ns_) / 1e9 << " s, "
+            << speed_label(options_.speed) << ")\n"
+            << "throughput: " << rate(now.frames, 0) << " frames/s, " << rate(now.bytes, 0) / 1024.0
+            << " KiB/s\n";
+    print_latency("schedule lag (due -> sent)", LatencySummary::fromCounts(*now.lag_ns));
+    if (options_.ack) {
+        std::cout << "acked: " << now.acks << " of " << now.acked_frames << " frames ("
+                << (now.acked_frames > now.acks ? now.acked_frames - now.acks : 0) << " missing)\n";
+        print_latency("ingest (sent -> stored)", LatencySummary::fromCounts(*now.ingest_ns));
+        print_latency("ack (sent -> ack received)", LatencySummary::fromCounts(*now.ack_ns));
+    }
+    std::cout << std::defaultfloat << std::flush;
+}
@@ -0,0 +1,70 @@
+#include "Replayer.h"
+#include "CommandLine.h"
+#include "Logger.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Many replay connections need as many sockets; raise the soft limit as far as allowed.
+void raise_open_file_limit() {
+#ifndef _WIN32
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    std::cout << "--- WebSocket Performance Monitor Replay ---\n";
+    const CommandLine cl(argc, argv);
+    auto log_options = LogOptions::fromCommandLine(cl);
+    if (!cl.has("log-level")) {
+        log_options.level = LogLevel::Warn;
+    }
+    Logger::configure(log_options);
+    raise_open_file_limit();
+
+    const auto options = ReplayOptions::fromCommandLine(cl);
+    if (options.capture_path.empty()) {
+        std::cerr << "Usage: replay --capture=<file> [--connections=N] [--speed=1|10|max] [--host=...] [--port=...]"
+                << std::endl;
+        Logger::shutdown();
+        return 2;
+    }
+    std::cout << "\nConfiguration set:" << std::endl;
+    std::cout << "  - Server:        " << options.host << ":" << options.port << std::endl;
+    std::cout << "  - Capture:       " << options.capture_path << std::endl;
+    std::cout << "  - Connections:   " << options.connections << " on " << options.threads << " threads"
+            << (options.compression.enabled ? ", permessage-deflate" : "") << std::endl;
+    std::cout << "  - Speed:         ";
+    if (options.speed > 0) {
+        std::cout << options.speed << "x" << std::endl;
+    } else {
+        std::cout << "as fast as possible" << std::endl;
+    }
+    std::cout << "  - Acks:          " << (options.ack ? "on" : "off") << std::endl;
+    std::cout << "-------------------------------------------\n" << std::endl;
+
+    try {
+        Replayer replayer(options);
+        std::string error;
+        if (!replayer.load(error)) {
+            std::cerr << "Error: " << error << std::endl;
+            Logger::shutdown();
+            return 1;
+        }
+        replayer.run();
+    } catch (const std::exception &e) {
+        std::cerr << "Fatal Error: " << e.what() << std::endl;
+        Logger::shutdown();
+        return 1;
+    }
+
+    Logger::shutdown();
+    return 0;
+}
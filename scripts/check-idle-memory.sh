@@ -0,0 +1,28 @@
+#!/bin/sh
+# Idle connection memory check: starts the server with its default options, opens idle
+# connections with loadgen and fails when the server's RSS grows by more than the limit per
+# connection. Usage: check-idle-memory.sh [build dir] [clients] [max KB per connection]
+set -u
+
+build_dir=${1:-cmake-build}
+clients=${2:-5000}
+max_kb=${3:-10}
+port=${CHECK_PORT:-6979}
+
+ulimit -n "$(ulimit -Hn)" 2>/dev/null || true
+
+# The server's CLI exits on end of input: feed it from a fifo this script holds open, so the
+# server stays up for the run and stops when the script exits.
+fifo=$(mktemp -u)
+mkfifo "$fifo" || exit 1
+"$build_dir/server" --port="$port" --log-level=warn < "$fifo" > /dev/null &
+server_pid=$!
+exec 3> "$fifo"
+rm -f "$fifo"
+trap 'kill "$server_pid" 2>/dev/null' EXIT
+sleep 1
+
+# permessage-deflate is left out on purpose: its zlib contexts cost ~100 KB per connection at
+# the default settings, so the target only holds for uncompressed connections.
+"$build_dir/loadgen" --port="$port" --clients="$clients" --idle=true --deflate=false \
+    --ramp-up=5 --duration=5 --server-pid="$server_pid" --max-conn-kb="$max_kb"
@@ -0,0 +1,45 @@
+#ifndef ADMISSIONOPTIONS_H
+#define ADMISSIONOPTIONS_H
+
+#include <boost/beast/websocket/stream_base.hpp>
+
+#include <chrono>
+#include <cstddef>
+
+#include "CommandLine.h"
+
+struct AdmissionOptions {
+    std::size_t max_connections = 10000;        // open sockets, including ones still handshaking
+    std::size_t max_rejecting = 64;             // refused sockets answered with 1013; beyond it, a bare 503
+    std::size_t max_message_bytes = 1024 * 1024; // larger frames close the session with 1009
+    std::chrono::seconds handshake_timeout{10};
+    std::chrono::seconds idle_timeout{60};      // 0 disables
+    bool keepalive_pings = true;                // ping at half the idle timeout before giving up
+
+    [[nodiscard]] boost::beast::websocket::stream_base::timeout toStreamTimeout() const {
+        boost::beast::websocket::stream_base::timeout timeout{};
+        timeout.handshake_timeout = handshake_timeout;
+        timeout.idle_timeout = idle_timeout.count() > 0
+                                   ? boost::beast::websocket::stream_base::duration(idle_timeout)
+                                   : boost::beast::websocket::stream_base::none();
+        timeout.keep_alive_pings = keepalive_pings && idle_timeout.count() > 0;
+        return timeout;
+    }
+
+    static AdmissionOptions fromCommandLine(const CommandLine &cl) {
+        AdmissionOptions options;
+        options.max_connections = static_cast<std::size_t>(cl.getInt("max-connections",
+                                                                      static_cast<long long>(options.max_connections)));
+        options.max_rejecting = static_cast<std::size_t>(cl.getInt("max-rejecting",
+                                                                    static_cast<long long>(options.max_rejecting)));
+        options.max_message_bytes = static_cast<std::size_t>(cl.getInt("max-message-bytes",
+                                                                        static_cast<long long>(options.max_message_bytes)));
+        options.handshake_timeout = std::chrono::seconds(cl.getInt("handshake-timeout",
+                                                                   options.handshake_timeout.count()));
+        options.idle_timeout = std::chrono::seconds(cl.getInt("idle-timeout", options.idle_timeout.count()));
+        options.keepalive_pings = cl.getBool("keepalive", options.keepalive_pings);
+        return options;
+    }
+};
+
+#endif //ADMISSIONOPTIONS_H
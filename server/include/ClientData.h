@@ -16,6 +16,9 @@ struct ClientData {
 
     std::chrono::system_clock::time_point timestamp;
     std::vector<MetricDataPoint> metrics;
+    // Longest the client stays silent about a counter it still reports ("max_silence_ms"); a
+    // value is only held this long past its point. 0 holds it until the next point.
+    std::chrono::milliseconds maxSilence{0};
 };
 
 #endif //CLIENTDATA_H
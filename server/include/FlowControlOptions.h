@@ -0,0 +1,26 @@
+#ifndef FLOWCONTROLOPTIONS_H
+#define FLOWCONTROLOPTIONS_H
+
+#include <cstddef>
+
+#include "CommandLine.h"
+
+struct FlowControlOptions {
+    bool enabled = true;
+    int window = 32;                   // credits granted per session at throttle level 0
+    std::size_t low_watermark = 256;   // ingest depth at which sessions are asked to batch
+    std::size_t high_watermark = 1024; // ingest depth at which reads pause and clients drop resolution
+
+    static FlowControlOptions fromCommandLine(const CommandLine &cl) {
+        FlowControlOptions options;
+        options.enabled = cl.getBool("flow-control", options.enabled);
+        options.window = static_cast<int>(cl.getInt("flow-window", options.window));
+        options.low_watermark = static_cast<std::size_t>(cl.getInt("flow-low-watermark",
+                                                                    static_cast<long long>(options.low_watermark)));
+        options.high_watermark = static_cast<std::size_t>(cl.getInt("flow-high-watermark",
+                                                                     static_cast<long long>(options.high_watermark)));
+        return options;
+    }
+};
+
+#endif //FLOWCONTROLOPTIONS_H
@@ -0,0 +1,55 @@
+#ifndef GZIPENCODER_H
+#define GZIPENCODER_H
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Wraps Beast's raw deflate in gzip framing. Each call produces one complete gzip member;
+// members can be concatenated into a single valid gzip body, which is what lets callers cache
+// compressed pieces and send them together.
+class GzipEncoder {
+public:
+    explicit GzipEncoder(int level = 6) {
+        deflater_.reset(level, 15, 8, boost::beast::zlib::Strategy::normal);
+    }
+
+    std::string encode(std::string_view in) {
+        namespace zlib = boost::beast::zlib;
+
+        static constexpr unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+        std::string out(reinterpret_cast<const char *>(header), sizeof(header));
+        out.resize(sizeof(header) + deflater_.upper_bound(in.size()));
+
+        zlib::z_params zs;
+        zs.next_in = in.data();
+        zs.avail_in = in.size();
+        zs.next_out = out.data() + sizeof(header);
+        zs.avail_out = out.size() - sizeof(header);
+
+        boost::beast::error_code ec;
+        deflater_.write(zs, zlib::Flush::finish, ec);
+        out.resize(sizeof(header) + zs.total_out);
+        deflater_.reset();
+
+        boost::crc_32_type crc;
+        crc.process_bytes(in.data(), in.size());
+        appendLittleEndian(out, crc.checksum());
+        appendLittleEndian(out, static_cast<std::uint32_t>(in.size()));
+        return out;
+    }
+
+private:
+    static void appendLittleEndian(std::string &out, std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    boost::beast::zlib::deflate_stream deflater_;
+};
+
+#endif //GZIPENCODER_H
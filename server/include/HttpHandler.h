@@ -0,0 +1,37 @@
+#ifndef HTTPHANDLER_H
+#define HTTPHANDLER_H
+
+#include <boost/beast/http.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using HttpRequest = boost::beast::http::request<boost::beast::http::string_body>;
+
+// What a handler returns for a plain HTTP request on the WebSocket port. Small responses set
+// body; large ones set next_chunk instead, which the session keeps calling (each call fills
+// chunk and returns true) and sends with chunked transfer encoding until it returns false.
+// Bodies assembled from cached pieces set body_parts, which are written with one gather write
+// without being copied together.
+struct HttpResponse {
+    boost::beast::http::status status = boost::beast::http::status::ok;
+    std::string content_type = "application/json";
+    std::string content_encoding;
+    std::string body;
+    std::function<bool(std::string &chunk)> next_chunk;
+    std::vector<std::shared_ptr<const std::string> > body_parts;
+
+    static HttpResponse error(boost::beast::http::status status, const std::string &message) {
+        HttpResponse response;
+        response.status = status;
+        response.body = "{\"error\":\"" + message + "\"}";
+        return response;
+    }
+};
+
+// Runs on the session's IO thread, so handlers must not block for long.
+using HttpHandler = std::function<HttpResponse(const HttpRequest &)>;
+
+#endif //HTTPHANDLER_H
@@ -0,0 +1,44 @@
+#ifndef HTTPQUERYAPI_H
+#define HTTPQUERYAPI_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "HttpHandler.h"
+#include "MetricStore.h"
+
+// Read-only JSON API over the client stores, served on the WebSocket port:
+//   GET /api/clients
+//   GET /api/series?client=<id>
+//   GET /api/query?client=<id>[&metric=<name|prefix*>][&from=<epoch ms>][&to=<epoch ms>]
+//   GET /api/aggregate?client=<id>[&metric=...][&from=...][&to=...]
+//   GET /api/summaries?client=<id>[&metric=...][&from=...][&to=...]
+// Query results are streamed series by series with chunked encoding.
+class HttpQueryApi {
+public:
+    HttpQueryApi(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores, std::mutex &stores_mutex);
+
+    HttpResponse handle(const HttpRequest &request) const;
+
+private:
+    using Params = std::map<std::string, std::string>;
+
+    HttpResponse listClients() const;
+
+    HttpResponse listSeries(const Params &params) const;
+
+    HttpResponse query(const Params &params) const;
+
+    HttpResponse aggregate(const Params &params) const;
+
+    HttpResponse summaries(const Params &params) const;
+
+    std::shared_ptr<MetricStore> findStore(const Params &params) const;
+
+    std::map<std::string, std::shared_ptr<MetricStore> > &client_stores_;
+    std::mutex &stores_mutex_;
+};
+
+#endif //HTTPQUERYAPI_H
@@ -0,0 +1,58 @@
+#ifndef INGESTQUEUE_H
+#define INGESTQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Session;
+
+// Hands inbound messages from the IO threads to a small pool of ingest workers. Each session is
+// pinned to one shard so its messages are still processed in arrival order.
+class IngestQueue {
+public:
+    using Handler = std::function<void(std::shared_ptr<Session>, const std::string &)>;
+
+    explicit IngestQueue(std::size_t workers);
+
+    ~IngestQueue();
+
+    void start(Handler handler);
+
+    void stop();
+
+    std::size_t assignShard();
+
+    void push(std::size_t shard, std::shared_ptr<Session> session, std::string message);
+
+    [[nodiscard]] std::size_t depth() const;
+
+private:
+    struct Item {
+        std::shared_ptr<Session> session;
+        std::string message;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Item> items;
+        std::thread worker;
+    };
+
+    void workerLoop(Shard &shard);
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    Handler handler_;
+    std::atomic<bool> is_running_{false};
+    std::atomic<std::size_t> depth_{0};
+    std::atomic<std::size_t> next_shard_{0};
+};
+
+#endif //INGESTQUEUE_H
@@ -0,0 +1,68 @@
+#ifndef IOCONTEXTPOOL_H
+#define IOCONTEXTPOOL_H
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CommandLine.h"
+
+struct IoContextPoolOptions {
+    int threads = 4;
+    // true: one single-threaded io_context per thread (thread-per-core), sessions pinned to the
+    // context that accepted them. false: one io_context shared by all threads, which costs every
+    // session its own strand (~1.3 KB per idle connection).
+    bool sharded = true;
+    // Sharded mode only: every shard binds its own SO_REUSEPORT acceptor so the kernel spreads
+    // connections. Otherwise shard 0 accepts and hands sockets off round-robin.
+    bool reuse_port = true;
+    bool cpu_affinity = false;
+
+    static IoContextPoolOptions fromCommandLine(const CommandLine &cl) {
+        IoContextPoolOptions options;
+        options.threads = static_cast<int>(cl.getInt("threads", options.threads));
+        if (options.threads <= 0) {
+            options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        options.sharded = cl.getBool("sharded", options.sharded);
+        options.reuse_port = cl.getBool("reuseport", options.reuse_port);
+        options.cpu_affinity = cl.getBool("cpu-affinity", options.cpu_affinity);
+        return options;
+    }
+};
+
+class IoContextPool {
+public:
+    explicit IoContextPool(IoContextPoolOptions options);
+
+    void run();
+
+    void stop();
+
+    void join();
+
+    boost::asio::io_context &getContext(std::size_t index);
+
+    boost::asio::io_context &getNextContext();
+
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] const IoContextPoolOptions &getOptions() const;
+
+private:
+    static void pinCurrentThread(std::size_t cpu);
+
+    IoContextPoolOptions options_;
+    std::vector<std::unique_ptr<boost::asio::io_context> > contexts_;
+    // Shards that have no acceptor start out idle; keep their run() from returning early.
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type> > work_guards_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> next_context_{0};
+};
+
+#endif //IOCONTEXTPOOL_H
@@ -4,14 +4,23 @@
 #include <string>
 #include <nlohmann/json.hpp>
 
+#include "CounterSummary.h"
+
 struct MetricDataPoint {
     std::string name;
     double value;
+    CounterSummary summary{}; // count 0 unless the client pre-aggregated a report window
 };
 
 inline void from_json(const nlohmann::json& j, MetricDataPoint& p) {
     j.at("name").get_to(p.name);
     j.at("value").get_to(p.value);
+    if (const auto summary = j.find("summary"); summary != j.end()) {
+        summary->get_to(p.summary);
+        p.summary.mean = p.value;
+    } else {
+        p.summary.count = 0;
+    }
 }
 
 
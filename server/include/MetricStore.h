@@ -5,20 +5,101 @@
 #include "ClientData.h"
 #include <string>
 #include <vector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <mutex>
+#include <unordered_map>
 #include <memory>
 
 class MetricStore {
 public:
+    using SeriesId = std::size_t;
+
+    // A counter name already resolved to its series.
+    struct SeriesRef {
+        std::string name;
+        SeriesId id;
+    };
+
+    // Series resolved for one client, kept by the caller across messages so repeat messages
+    // skip the store's name lookup. Counters usually arrive in the same order, so each position
+    // remembers the name last seen there; names that moved, as when a client only sends the
+    // counters that changed, are found by hash instead. Only valid for the store that filled it.
+    class SeriesCache {
+    public:
+        void clear() {
+            by_position_.clear();
+            by_name_.clear();
+        }
+
+    private:
+        friend class MetricStore;
+
+        std::vector<SeriesRef> by_position_;
+        std::unordered_map<std::string, SeriesId> by_name_;
+    };
+
+    // Summary of one series over a time range, over the same points readRange returns.
+    struct SeriesSummary {
+        std::size_t count = 0;
+        double min = 0.0;
+        double max = 0.0;
+        double sum = 0.0;
+        double last = 0.0;
+        // Step-function integral: each value held until the next point, the last one until
+        // min(to, now), but no longer than the series' max silence past its point.
+        // time_weighted_sum / covered_seconds is the time-weighted average.
+        double time_weighted_sum = 0.0;
+        double covered_seconds = 0.0;
+    };
+
     void addData(const ClientData& data);
 
+    void addData(const ClientData& data, SeriesCache& series_cache);
+
     void print() const;
 
     nlohmann::json exportToJson() const;
 
+    std::vector<std::string> getSeriesNames() const;
+
+    // Appends up to max_points points of the series with from <= timestamp < to to out, starting
+    // at cursor (0 on the first call) and advancing it; returns the number of points appended.
+    // Series are step functions (clients only report values that changed), so unless a point
+    // falls exactly on from, the first point is the value in effect at from, stamped with from.
+    // A value is only in effect for the max silence its client sent; where that runs out before
+    // the next point, a NaN point marks the gap.
+    std::size_t readRange(const std::string& name, std::chrono::system_clock::time_point from,
+                          std::chrono::system_clock::time_point to, std::size_t& cursor, std::size_t max_points,
+                          std::vector<TimeSeriesPoint>& out) const;
+
+    // Bumped by every addData call; lets readers skip stores that have not changed.
+    [[nodiscard]] std::uint64_t getVersion() const;
+
+    // Calls fn with the latest point of every series written after the given version.
+    void visitChangedSince(std::uint64_t version,
+                           const std::function<void(SeriesId, const std::string&, const TimeSeriesPoint&)>& fn) const;
+
+    // min/max also cover the report window summaries in the range, so spikes between points count.
+    bool summarize(const std::string& name, std::chrono::system_clock::time_point from,
+                   std::chrono::system_clock::time_point to, SeriesSummary& out) const;
+
+    // Report window summaries of the series with from <= timestamp < to, for clients that
+    // pre-aggregate; the series itself holds their means.
+    std::size_t readSummaries(const std::string& name, std::chrono::system_clock::time_point from,
+                              std::chrono::system_clock::time_point to, std::vector<SummaryPoint>& out) const;
+
 private:
-    std::map<std::string, std::vector<TimeSeriesPoint>> time_series_data_;
+    SeriesId resolveSeries(const std::string& name);
+
+    std::map<std::string, SeriesId> series_index_;
+    std::vector<std::vector<TimeSeriesPoint>> series_;
+    std::vector<std::vector<SummaryPoint>> summaries_; // empty for series without summaries
+    std::vector<std::uint64_t> series_versions_;
+    std::vector<std::chrono::milliseconds> max_silence_; // 0: unbounded
+    std::atomic<std::uint64_t> version_{0};
 
     mutable std::mutex mutex_;
 };
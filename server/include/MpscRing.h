@@ -0,0 +1,75 @@
+#ifndef MPSCRING_H
+#define MPSCRING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Fixed-capacity lock-free ring for many producers and a single consumer (Vyukov's bounded
+// queue). Each cell carries a sequence number that tells producers and the consumer whose
+// turn it is, so neither side ever blocks; a full ring rejects the push instead.
+template<typename T, std::size_t Capacity>
+class MpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "MpscRing elements are copied with plain stores");
+
+public:
+    MpscRing() {
+        for (std::size_t i = 0; i < Capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing &) = delete;
+
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    bool tryPush(const T &value) {
+        Cell *cell;
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & (Capacity - 1)];
+            const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; must only be called from one thread.
+    bool tryPop(T &out) {
+        Cell &cell = cells_[dequeue_pos_ & (Capacity - 1)];
+        const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(dequeue_pos_ + 1) < 0) {
+            return false;
+        }
+        out = cell.data;
+        cell.sequence.store(dequeue_pos_ + Capacity, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::array<Cell, Capacity> cells_;
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(64) std::size_t dequeue_pos_ = 0;
+};
+
+#endif //MPSCRING_H
@@ -0,0 +1,48 @@
+#ifndef PROMETHEUSEXPORTER_H
+#define PROMETHEUSEXPORTER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "GzipEncoder.h"
+#include "HttpHandler.h"
+#include "MetricStore.h"
+
+// Serves GET /metrics in the Prometheus text format: the latest value of every client series as
+//   perfmon_value{client="<id>",metric="<name>"} <value> <timestamp ms>
+// Each series line is cached and only re-rendered when the series changed since the previous
+// scrape; the lines of one client are kept as a single block (and a gzip member of it), and the
+// response gathers the blocks without copying them.
+class PrometheusExporter {
+public:
+    PrometheusExporter(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores, std::mutex &stores_mutex);
+
+    HttpResponse handle(const HttpRequest &request);
+
+private:
+    struct ClientBlock {
+        const MetricStore *store = nullptr;
+        std::uint64_t version = 0;
+        std::vector<std::string> lines; // indexed by series id
+        std::shared_ptr<const std::string> text;
+        std::shared_ptr<const std::string> gzip;
+    };
+
+    void refresh(const std::string &client, const MetricStore &store, ClientBlock &block);
+
+    std::map<std::string, std::shared_ptr<MetricStore> > &client_stores_;
+    std::mutex &stores_mutex_;
+
+    // Scrapes are serialised; they only do real work for clients that changed.
+    std::mutex render_mutex_;
+    std::map<std::string, ClientBlock> blocks_;
+    std::shared_ptr<const std::string> header_;
+    std::shared_ptr<const std::string> header_gzip_;
+    GzipEncoder gzip_;
+};
+
+#endif //PROMETHEUSEXPORTER_H
@@ -9,13 +9,27 @@
 #include <map>
 #include <memory>
 #include <list>
+#include <cstdint>
 
 #include "Metric.h"
 #include "MetricStore.h"
+#include "WSServer.h"
+#include "MpscRing.h"
+#include "ServerStats.h"
+
+// Fixed-size realtime feed entry; formatted only when the realtime view prints it.
+struct RealtimeEvent {
+    enum class Type : std::uint8_t { DATA_RECEIVED };
+
+    Type type;
+    std::uint32_t metric_count;
+    char client_id[48];
+};
 
 class ServerCLI {
 public:
-    ServerCLI(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores, std::atomic<bool> &shutdown_flag);
+    ServerCLI(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores, WSServer &server,
+              ServerStats &stats, std::atomic<bool> &shutdown_flag);
 
     ~ServerCLI();
 
@@ -23,7 +37,9 @@ public:
 
     void stop();
 
-    void postMessage(const std::string &message);
+    [[nodiscard]] bool isRealtimeViewActive() const;
+
+    void postDataReceived(const std::string &client_id, std::size_t metric_count);
 
 private:
     enum class View { COMMAND, REALTIME };
@@ -33,10 +49,15 @@ private:
     std::atomic<bool> is_running_{false};
 
     std::map<std::string, std::shared_ptr<MetricStore> > &client_stores_;
+    WSServer &server_;
+    ServerStats &stats_;
     std::atomic<bool> &app_shutdown_flag_;
 
-    std::list<std::string> realtime_queue_;
-    std::mutex queue_mutex_;
+    // Baseline for the rates printed by `stats`.
+    ServerStats::Snapshot last_stats_;
+
+    MpscRing<RealtimeEvent, 256> realtime_ring_;
+    std::atomic<std::size_t> realtime_dropped_{0};
 
     void cliLoop();
 
@@ -44,6 +65,8 @@ private:
 
     void runRealtimeView();
 
+    void drainRealtimeRing(bool print);
+
     void processCommand(const std::string &line);
 
     static void printPrompt();
@@ -58,6 +81,12 @@ private:
 
     void handleExportClientData(const std::vector<std::string> &args) const;
 
+    void handleListSessions() const;
+
+    void handleStats();
+
+    void handleRecord(const std::vector<std::string> &args);
+
     void handleSwitchView(const std::vector<std::string> &args);
 
     void handleExit();
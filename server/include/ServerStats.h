@@ -0,0 +1,52 @@
+#ifndef SERVERSTATS_H
+#define SERVERSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+// Ingest-path counters. Every thread that records gets its own cache-line aligned slot, so the
+// hot path never contends or false-shares; readers sum the slots.
+class ServerStats {
+public:
+    // Client id under which the server stores its own metrics; remote clients may not use it.
+    static constexpr const char *reserved_client_id = "__server__";
+
+    struct alignas(64) ThreadCounters {
+        std::atomic<std::uint64_t> messages{0};
+        std::atomic<std::uint64_t> samples{0};
+        std::atomic<std::uint64_t> rejected{0}; // failed to parse or ingest
+        std::atomic<std::uint64_t> bytes{0};
+        LatencyHistogram parse_ns;
+        LatencyHistogram store_ns;
+
+        static void bump(std::atomic<std::uint64_t> &counter, std::uint64_t n = 1) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    struct Snapshot {
+        std::chrono::steady_clock::time_point taken;
+        std::uint64_t messages = 0;
+        std::uint64_t samples = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t bytes = 0;
+        LatencySummary parse_ns;
+        LatencySummary store_ns;
+    };
+
+    ThreadCounters &local();
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadCounters> > threads_;
+};
+
+#endif //SERVERSTATS_H
@@ -4,11 +4,18 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/container/deque.hpp>
 
 #include <memory>
+#include <optional>
 #include <string>
-#include <list>
+#include <atomic>
+
+#include "CompressionStats.h"
+#include "HttpHandler.h"
+#include "MetricStore.h"
 
 class WSServer;
 
@@ -23,27 +30,105 @@ public:
         return std::make_shared<make_shared_enabler>(std::move(socket), server);
     }
 
-    void send(const std::string &message);
+    ~Session();
+
+    void send(const std::string &message, bool is_json);
+
+    // Queues a shared, immutable payload; broadcasts hand the same buffer to every session.
+    // Runs of JSON frames are gathered into one array message, but only for clients that
+    // negotiated the BatchFrames subprotocol; the caller says whether it built JSON.
+    void send(std::shared_ptr<const std::string> message, bool is_json);
+
+    // Flow control grants, acks and request errors. They bypass the write queue's overflow policy
+    // and go out ahead of queued data, each as its own frame: a client waiting for a grant only
+    // writes again once it arrives.
+    void send_control(std::string message);
+
+    [[nodiscard]] std::size_t get_dropped_frames() const;
+
+    [[nodiscard]] std::size_t get_write_queue_depth() const;
+
+    [[nodiscard]] std::uint64_t get_id() const;
 
     boost::asio::ip::tcp::endpoint get_remote_endpoint() const;
 
+    const CompressionStats &get_compression_stats() const;
+
+    // Store resolved for the client this session last reported as, bound on its first message.
+    // Only touched from the session's ingest shard, so it needs no locking.
+    struct StoreBinding {
+        std::string client_id;
+        std::shared_ptr<MetricStore> store;
+        MetricStore::SeriesCache series;
+    };
+
+    StoreBinding &get_store_binding();
+
 private:
     friend class WSServer;
 
-    boost::beast::websocket::stream<boost::beast::tcp_stream> ws_;
+    CompressionStats compression_stats_;
+
+    boost::beast::websocket::stream<MeteredTcpStream> ws_;
 
     Session(boost::asio::ip::tcp::socket &&socket, WSServer &server);
 
-    void run(boost::asio::yield_context yield);
+    // Stackless coroutines: each suspended session costs one small heap frame instead of a
+    // dedicated stack, which is what lets a single process hold 100k+ idle connections.
+    boost::asio::awaitable<void> run();
 
-    void do_read(boost::asio::yield_context yield);
+    // Answers plain HTTP requests until the connection asks to upgrade; returns that request.
+    boost::asio::awaitable<std::optional<HttpRequest> > serve_http();
 
-    void do_write(boost::asio::yield_context yield);
+    boost::asio::awaitable<void> run_websocket(HttpRequest upgrade);
+
+    boost::asio::awaitable<void> write_http_response(const HttpRequest &request, boost::beast::error_code &ec);
+
+    boost::asio::awaitable<void> do_read();
+
+    // The session's only writer: started once the handshake is done, it drains both queues and
+    // then sleeps on write_signal_ until start_write() wakes it or the session stops.
+    boost::asio::awaitable<void> do_write();
+
+    // Writes the next control frame, or the next run of queued frames. Kept out of do_write so
+    // the frame that stays suspended while the session is idle holds no buffers.
+    boost::asio::awaitable<void> write_next(boost::beast::error_code &ec);
+
+    boost::asio::awaitable<void> stop_writer();
+
+    boost::asio::awaitable<void> wait_for_ingest_capacity();
+
+    void grant_credits();
+
+    void consume_credit();
+
+    struct QueuedFrame {
+        std::shared_ptr<const std::string> payload;
+        bool is_json = true;
+    };
+
+    void start_write();
 
     boost::beast::flat_buffer buffer_;
-    std::list<std::shared_ptr<const std::string> > write_queue_;
+    // Boost's deque allocates nothing until the first push; std::deque costs ~600 bytes per
+    // queue even while empty, which adds up across idle connections.
+    boost::container::deque<QueuedFrame> write_queue_;
+    boost::container::deque<std::string> control_queue_;
+    boost::asio::steady_timer write_signal_;
+    boost::asio::steady_timer writer_done_;
+    bool writer_running_ = false;
+    bool write_stopped_ = false;
+    bool batch_frames_ = false; // client negotiated BatchFrames::subprotocol
+    std::atomic<std::size_t> dropped_frames_{0};
+    std::atomic<std::size_t> write_queue_depth_{0}; // mirrors both queues' size for other threads
 
     WSServer &server_;
+    std::uint64_t session_id_ = 0;
+    std::size_t ingest_shard_;
+    int credits_ = 0;
+    int granted_credits_ = 0;
+
+    StoreBinding store_binding_;
 };
 
 
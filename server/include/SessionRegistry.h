@@ -0,0 +1,141 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Sharded slot map. Insert and remove are O(1) (free list per shard), ids stay valid until
+// removed and are never reused by accident thanks to a per-slot generation, and iteration
+// walks each shard in place under that shard's lock instead of copying the whole set.
+//
+// Id layout: [shard:8][index:24][generation:32].
+template<typename T, std::size_t ShardCount = 16>
+class ShardedRegistry {
+    static_assert(ShardCount > 0 && ShardCount <= 256, "shard index is stored in 8 bits");
+
+public:
+    using Id = std::uint64_t;
+    static constexpr Id INVALID_ID = 0;
+
+    Id insert(T value) {
+        return insert(std::move(value), [](Id, T &) {
+        });
+    }
+
+    // on_insert(id, value) runs under the shard lock, so iteration never sees the value before
+    // whatever on_insert stores in it (e.g. the id itself).
+    template<typename OnInsert>
+    Id insert(T value, OnInsert &&on_insert) {
+        const auto shard_index = next_shard_.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+        auto &shard = shards_[shard_index];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::uint32_t index;
+        if (!shard.free_list.empty()) {
+            index = shard.free_list.back();
+            shard.free_list.pop_back();
+        } else {
+            index = static_cast<std::uint32_t>(shard.slots.size());
+            shard.slots.emplace_back();
+        }
+
+        auto &slot = shard.slots[index];
+        slot.value = std::move(value);
+        slot.occupied = true;
+        size_.fetch_add(1, std::memory_order_relaxed);
+        const auto id = makeId(shard_index, index, slot.generation);
+        on_insert(id, slot.value);
+        return id;
+    }
+
+    bool remove(Id id) {
+        auto &shard = shards_[shardOf(id)];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto index = indexOf(id);
+        if (index >= shard.slots.size()) {
+            return false;
+        }
+        auto &slot = shard.slots[index];
+        if (!slot.occupied || slot.generation != generationOf(id)) {
+            return false;
+        }
+
+        slot.value = T{};
+        slot.occupied = false;
+        // Skip 0 so that a live id can never equal INVALID_ID.
+        if (++slot.generation == 0) {
+            slot.generation = 1;
+        }
+        shard.free_list.push_back(index);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // fn runs under one shard lock at a time; it must not call back into the registry.
+    template<typename Fn>
+    void forEach(Fn &&fn) {
+        for (auto &shard: shards_) {
+            forEachInShard(shard, fn);
+        }
+    }
+
+    template<typename Fn>
+    void forEachInShard(std::size_t shard_index, Fn &&fn) {
+        forEachInShard(shards_[shard_index % ShardCount], fn);
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    static constexpr std::size_t shardCount() {
+        return ShardCount;
+    }
+
+private:
+    struct Slot {
+        T value{};
+        std::uint32_t generation = 1;
+        bool occupied = false;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::vector<std::uint32_t> free_list;
+    };
+
+    template<typename Fn>
+    static void forEachInShard(Shard &shard, Fn &fn) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto &slot: shard.slots) {
+            if (slot.occupied) {
+                fn(slot.value);
+            }
+        }
+    }
+
+    static Id makeId(std::size_t shard, std::uint32_t index, std::uint32_t generation) {
+        return (static_cast<Id>(shard) << 56) | (static_cast<Id>(index & 0xFFFFFF) << 32) | generation;
+    }
+
+    static std::size_t shardOf(Id id) { return static_cast<std::size_t>(id >> 56) % ShardCount; }
+
+    static std::uint32_t indexOf(Id id) { return static_cast<std::uint32_t>((id >> 32) & 0xFFFFFF); }
+
+    static std::uint32_t generationOf(Id id) { return static_cast<std::uint32_t>(id); }
+
+    std::array<Shard, ShardCount> shards_;
+    std::atomic<std::size_t> next_shard_{0};
+    std::atomic<std::size_t> size_{0};
+};
+
+class Session;
+using SessionRegistry = ShardedRegistry<std::shared_ptr<Session> >;
+
+#endif //SESSIONREGISTRY_H
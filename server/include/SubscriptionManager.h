@@ -0,0 +1,79 @@
+#ifndef SUBSCRIPTIONMANAGER_H
+#define SUBSCRIPTIONMANAGER_H
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ClientData.h"
+#include "Subscription.h"
+
+class Session;
+
+// Live series subscriptions (see Subscription.h for the wire protocol). Ingest workers publish
+// samples, which are matched through a metric-name index and coalesced per subscription; a
+// single timer flushes each subscription at most once per its interval.
+class SubscriptionManager {
+public:
+    SubscriptionManager(boost::asio::io_context &ioc, std::size_t max_per_session);
+
+    // Starts the flush timer; it runs until the io_context stops.
+    void start();
+
+    void handle(const std::shared_ptr<Session> &session, const SubscriptionRequest &request);
+
+    void removeSession(std::uint64_t session_id);
+
+    void publish(const ClientData &data);
+
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Point {
+        std::int64_t t_ms;
+        double value;
+    };
+
+    struct Subscription {
+        std::weak_ptr<Session> session;
+        std::string id;
+        LabelSelector client;
+        LabelSelector metric;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next_due;
+        // Latest point per (client, metric) since the last flush.
+        std::map<std::pair<std::string, std::string>, Point> pending;
+    };
+
+    using Key = std::pair<std::uint64_t, std::string>; // (session id, subscription id)
+
+    boost::asio::awaitable<void> tickLoop();
+
+    void flush(std::chrono::steady_clock::time_point now);
+
+    void index(Subscription *subscription);
+
+    void unindex(Subscription *subscription);
+
+    std::size_t max_per_session_;
+    boost::asio::steady_timer timer_;
+
+    mutable std::mutex mutex_;
+    std::map<Key, std::unique_ptr<Subscription> > subscriptions_;
+    std::unordered_map<std::string, std::vector<Subscription *> > by_metric_;
+    std::vector<Subscription *> by_metric_pattern_;
+    std::atomic<std::size_t> count_{0};
+};
+
+#endif //SUBSCRIPTIONMANAGER_H
@@ -7,6 +7,8 @@
 #include <chrono>
 #include <nlohmann/json.hpp>
 
+#include "CounterSummary.h"
+
 struct TimeSeriesPoint {
     std::chrono::system_clock::time_point timestamp;
     double value;
@@ -32,4 +34,10 @@ inline void to_json(nlohmann::json &j, const TimeSeriesPoint &p) {
     };
 }
 
+// A report window summary, stored next to the series point carrying its mean.
+struct SummaryPoint {
+    std::chrono::system_clock::time_point timestamp;
+    CounterSummary summary;
+};
+
 #endif //TIMESERIESPOINT_H
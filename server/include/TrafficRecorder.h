@@ -0,0 +1,90 @@
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records inbound WebSocket messages into a capture file (see CaptureFormat.h) for the replay
+// tool. While idle the read path pays one relaxed load; while recording, each thread appends to
+// its own buffer under an uncontended lock, and a writer thread swaps the buffers out, merges
+// them by time and writes them to disk. If the disk falls behind, frames are dropped rather than
+// stalling the sessions; failed writes are counted.
+class TrafficRecorder {
+public:
+    struct Status {
+        bool recording = false;
+        std::string path;
+        std::uint64_t frames = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t write_errors = 0;
+    };
+
+    static constexpr std::size_t flush_threshold_bytes = 1 << 20;
+    static constexpr std::size_t max_buffered_bytes = 64 << 20; // per recording thread
+    static constexpr std::chrono::milliseconds flush_interval{100};
+
+    ~TrafficRecorder();
+
+    // Starts a new capture, ending any running one; returns false with error set if the file
+    // cannot be created.
+    bool start(const std::string &path, std::string &error);
+
+    void stop();
+
+    [[nodiscard]] bool isRecording() const {
+        return recording_.load(std::memory_order_relaxed);
+    }
+
+    void record(std::uint64_t session_id, const void *data, std::size_t size);
+
+    [[nodiscard]] Status getStatus() const;
+
+private:
+    // Records in the buffer carry their time since the capture start instead of a delta; the
+    // writer turns them into the file's delta encoding while merging.
+    struct alignas(64) ThreadBuffer {
+        std::mutex mutex;
+        std::string active;
+        std::uint64_t frames = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t dropped = 0;
+    };
+
+    ThreadBuffer &local();
+
+    // Ends the running capture; the caller holds control_mutex_.
+    void stopWriter();
+
+    // Swaps every thread buffer into pending, one string per buffer.
+    void takeBuffers(std::vector<std::string> &pending);
+
+    void writerLoop();
+
+    std::atomic<bool> recording_{false};
+    std::mutex control_mutex_; // serialises start/stop
+
+    mutable std::mutex buffers_mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers_;
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<bool> flush_requested_{false};
+    std::atomic<std::uint64_t> write_errors_{0};
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::string path_;
+
+    std::ofstream file_;
+    std::thread writer_;
+};
+
+#endif //TRAFFICRECORDER_H
@@ -4,24 +4,80 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/awaitable.hpp>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
-#include <list>
-#include <mutex>
+#include <vector>
 
 #include "Session.h"
+#include "AdmissionOptions.h"
+#include "CompressionOptions.h"
+#include "FlowControlOptions.h"
+#include "HttpHandler.h"
+#include "IngestQueue.h"
+#include "WriteQueueOptions.h"
+#include "SessionRegistry.h"
+#include "IoContextPool.h"
+#include "TrafficRecorder.h"
+
+struct WSServerOptions {
+    AdmissionOptions admission;
+    CompressionOptions compression;
+    FlowControlOptions flow_control;
+    WriteQueueOptions write_queue;
+    std::size_t ingest_workers = 2;
+};
+
 
+// Byte totals over every session the server has had, open or closed.
+struct TrafficTotals {
+    std::uint64_t payload_bytes_in = 0;
+    std::uint64_t payload_bytes_out = 0;
+    std::uint64_t wire_bytes_in = 0;
+    std::uint64_t wire_bytes_out = 0;
+};
 
 class WSServer {
 public:
-    WSServer(boost::asio::io_context &ioc, unsigned short port);
+    WSServer(IoContextPool &pool, unsigned short port, WSServerOptions options = {});
+
+    ~WSServer();
 
     void run();
 
-    void broadcast(const std::string &message);
+    void stop();
+
+    // is_json: the message is a JSON value, which sessions may gather with other queued frames.
+    void broadcast(const std::string &message, bool is_json);
+
+    std::vector<std::shared_ptr<Session> > getSessions();
+
+    [[nodiscard]] std::size_t getSessionCount() const;
+
+    const CompressionOptions &getCompressionOptions() const;
+
+    [[nodiscard]] std::size_t getIngestDepth() const;
+
+    const AdmissionOptions &getAdmissionOptions() const;
+
+    // Sockets currently held, handshaking sessions included.
+    [[nodiscard]] std::size_t getOpenConnectionCount() const;
+
+    // Connections refused at capacity, in total.
+    [[nodiscard]] std::uint64_t getRejectedConnectionCount() const;
+
+    // Refused sockets still being closed with 1013; not part of the open connection count.
+    [[nodiscard]] std::size_t getRejectingConnectionCount() const;
+
+    // Refused past --max-rejecting with a bare 503 instead.
+    [[nodiscard]] std::uint64_t getRefusedConnectionCount() const;
+
+    [[nodiscard]] TrafficTotals getTrafficTotals();
+
+    TrafficRecorder &getRecorder();
 
     void setOnConnectCallback(std::function<void(std::shared_ptr<Session>)> on_connect_callback);
 
@@ -29,24 +85,46 @@ public:
 
     void setOnMessageCallback(std::function<void(std::shared_ptr<Session>, const std::string &)> on_message_callback);
 
+    // Serves plain (non-upgrade) HTTP requests on the same port; without one they get a 404.
+    void setHttpHandler(HttpHandler http_handler);
+
 private:
     friend class Session;
 
-    void do_accept(boost::asio::yield_context yield);
+    boost::asio::awaitable<void> do_accept(boost::asio::ip::tcp::acceptor &acceptor);
+
+    boost::asio::any_io_executor make_session_executor(boost::asio::ip::tcp::acceptor &acceptor);
+
+    boost::asio::awaitable<void> do_reject(boost::asio::ip::tcp::socket socket);
 
     void join(std::shared_ptr<Session> session);
 
     void leave(std::shared_ptr<Session> session);
 
-    boost::asio::io_context &ioc_;
-    boost::asio::ip::tcp::acceptor acceptor_;
+    void retireTraffic(const CompressionStats &stats);
+
+    IoContextPool &pool_;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor> > acceptors_;
+    bool per_shard_acceptors_ = false;
+
+    WSServerOptions options_;
+    IngestQueue ingest_queue_;
+    TrafficRecorder recorder_;
 
-    std::list<std::shared_ptr<Session> > sessions_;
-    std::mutex sessions_mutex_;
+    SessionRegistry sessions_;
+    std::atomic<std::size_t> open_connections_{0};
+    std::atomic<std::uint64_t> rejected_connections_{0};
+    std::atomic<std::size_t> rejecting_connections_{0};
+    std::atomic<std::uint64_t> refused_connections_{0};
+    std::atomic<std::uint64_t> retired_payload_in_{0};
+    std::atomic<std::uint64_t> retired_payload_out_{0};
+    std::atomic<std::uint64_t> retired_wire_in_{0};
+    std::atomic<std::uint64_t> retired_wire_out_{0};
 
     std::function<void(std::shared_ptr<Session>)> on_connect_callback_;
     std::function<void(std::shared_ptr<Session>)> on_disconnect_callback_;
     std::function<void(std::shared_ptr<Session>, const std::string &)> on_message_callback_;
+    HttpHandler http_handler_;
 };
 
 #endif //WSSERVER_H
@@ -0,0 +1,43 @@
+#ifndef WRITEQUEUEOPTIONS_H
+#define WRITEQUEUEOPTIONS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#include "CommandLine.h"
+
+// Per-session outbound queue limits, so one stalled reader cannot grow server memory.
+struct WriteQueueOptions {
+    enum class OverflowPolicy {
+        DROP_OLDEST,     // discard the oldest queued frame
+        COALESCE_LATEST, // discard everything queued and keep only the newest frame
+        DISCONNECT       // close the slow session
+    };
+
+    std::size_t max_queued_frames = 64;
+    OverflowPolicy overflow_policy = OverflowPolicy::DROP_OLDEST;
+    // Up to this many queued frames are sent as one JSON array message in a single gathered
+    // write. 1 disables batching.
+    std::size_t max_gather = 16;
+
+    static WriteQueueOptions fromCommandLine(const CommandLine &cl) {
+        WriteQueueOptions options;
+        options.max_queued_frames = static_cast<std::size_t>(cl.getInt("write-queue-max",
+                                                                        static_cast<long long>(options.max_queued_frames)));
+        options.max_gather = static_cast<std::size_t>(cl.getInt("write-gather",
+                                                                 static_cast<long long>(options.max_gather)));
+        // An empty queue has nothing to drop on overflow.
+        options.max_queued_frames = std::max<std::size_t>(1, options.max_queued_frames);
+        options.max_gather = std::max<std::size_t>(1, options.max_gather);
+        const auto policy = cl.getString("write-overflow", "drop-oldest");
+        if (policy == "coalesce") {
+            options.overflow_policy = OverflowPolicy::COALESCE_LATEST;
+        } else if (policy == "disconnect") {
+            options.overflow_policy = OverflowPolicy::DISCONNECT;
+        }
+        return options;
+    }
+};
+
+#endif //WRITEQUEUEOPTIONS_H
@@ -0,0 +1,305 @@
+#include "HttpQueryApi.h"
+
+#include "Subscription.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <nlohmann/json.hpp>
+
+namespace http = boost::beast::http;
+
+namespace {
+    constexpr std::size_t points_per_chunk = 1024;
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    std::string url_decode(std::string_view in) {
+        std::string out;
+        out.reserve(in.size());
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            if (in[i] == '+') {
+                out.push_back(' ');
+            } else if (in[i] == '%' && i + 2 < in.size() && hex_value(in[i + 1]) >= 0 && hex_value(in[i + 2]) >= 0) {
+                out.push_back(static_cast<char>(hex_value(in[i + 1]) * 16 + hex_value(in[i + 2])));
+                i += 2;
+            } else {
+                out.push_back(in[i]);
+            }
+        }
+        return out;
+    }
+
+    std::map<std::string, std::string> parse_query(std::string_view query) {
+        std::map<std::string, std::string> params;
+        while (!query.empty()) {
+            const auto amp = query.find('&');
+            const auto pair = query.substr(0, amp);
+            const auto eq = pair.find('=');
+            if (eq == std::string_view::npos) {
+                params[url_decode(pair)] = "";
+            } else {
+                params[url_decode(pair.substr(0, eq))] = url_decode(pair.substr(eq + 1));
+            }
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+        }
+        return params;
+    }
+
+    std::chrono::system_clock::time_point param_time(const std::map<std::string, std::string> &params,
+                                                     const std::string &name,
+                                                     std::chrono::system_clock::time_point fallback) {
+        const auto it = params.find(name);
+        if (it == params.end()) {
+            return fallback;
+        }
+        long long ms = 0;
+        const auto result = std::from_chars(it->second.data(), it->second.data() + it->second.size(), ms);
+        if (result.ec != std::errc()) {
+            return fallback;
+        }
+        return std::chrono::system_clock::time_point(std::chrono::milliseconds(ms));
+    }
+
+    std::vector<std::string> matching_series(const MetricStore &store, const LabelSelector &selector) {
+        auto names = store.getSeriesNames();
+        names.erase(std::remove_if(names.begin(), names.end(),
+                                   [&selector](const std::string &name) { return !selector.matches(name); }),
+                    names.end());
+        return names;
+    }
+
+    void append_number(std::string &out, long long value) {
+        char buf[24];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+
+    void append_number(std::string &out, double value) {
+        // JSON has no NaN or infinity; nlohmann writes them as null as well.
+        if (!std::isfinite(value)) {
+            out += "null";
+            return;
+        }
+        char buf[32];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+
+    // Pulls one chunk at a time: the opening object, then up to points_per_chunk points of the
+    // current series per call, then the closing brackets.
+    struct QueryStream {
+        std::shared_ptr<MetricStore> store;
+        std::string client;
+        std::vector<std::string> names;
+        std::chrono::system_clock::time_point from;
+        std::chrono::system_clock::time_point to;
+
+        std::size_t series = 0;
+        std::size_t cursor = 0;
+        bool started = false;
+        bool series_open = false;
+        bool done = false;
+        std::vector<TimeSeriesPoint> points;
+
+        bool next(std::string &chunk) {
+            if (done) {
+                return false;
+            }
+            if (!started) {
+                started = true;
+                chunk = "{\"client\":" + nlohmann::json(client).dump() + ",\"series\":[";
+                return true;
+            }
+            if (series >= names.size()) {
+                done = true;
+                chunk = "]}";
+                return true;
+            }
+
+            if (!series_open) {
+                series_open = true;
+                cursor = 0;
+                if (series > 0) {
+                    chunk.push_back(',');
+                }
+                chunk += "{\"metric\":" + nlohmann::json(names[series]).dump() + ",\"points\":[";
+            }
+
+            const bool continuing = chunk.empty();
+            points.clear();
+            store->readRange(names[series], from, to, cursor, points_per_chunk, points);
+            for (std::size_t i = 0; i < points.size(); ++i) {
+                if (i > 0 || continuing) {
+                    chunk.push_back(',');
+                }
+                chunk.push_back('[');
+                append_number(chunk, static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    points[i].timestamp.time_since_epoch()).count()));
+                chunk.push_back(',');
+                append_number(chunk, points[i].value);
+                chunk.push_back(']');
+            }
+
+            if (points.size() < points_per_chunk) {
+                chunk += "]}";
+                series_open = false;
+                ++series;
+            }
+            return true;
+        }
+    };
+}
+
+HttpQueryApi::HttpQueryApi(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores,
+                           std::mutex &stores_mutex): client_stores_(client_stores), stores_mutex_(stores_mutex) {
+}
+
+HttpResponse HttpQueryApi::handle(const HttpRequest &request) const {
+    if (request.method() != http::verb::get) {
+        return HttpResponse::error(http::status::method_not_allowed, "only GET is supported");
+    }
+
+    const std::string_view target(request.target().data(), request.target().size());
+    const auto question = target.find('?');
+    const auto path = target.substr(0, question);
+    const auto params = parse_query(question == std::string_view::npos ? std::string_view() : target.substr(question + 1));
+
+    if (path == "/api/clients") {
+        return listClients();
+    }
+    if (path == "/api/series") {
+        return listSeries(params);
+    }
+    if (path == "/api/query") {
+        return query(params);
+    }
+    if (path == "/api/aggregate") {
+        return aggregate(params);
+    }
+    if (path == "/api/summaries") {
+        return summaries(params);
+    }
+    return HttpResponse::error(http::status::not_found, "not found");
+}
+
+HttpResponse HttpQueryApi::listClients() const {
+    nlohmann::json clients = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(stores_mutex_);
+        for (const auto &pair: client_stores_) {
+            clients.push_back(pair.first);
+        }
+    }
+    HttpResponse response;
+    response.body = clients.dump();
+    return response;
+}
+
+HttpResponse HttpQueryApi::listSeries(const Params &params) const {
+    const auto store = findStore(params);
+    if (!store) {
+        return HttpResponse::error(http::status::not_found, "unknown client");
+    }
+    HttpResponse response;
+    response.body = nlohmann::json(store->getSeriesNames()).dump();
+    return response;
+}
+
+HttpResponse HttpQueryApi::query(const Params &params) const {
+    const auto store = findStore(params);
+    if (!store) {
+        return HttpResponse::error(http::status::not_found, "unknown client");
+    }
+
+    const auto it = params.find("metric");
+    auto stream = std::make_shared<QueryStream>();
+    stream->store = store;
+    stream->client = params.at("client");
+    stream->names = matching_series(*store, LabelSelector{it == params.end() ? "*" : it->second});
+    stream->from = param_time(params, "from", std::chrono::system_clock::time_point::min());
+    stream->to = param_time(params, "to", std::chrono::system_clock::time_point::max());
+
+    HttpResponse response;
+    response.next_chunk = [stream](std::string &chunk) { return stream->next(chunk); };
+    return response;
+}
+
+HttpResponse HttpQueryApi::aggregate(const Params &params) const {
+    const auto store = findStore(params);
+    if (!store) {
+        return HttpResponse::error(http::status::not_found, "unknown client");
+    }
+
+    const auto it = params.find("metric");
+    const auto from = param_time(params, "from", std::chrono::system_clock::time_point::min());
+    const auto to = param_time(params, "to", std::chrono::system_clock::time_point::max());
+
+    nlohmann::json series = nlohmann::json::array();
+    for (const auto &name: matching_series(*store, LabelSelector{it == params.end() ? "*" : it->second})) {
+        MetricStore::SeriesSummary summary;
+        if (!store->summarize(name, from, to, summary) || summary.count == 0) {
+            continue;
+        }
+        series.push_back({
+            {"metric", name}, {"count", summary.count}, {"min", summary.min}, {"max", summary.max},
+            {"avg", summary.sum / static_cast<double>(summary.count)},
+            {"time_avg", summary.covered_seconds > 0.0 ? summary.time_weighted_sum / summary.covered_seconds
+                                                       : summary.last},
+            {"last", summary.last}
+        });
+    }
+
+    HttpResponse response;
+    response.body = nlohmann::json{{"client", params.at("client")}, {"series", series}}.dump();
+    return response;
+}
+
+HttpResponse HttpQueryApi::summaries(const Params &params) const {
+    const auto store = findStore(params);
+    if (!store) {
+        return HttpResponse::error(http::status::not_found, "unknown client");
+    }
+
+    const auto it = params.find("metric");
+    const auto from = param_time(params, "from", std::chrono::system_clock::time_point::min());
+    const auto to = param_time(params, "to", std::chrono::system_clock::time_point::max());
+
+    // Points are [time, count, min, max, mean, last, p50, p90, p99].
+    nlohmann::json series = nlohmann::json::array();
+    std::vector<SummaryPoint> points;
+    for (const auto &name: matching_series(*store, LabelSelector{it == params.end() ? "*" : it->second})) {
+        points.clear();
+        if (store->readSummaries(name, from, to, points) == 0) {
+            continue;
+        }
+        nlohmann::json rows = nlohmann::json::array();
+        for (const auto &point: points) {
+            const auto &s = point.summary;
+            rows.push_back({
+                std::chrono::duration_cast<std::chrono::milliseconds>(point.timestamp.time_since_epoch()).count(),
+                s.count, s.min, s.max, s.mean, s.last, s.p50, s.p90, s.p99
+            });
+        }
+        series.push_back({{"metric", name}, {"points", std::move(rows)}});
+    }
+
+    HttpResponse response;
+    response.body = nlohmann::json{{"client", params.at("client")}, {"series", series}}.dump();
+    return response;
+}
+
+std::shared_ptr<MetricStore> HttpQueryApi::findStore(const Params &params) const {
+    const auto client = params.find("client");
+    if (client == params.end()) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(stores_mutex_);
+    const auto it = client_stores_.find(client->second);
+    return it == client_stores_.end() ? nullptr : it->second;
+}
@@ -0,0 +1,77 @@
+#include "IngestQueue.h"
+
+#include <algorithm>
+
+IngestQueue::IngestQueue(std::size_t workers) {
+    workers = std::max<std::size_t>(1, workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        shards_.emplace_back(std::make_unique<Shard>());
+    }
+}
+
+IngestQueue::~IngestQueue() {
+    stop();
+}
+
+void IngestQueue::start(Handler handler) {
+    if (is_running_.exchange(true)) {
+        return;
+    }
+    handler_ = std::move(handler);
+    for (auto &shard: shards_) {
+        shard->worker = std::thread(&IngestQueue::workerLoop, this, std::ref(*shard));
+    }
+}
+
+void IngestQueue::stop() {
+    if (!is_running_.exchange(false)) {
+        return;
+    }
+    for (auto &shard: shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+        }
+        shard->cv.notify_all();
+        if (shard->worker.joinable()) {
+            shard->worker.join();
+        }
+    }
+}
+
+std::size_t IngestQueue::assignShard() {
+    return next_shard_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+}
+
+void IngestQueue::push(std::size_t shard, std::shared_ptr<Session> session, std::string message) {
+    auto &target = *shards_[shard % shards_.size()];
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.items.push_back({std::move(session), std::move(message)});
+    }
+    depth_.fetch_add(1, std::memory_order_relaxed);
+    target.cv.notify_one();
+}
+
+std::size_t IngestQueue::depth() const {
+    return depth_.load(std::memory_order_relaxed);
+}
+
+void IngestQueue::workerLoop(Shard &shard) {
+    std::deque<Item> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.cv.wait(lock, [&] { return !shard.items.empty() || !is_running_.load(); });
+            if (shard.items.empty() && !is_running_.load()) {
+                return;
+            }
+            batch.swap(shard.items);
+        }
+
+        for (auto &item: batch) {
+            handler_(item.session, item.message);
+            depth_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        batch.clear();
+    }
+}
@@ -0,0 +1,90 @@
+#include "IoContextPool.h"
+
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+IoContextPool::IoContextPool(IoContextPoolOptions options): options_(options) {
+    options_.threads = std::max(1, options_.threads);
+    if (options_.sharded) {
+        // A concurrency hint of 1 lets Asio drop its internal locking for each shard.
+        for (int i = 0; i < options_.threads; ++i) {
+            contexts_.emplace_back(std::make_unique<boost::asio::io_context>(1));
+        }
+    } else {
+        contexts_.emplace_back(std::make_unique<boost::asio::io_context>(options_.threads));
+    }
+    for (auto &ioc: contexts_) {
+        work_guards_.emplace_back(ioc->get_executor());
+    }
+}
+
+void IoContextPool::run() {
+    const auto hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < options_.threads; ++i) {
+        auto &ioc = options_.sharded ? *contexts_[i] : *contexts_.front();
+        threads_.emplace_back([this, &ioc, i, hardware_threads] {
+            if (options_.cpu_affinity) {
+                pinCurrentThread(static_cast<std::size_t>(i) % hardware_threads);
+            }
+            ioc.run();
+        });
+    }
+}
+
+void IoContextPool::stop() {
+    for (auto &guard: work_guards_) {
+        guard.reset();
+    }
+    for (auto &ioc: contexts_) {
+        ioc->stop();
+    }
+}
+
+void IoContextPool::join() {
+    for (auto &t: threads_) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    threads_.clear();
+}
+
+boost::asio::io_context &IoContextPool::getContext(std::size_t index) {
+    return *contexts_[index % contexts_.size()];
+}
+
+boost::asio::io_context &IoContextPool::getNextContext() {
+    return getContext(next_context_.fetch_add(1, std::memory_order_relaxed));
+}
+
+std::size_t IoContextPool::size() const {
+    return contexts_.size();
+}
+
+const IoContextPoolOptions &IoContextPool::getOptions() const {
+    return options_;
+}
+
+void IoContextPool::pinCurrentThread(std::size_t cpu) {
+#ifdef _WIN32
+    if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << (cpu % (sizeof(DWORD_PTR) * 8))) == 0) {
+        LOG_WARN("IoContextPool", "SetThreadAffinityMask failed for cpu ", cpu);
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_WARN("IoContextPool", "pthread_setaffinity_np failed for cpu ", cpu);
+    }
+#else
+    (void) cpu;
+    LOG_WARN("IoContextPool", "CPU affinity is not supported on this platform");
+#endif
+}
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <limits>
 #include <nlohmann/json.hpp>
 
 std::string format_ts_for_print(const std::chrono::system_clock::time_point& tp) {
@@ -17,28 +19,108 @@ std::string format_ts_for_print(const std::chrono::system_clock::time_point& tp)
     return ss.str();
 }
 
+namespace {
+    // Series stay sorted by timestamp: samples normally arrive in order, but a client draining
+    // its offline spool sends older ones after live ones. The spool is at-least-once (a batch is
+    // resent after an ack timeout or a reconnect), so a point at a timestamp the series already
+    // has replaces it instead of counting twice.
+    template<typename Point>
+    void insert_point(std::vector<Point>& points, const Point& point) {
+        if (points.empty() || points.back().timestamp < point.timestamp) {
+            points.push_back(point);
+            return;
+        }
+        const auto it = std::lower_bound(points.begin(), points.end(), point.timestamp,
+                                         [](const Point& p, const auto& t) { return p.timestamp < t; });
+        if (it != points.end() && it->timestamp == point.timestamp) {
+            *it = point;
+            return;
+        }
+        points.insert(it, point);
+    }
+}
+
+MetricStore::SeriesId MetricStore::resolveSeries(const std::string& name) {
+    auto it = series_index_.find(name);
+    if (it != series_index_.end()) {
+        return it->second;
+    }
+    const SeriesId id = series_.size();
+    series_.emplace_back();
+    summaries_.emplace_back();
+    series_versions_.push_back(0);
+    max_silence_.emplace_back(0);
+    series_index_.emplace(name, id);
+    return id;
+}
+
 void MetricStore::addData(const ClientData& data) {
     std::lock_guard<std::mutex> lock(mutex_);
 
     const auto& batch_timestamp = data.timestamp;
+    const auto version = version_.load(std::memory_order_relaxed) + 1;
 
     for (const auto& metric_dp : data.metrics) {
         TimeSeriesPoint new_point{batch_timestamp, metric_dp.value};
 
-        time_series_data_[metric_dp.name].push_back(new_point);
+        const auto id = resolveSeries(metric_dp.name);
+        insert_point(series_[id], new_point);
+        if (metric_dp.summary.count > 0) {
+            insert_point(summaries_[id], SummaryPoint{batch_timestamp, metric_dp.summary});
+        }
+        if (data.maxSilence.count() > 0) {
+            max_silence_[id] = data.maxSilence;
+        }
+        series_versions_[id] = version;
     }
+    version_.store(version, std::memory_order_release);
+}
+
+void MetricStore::addData(const ClientData& data, SeriesCache& series_cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto& batch_timestamp = data.timestamp;
+    const auto version = version_.load(std::memory_order_relaxed) + 1;
+
+    for (std::size_t i = 0; i < data.metrics.size(); ++i) {
+        const auto& metric_dp = data.metrics[i];
+
+        auto& by_position = series_cache.by_position_;
+        if (i >= by_position.size() || by_position[i].name != metric_dp.name) {
+            auto [it, inserted] = series_cache.by_name_.try_emplace(metric_dp.name, SeriesId{0});
+            if (inserted) {
+                it->second = resolveSeries(metric_dp.name);
+            }
+            if (i >= by_position.size()) {
+                by_position.push_back({metric_dp.name, it->second});
+            } else {
+                by_position[i] = {metric_dp.name, it->second};
+            }
+        }
+
+        const auto id = by_position[i].id;
+        insert_point(series_[id], TimeSeriesPoint{batch_timestamp, metric_dp.value});
+        if (metric_dp.summary.count > 0) {
+            insert_point(summaries_[id], SummaryPoint{batch_timestamp, metric_dp.summary});
+        }
+        if (data.maxSilence.count() > 0) {
+            max_silence_[id] = data.maxSilence;
+        }
+        series_versions_[id] = version;
+    }
+    version_.store(version, std::memory_order_release);
 }
 
 void MetricStore::print() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (time_series_data_.empty()) {
+    if (series_index_.empty()) {
         std::cout << "  (Store is empty)" << std::endl;
         return;
     }
 
-    for (const auto& pair : time_series_data_) {
+    for (const auto& pair : series_index_) {
         const auto& metric_name = pair.first;
-        const auto& points = pair.second;
+        const auto& points = series_[pair.second];
         std::cout << "  Metric: \"" << metric_name << "\" (" << points.size() << " points)" << std::endl;
         const size_t start_index = (points.size() > 5) ? points.size() - 5 : 0;
         for (size_t i = start_index; i < points.size(); ++i) {
@@ -52,8 +134,178 @@ nlohmann::json MetricStore::exportToJson() const {
     // Lock the mutex to ensure a thread-safe read of the data
     std::lock_guard<std::mutex> lock(mutex_);
 
-    // The magic happens here. Because we taught the library how to handle
-    // a TimeSeriesPoint, it automatically knows how to handle a
-    // std::vector<TimeSeriesPoint> and a std::map<std::string, ...>.
-    return nlohmann::json(time_series_data_);
-}
\ No newline at end of file
+    // TimeSeriesPoint has a to_json overload, so each series converts directly; the index
+    // map keeps the output ordered by metric name.
+    nlohmann::json j = nlohmann::json::object();
+    for (const auto& pair : series_index_) {
+        j[pair.first] = series_[pair.second];
+    }
+    return j;
+}
+
+std::vector<std::string> MetricStore::getSeriesNames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> names;
+    names.reserve(series_index_.size());
+    for (const auto& pair : series_index_) {
+        names.push_back(pair.first);
+    }
+    return names;
+}
+
+namespace {
+    template<typename Point>
+    std::size_t lower_bound_index(const std::vector<Point>& points, std::chrono::system_clock::time_point from) {
+        const auto it = std::lower_bound(points.begin(), points.end(), from,
+                                         [](const Point& p, const auto& t) { return p.timestamp < t; });
+        return static_cast<std::size_t>(it - points.begin());
+    }
+
+    // Index of the point whose value is in effect at from: the last one before from when no
+    // point sits exactly on it.
+    std::size_t step_start_index(const std::vector<TimeSeriesPoint>& points,
+                                 std::chrono::system_clock::time_point from) {
+        const auto index = lower_bound_index(points, from);
+        if (index > 0 && (index == points.size() || from < points[index].timestamp)) {
+            return index - 1;
+        }
+        return index;
+    }
+
+    // When the value of points[index] stops being in effect: at the next point, or max_silence
+    // after its own timestamp if that comes first.
+    std::chrono::system_clock::time_point held_until(const std::vector<TimeSeriesPoint>& points, std::size_t index,
+                                                     std::chrono::milliseconds max_silence) {
+        auto until = index + 1 < points.size() ? points[index + 1].timestamp
+                                               : std::chrono::system_clock::time_point::max();
+        if (max_silence.count() > 0) {
+            until = std::min(until, points[index].timestamp + max_silence);
+        }
+        return until;
+    }
+}
+
+std::size_t MetricStore::readRange(const std::string& name, std::chrono::system_clock::time_point from,
+                                   std::chrono::system_clock::time_point to, std::size_t& cursor,
+                                   std::size_t max_points, std::vector<TimeSeriesPoint>& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = series_index_.find(name);
+    if (it == series_index_.end()) {
+        return 0;
+    }
+
+    const auto& points = series_[it->second];
+    const auto max_silence = max_silence_[it->second];
+    const auto end = std::min(to, std::chrono::system_clock::now());
+    std::size_t appended = 0;
+    // Appends points[index] stamped at, then the gap if its value runs out before the next point.
+    const auto append = [&](std::size_t index, std::chrono::system_clock::time_point at) {
+        out.push_back({at, points[index].value});
+        ++appended;
+        const auto until = held_until(points, index, max_silence);
+        if (until < end && (index + 1 == points.size() || until < points[index + 1].timestamp)) {
+            out.push_back({until, std::numeric_limits<double>::quiet_NaN()});
+            ++appended;
+        }
+    };
+
+    if (cursor == 0) {
+        cursor = step_start_index(points, from);
+        if (cursor < points.size() && points[cursor].timestamp < from && from < to && max_points > 0) {
+            if (held_until(points, cursor, max_silence) > from) {
+                append(cursor, from);
+            }
+            ++cursor;
+        }
+    }
+
+    while (cursor < points.size() && appended < max_points && points[cursor].timestamp < to) {
+        append(cursor, points[cursor].timestamp);
+        ++cursor;
+    }
+    if (cursor < points.size() && points[cursor].timestamp >= to) {
+        cursor = points.size();
+    }
+    return appended;
+}
+
+std::uint64_t MetricStore::getVersion() const {
+    return version_.load(std::memory_order_acquire);
+}
+
+void MetricStore::visitChangedSince(
+    std::uint64_t version,
+    const std::function<void(SeriesId, const std::string&, const TimeSeriesPoint&)>& fn) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& pair : series_index_) {
+        const auto id = pair.second;
+        if (series_versions_[id] > version && !series_[id].empty()) {
+            fn(id, pair.first, series_[id].back());
+        }
+    }
+}
+
+bool MetricStore::summarize(const std::string& name, std::chrono::system_clock::time_point from,
+                            std::chrono::system_clock::time_point to, SeriesSummary& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = series_index_.find(name);
+    if (it == series_index_.end()) {
+        return false;
+    }
+
+    const auto& points = series_[it->second];
+    const auto max_silence = max_silence_[it->second];
+    out = SeriesSummary{};
+    const auto end = std::min(to, std::chrono::system_clock::now());
+    for (auto i = step_start_index(points, from); i < points.size() && points[i].timestamp < to; ++i) {
+        const auto until = std::min(held_until(points, i, max_silence), end);
+        // A value from before the range that ran out before from is not in it at all.
+        if (points[i].timestamp < from && until <= from) {
+            continue;
+        }
+        const double value = points[i].value;
+        if (out.count == 0) {
+            out.min = value;
+            out.max = value;
+        } else {
+            out.min = std::min(out.min, value);
+            out.max = std::max(out.max, value);
+        }
+        out.sum += value;
+        out.last = value;
+        ++out.count;
+
+        const auto held_from = std::max(points[i].timestamp, from);
+        if (held_from < until) {
+            const double seconds = std::chrono::duration<double>(until - held_from).count();
+            out.time_weighted_sum += value * seconds;
+            out.covered_seconds += seconds;
+        }
+    }
+
+    const auto& summaries = summaries_[it->second];
+    for (auto i = lower_bound_index(summaries, from); out.count > 0 && i < summaries.size() &&
+                                                      summaries[i].timestamp < to; ++i) {
+        out.min = std::min(out.min, summaries[i].summary.min);
+        out.max = std::max(out.max, summaries[i].summary.max);
+    }
+    return true;
+}
+
+std::size_t MetricStore::readSummaries(const std::string& name, std::chrono::system_clock::time_point from,
+                                       std::chrono::system_clock::time_point to,
+                                       std::vector<SummaryPoint>& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = series_index_.find(name);
+    if (it == series_index_.end()) {
+        return 0;
+    }
+
+    const auto& summaries = summaries_[it->second];
+    std::size_t appended = 0;
+    for (auto i = lower_bound_index(summaries, from); i < summaries.size() && summaries[i].timestamp < to; ++i) {
+        out.push_back(summaries[i]);
+        ++appended;
+    }
+    return appended;
+}
@@ -0,0 +1,138 @@
+#include "PrometheusExporter.h"
+
+#include <charconv>
+#include <cmath>
+
+namespace http = boost::beast::http;
+
+namespace {
+    void append_label_value(std::string &out, const std::string &value) {
+        for (const char c: value) {
+            switch (c) {
+                case '\\': out += "\\\\";
+                    break;
+                case '"': out += "\\\"";
+                    break;
+                case '\n': out += "\\n";
+                    break;
+                default: out.push_back(c);
+            }
+        }
+    }
+
+    void append_sample_value(std::string &out, double value) {
+        if (std::isnan(value)) {
+            out += "NaN";
+        } else if (std::isinf(value)) {
+            out += value > 0 ? "+Inf" : "-Inf";
+        } else {
+            char buf[32];
+            const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, result.ptr);
+        }
+    }
+
+    bool accepts_gzip(const HttpRequest &request) {
+        const auto it = request.find(http::field::accept_encoding);
+        return it != request.end() && it->value().find("gzip") != boost::beast::string_view::npos;
+    }
+}
+
+PrometheusExporter::PrometheusExporter(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores,
+                                       std::mutex &stores_mutex): client_stores_(client_stores),
+                                                                  stores_mutex_(stores_mutex) {
+    header_ = std::make_shared<const std::string>(
+        "# HELP perfmon_value Latest sample of each client performance counter.\n"
+        "# TYPE perfmon_value gauge\n");
+    header_gzip_ = std::make_shared<const std::string>(gzip_.encode(*header_));
+}
+
+HttpResponse PrometheusExporter::handle(const HttpRequest &request) {
+    if (request.method() != http::verb::get) {
+        return HttpResponse::error(http::status::method_not_allowed, "only GET is supported");
+    }
+
+    std::vector<std::pair<std::string, std::shared_ptr<MetricStore> > > stores;
+    {
+        std::lock_guard<std::mutex> lock(stores_mutex_);
+        stores.assign(client_stores_.begin(), client_stores_.end());
+    }
+
+    const bool gzip = accepts_gzip(request);
+
+    HttpResponse response;
+    response.content_type = "text/plain; version=0.0.4; charset=utf-8";
+    response.body_parts.reserve(stores.size() + 1);
+    response.body_parts.push_back(gzip ? header_gzip_ : header_);
+
+    std::lock_guard<std::mutex> lock(render_mutex_);
+    for (const auto &[client, store]: stores) {
+        auto &block = blocks_[client];
+        refresh(client, *store, block);
+        if (block.text->empty()) {
+            continue;
+        }
+        if (gzip) {
+            if (!block.gzip) {
+                block.gzip = std::make_shared<const std::string>(gzip_.encode(*block.text));
+            }
+            response.body_parts.push_back(block.gzip);
+        } else {
+            response.body_parts.push_back(block.text);
+        }
+    }
+
+    if (gzip) {
+        response.content_encoding = "gzip";
+    }
+    return response;
+}
+
+void PrometheusExporter::refresh(const std::string &client, const MetricStore &store, ClientBlock &block) {
+    if (block.store != &store) {
+        block = ClientBlock{};
+        block.store = &store;
+    }
+
+    const auto version = store.getVersion();
+    if (block.text && version == block.version) {
+        return;
+    }
+
+    std::string prefix = "perfmon_value{client=\"";
+    append_label_value(prefix, client);
+    prefix += "\",metric=\"";
+
+    store.visitChangedSince(block.version, [&](MetricStore::SeriesId id, const std::string &name,
+                                               const TimeSeriesPoint &latest) {
+        if (id >= block.lines.size()) {
+            block.lines.resize(id + 1);
+        }
+        auto &line = block.lines[id];
+        line = prefix;
+        append_label_value(line, name);
+        line += "\"} ";
+        append_sample_value(line, latest.value);
+        line.push_back(' ');
+        char buf[24];
+        const auto result = std::to_chars(buf, buf + sizeof(buf),
+                                          std::chrono::duration_cast<std::chrono::milliseconds>(
+                                              latest.timestamp.time_since_epoch()).count());
+        line.append(buf, result.ptr);
+        line.push_back('\n');
+    });
+
+    std::size_t total = 0;
+    for (const auto &line: block.lines) {
+        total += line.size();
+    }
+    auto text = std::make_shared<std::string>();
+    text->reserve(total);
+    for (const auto &line: block.lines) {
+        *text += line;
+    }
+
+    block.text = std::move(text);
+    block.gzip.reset();
+    block.version = version;
+}
@@ -1,6 +1,8 @@
 #include "ServerCLI.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 
 
@@ -49,9 +51,12 @@ bool is_key_pressed() {
     return _kbhit() != 0;
 }
 
-ServerCLI::ServerCLI(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores,
-                     std::atomic<bool> &shutdown_flag): client_stores_(client_stores),
-                                                        app_shutdown_flag_(shutdown_flag) {
+ServerCLI::ServerCLI(std::map<std::string, std::shared_ptr<MetricStore> > &client_stores, WSServer &server,
+                     ServerStats &stats, std::atomic<bool> &shutdown_flag): client_stores_(client_stores),
+                                                                            server_(server),
+                                                                            stats_(stats),
+                                                                            app_shutdown_flag_(shutdown_flag),
+                                                                            last_stats_(stats.snapshot()) {
 }
 
 ServerCLI::~ServerCLI() {
@@ -64,21 +69,30 @@ void ServerCLI::run() {
 }
 
 void ServerCLI::stop() {
-    if (!is_running_.load()) {
-        return;
-    }
     is_running_.store(false);
 
-    if (cli_thread_.joinable()) {
+    // `exit` clears is_running_ from the CLI thread itself, so the join must not depend on it.
+    if (cli_thread_.joinable() && cli_thread_.get_id() != std::this_thread::get_id()) {
         cli_thread_.join();
     }
 }
 
-void ServerCLI::postMessage(const std::string &message) {
-    std::lock_guard<std::mutex> lock(queue_mutex_);
-    realtime_queue_.push_back(message);
-    if (realtime_queue_.size() > 100) {
-        realtime_queue_.pop_front();
+bool ServerCLI::isRealtimeViewActive() const {
+    return current_view_.load(std::memory_order_relaxed) == View::REALTIME;
+}
+
+void ServerCLI::postDataReceived(const std::string &client_id, std::size_t metric_count) {
+    if (!isRealtimeViewActive()) {
+        return;
+    }
+
+    RealtimeEvent event{};
+    event.type = RealtimeEvent::Type::DATA_RECEIVED;
+    event.metric_count = static_cast<std::uint32_t>(metric_count);
+    client_id.copy(event.client_id, sizeof(event.client_id) - 1);
+
+    if (!realtime_ring_.tryPush(event)) {
+        realtime_dropped_.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
@@ -125,15 +139,26 @@ void ServerCLI::runRealtimeView() {
         return;
     }
 
-    std::list<std::string> messages_to_print; {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        if (!realtime_queue_.empty()) {
-            messages_to_print.swap(realtime_queue_);
+    drainRealtimeRing(true);
+}
+
+void ServerCLI::drainRealtimeRing(bool print) {
+    RealtimeEvent event{};
+    while (realtime_ring_.tryPop(event)) {
+        if (!print) {
+            continue;
+        }
+        switch (event.type) {
+            case RealtimeEvent::Type::DATA_RECEIVED:
+                std::cout << "[Real-time] Data received from " << event.client_id
+                        << " (" << event.metric_count << " metrics)" << std::endl;
+                break;
         }
     }
 
-    for (const auto &msg: messages_to_print) {
-        std::cout << msg << std::endl;
+    const auto dropped = realtime_dropped_.exchange(0, std::memory_order_relaxed);
+    if (print && dropped > 0) {
+        std::cout << "[Real-time] ... " << dropped << " events dropped (feed full)" << std::endl;
     }
 }
 
@@ -156,6 +181,12 @@ void ServerCLI::processCommand(const std::string &line) {
         handleShowClientData(args);
     } else if (command == "export") {
         handleExportClientData(args);
+    } else if (command == "sessions") {
+        handleListSessions();
+    } else if (command == "stats") {
+        handleStats();
+    } else if (command == "record") {
+        handleRecord(args);
     } else if (command == "view") {
         handleSwitchView(args);
     } else if (command == "exit" || command == "quit") {
@@ -176,6 +207,9 @@ void ServerCLI::printHelp() {
             << "  ls, list             - Lists all currently and previously connected client IDs.\n"
             << "  show <client_id>     - Displays a summary of all metrics for a specific client.\n"
             << "  export <client_id> <filename.json> - Exports all data for a client to a JSON file.\n"
+            << "  sessions             - Lists open WebSocket sessions with their compression ratio and cost.\n"
+            << "  stats                - Shows ingest rates, parse/store latency percentiles and queue depths.\n"
+            << "  record start <file> | stop - Records inbound messages to a capture file for the replay tool.\n"
             << "  view <mode>          - Switches the CLI view. Modes: 'command', 'realtime'.\n"
             << "  exit, quit           - Shuts down the server and the CLI.\n"
             << "-----------------------\n";
@@ -242,6 +276,113 @@ void ServerCLI::handleExportClientData(const std::vector<std::string> &args) con
     std::cout << "Successfully exported data for '" << client_id << "' to '" << filename << "'" << std::endl;
 }
 
+void ServerCLI::handleListSessions() const {
+    const auto &options = server_.getCompressionOptions();
+    std::cout << "permessage-deflate: " << (options.enabled ? "on" : "off")
+            << " (level " << options.level << ", window " << options.window_bits
+            << " bits, context takeover " << (options.context_takeover ? "on" : "off")
+            << ", min size " << options.min_message_size << " B)" << std::endl;
+    std::cout << "ingest queue depth: " << server_.getIngestDepth() << std::endl;
+    std::cout << "connections: " << server_.getOpenConnectionCount() << "/"
+            << server_.getAdmissionOptions().max_connections << ", rejected "
+            << server_.getRejectedConnectionCount() << " (" << server_.getRejectingConnectionCount()
+            << " closing, " << server_.getRefusedConnectionCount() << " refused with 503)" << std::endl;
+
+    const auto sessions = server_.getSessions();
+    if (sessions.empty()) {
+        std::cout << "  (No open sessions)" << std::endl;
+        return;
+    }
+    for (const auto &session: sessions) {
+        std::string endpoint = "(closing)";
+        try {
+            std::stringstream ss;
+            ss << session->get_remote_endpoint();
+            endpoint = ss.str();
+        } catch (const std::exception &) {
+        }
+        std::cout << "  - #" << std::hex << session->get_id() << std::dec << " " << endpoint << ": " << session->get_compression_stats().summary()
+                << ", dropped frames " << session->get_dropped_frames() << std::endl;
+    }
+}
+
+void ServerCLI::handleStats() {
+    const auto now = stats_.snapshot();
+    const double seconds = std::chrono::duration<double>(now.taken - last_stats_.taken).count();
+    const auto rate = [seconds](std::uint64_t current, std::uint64_t previous) {
+        return seconds > 0 ? static_cast<double>(current - previous) / seconds : 0.0;
+    };
+    const auto print_latency = [](const char *label, const LatencySummary &summary) {
+        std::cout << "  " << label << ": n=" << summary.count
+                << " p50=" << summary.p50 / 1000.0 << " us"
+                << " p90=" << summary.p90 / 1000.0 << " us"
+                << " p99=" << summary.p99 / 1000.0 << " us"
+                << " max=" << summary.max / 1000.0 << " us" << std::endl;
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "messages: " << now.messages << " (" << rate(now.messages, last_stats_.messages) << "/s)"
+            << ", samples: " << now.samples << " (" << rate(now.samples, last_stats_.samples) << "/s)"
+            << ", rejected: " << now.rejected
+            << ", bytes: " << now.bytes << " (" << rate(now.bytes, last_stats_.bytes) << "/s)"
+            << "  [rates over the last " << seconds << " s]" << std::endl;
+    std::cout << "latency since start:" << std::endl;
+    print_latency("parse", now.parse_ns);
+    print_latency("store", now.store_ns);
+
+    std::size_t write_queue_total = 0;
+    std::size_t write_queue_max = 0;
+    const auto sessions = server_.getSessions();
+    for (const auto &session: sessions) {
+        const auto depth = session->get_write_queue_depth();
+        write_queue_total += depth;
+        write_queue_max = std::max(write_queue_max, depth);
+    }
+    std::cout << "ingest queue depth: " << server_.getIngestDepth()
+            << ", sessions: " << sessions.size()
+            << ", write queue frames: " << write_queue_total << " (max " << write_queue_max << ")" << std::endl;
+
+    const auto traffic = server_.getTrafficTotals();
+    std::cout << "traffic in: " << traffic.payload_bytes_in << " B payload / " << traffic.wire_bytes_in
+            << " B wire, out: " << traffic.payload_bytes_out << " B payload / " << traffic.wire_bytes_out
+            << " B wire" << std::endl;
+    std::cout << std::defaultfloat;
+
+    last_stats_ = now;
+}
+
+void ServerCLI::handleRecord(const std::vector<std::string> &args) {
+    auto &recorder = server_.getRecorder();
+    if (args.size() == 2 && args[0] == "start") {
+        std::string error;
+        if (!recorder.start(args[1], error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return;
+        }
+        std::cout << "Recording inbound messages to " << args[1] << std::endl;
+        return;
+    }
+    if (args.size() == 1 && args[0] == "stop") {
+        if (!recorder.isRecording()) {
+            std::cerr << "Not recording." << std::endl;
+            return;
+        }
+        recorder.stop();
+    } else if (!args.empty()) {
+        std::cerr << "Usage: record [start <file> | stop]" << std::endl;
+        return;
+    }
+
+    const auto status = recorder.getStatus();
+    if (status.path.empty()) {
+        std::cout << "Not recording." << std::endl;
+        return;
+    }
+    std::cout << (status.recording ? "Recording to " : "Last capture: ") << status.path << " (" << status.frames
+            << " frames, " << status.bytes << " bytes, " << status.dropped << " dropped, " << status.write_errors
+            << " write errors)" << std::endl;
+}
+
 void ServerCLI::handleSwitchView(const std::vector<std::string>& args) {
     if (args.empty()) {
         std::cerr << "Usage: view <mode>. Available modes: 'command', 'realtime'" << std::endl;
@@ -249,6 +390,7 @@ void ServerCLI::handleSwitchView(const std::vector<std::string>& args) {
     }
     const auto& mode = args[0];
     if (mode == "realtime") {
+        drainRealtimeRing(false);
         current_view_ = View::REALTIME;
         std::cout << "\nSwitched to real-time view. New messages will appear below." << std::endl;
         std::cout << ">>> PRESS ANY KEY to return to command mode <<<" << std::endl;
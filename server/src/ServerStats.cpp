@@ -0,0 +1,40 @@
+#include "ServerStats.h"
+
+ServerStats::ThreadCounters &ServerStats::local() {
+    thread_local const ServerStats *owner = nullptr;
+    thread_local ThreadCounters *counters = nullptr;
+    if (owner != this) {
+        auto slot = std::make_unique<ThreadCounters>();
+        counters = slot.get();
+        owner = this;
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::move(slot));
+    }
+    return *counters;
+}
+
+ServerStats::Snapshot ServerStats::snapshot() const {
+    Snapshot snapshot;
+    snapshot.taken = std::chrono::steady_clock::now();
+
+    auto parse_counts = std::make_unique<LatencyHistogram::Counts>();
+    auto store_counts = std::make_unique<LatencyHistogram::Counts>();
+    parse_counts->fill(0);
+    store_counts->fill(0);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &counters: threads_) {
+            snapshot.messages += counters->messages.load(std::memory_order_relaxed);
+            snapshot.samples += counters->samples.load(std::memory_order_relaxed);
+            snapshot.rejected += counters->rejected.load(std::memory_order_relaxed);
+            snapshot.bytes += counters->bytes.load(std::memory_order_relaxed);
+            counters->parse_ns.addTo(*parse_counts);
+            counters->store_ns.addTo(*store_counts);
+        }
+    }
+
+    snapshot.parse_ns = LatencySummary::fromCounts(*parse_counts);
+    snapshot.store_ns = LatencySummary::fromCounts(*store_counts);
+    return snapshot;
+}
@@ -1,100 +1,492 @@
 #include "Session.h"
 
 #include "WSServer.h"
-#include <iostream>
+#include "BatchFrames.h"
+#include "FlowControl.h"
+#include "Logger.h"
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <vector>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
+namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
-void Session::send(const std::string &message) {
-    auto shared_msg = std::make_shared<const std::string>(message);
+namespace {
+    constexpr std::size_t max_http_body_bytes = 64 * 1024;
+    // Control frames are never dropped; a client that lets this many pile up is not reading.
+    constexpr std::size_t max_control_frames = 4096;
+}
+
+void Session::send(const std::string &message, const bool is_json) {
+    send(std::make_shared<const std::string>(message), is_json);
+}
 
+void Session::send(std::shared_ptr<const std::string> message, const bool is_json) {
     net::post(
         ws_.get_executor(),
-        [self = shared_from_this(), shared_msg]() {
-            self->write_queue_.push_back(shared_msg);
-
-            if (self->write_queue_.size() > 1) {
+        [self = shared_from_this(), message = std::move(message), is_json]() mutable {
+            if (self->write_stopped_) {
                 return;
             }
+            const auto &options = self->server_.options_.write_queue;
 
-            net::spawn(self->ws_.get_executor(), std::bind(&Session::do_write, self, std::placeholders::_1));
+            if (self->write_queue_.size() >= options.max_queued_frames) {
+                switch (options.overflow_policy) {
+                    case WriteQueueOptions::OverflowPolicy::DROP_OLDEST:
+                        self->write_queue_.pop_front();
+                        self->dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    case WriteQueueOptions::OverflowPolicy::COALESCE_LATEST:
+                        self->dropped_frames_.fetch_add(self->write_queue_.size(), std::memory_order_relaxed);
+                        self->write_queue_.clear();
+                        break;
+                    case WriteQueueOptions::OverflowPolicy::DISCONNECT: {
+                        LOG_WARN("Session", "Write queue full, disconnecting slow consumer");
+                        self->dropped_frames_.fetch_add(self->write_queue_.size() + 1, std::memory_order_relaxed);
+                        self->write_queue_.clear();
+                        beast::error_code ec;
+                        beast::get_lowest_layer(self->ws_).socket().shutdown(tcp::socket::shutdown_both, ec);
+                        beast::get_lowest_layer(self->ws_).socket().close(ec);
+                        return;
+                    }
+                }
+            }
+
+            self->write_queue_.push_back({std::move(message), is_json});
+            self->start_write();
+        });
+}
+
+void Session::send_control(std::string message) {
+    net::post(
+        ws_.get_executor(),
+        [self = shared_from_this(), message = std::move(message)]() mutable {
+            if (self->write_stopped_) {
+                return;
+            }
+            if (self->control_queue_.size() >= max_control_frames) {
+                LOG_WARN("Session", "Control frames not read, disconnecting");
+                beast::error_code ec;
+                beast::get_lowest_layer(self->ws_).socket().shutdown(tcp::socket::shutdown_both, ec);
+                beast::get_lowest_layer(self->ws_).socket().close(ec);
+                return;
+            }
+            self->control_queue_.push_back(std::move(message));
+            self->start_write();
         });
 }
 
+void Session::start_write() {
+    write_queue_depth_.store(write_queue_.size() + control_queue_.size(), std::memory_order_relaxed);
+    // Wakes the writer if it is idle; a busy writer sees the frame before it sleeps again.
+    write_signal_.cancel();
+}
+
+std::size_t Session::get_dropped_frames() const {
+    return dropped_frames_.load(std::memory_order_relaxed);
+}
+
+std::size_t Session::get_write_queue_depth() const {
+    return write_queue_depth_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Session::get_id() const {
+    return session_id_;
+}
+
 
-Session::Session(boost::asio::ip::tcp::socket &&socket, WSServer &server): ws_(std::move(socket)), server_(server) {
+Session::Session(boost::asio::ip::tcp::socket &&socket, WSServer &server): ws_(std::move(socket)),
+                                                                            write_signal_(ws_.get_executor()),
+                                                                            writer_done_(ws_.get_executor()),
+                                                                            server_(server),
+                                                                            ingest_shard_(
+                                                                                server.ingest_queue_.assignShard()) {
+    beast::get_lowest_layer(ws_).rate_policy().attach(&compression_stats_);
+    ws_.set_option(server_.options_.compression.toPermessageDeflate());
+    ws_.set_option(server_.options_.admission.toStreamTimeout());
+    ws_.read_message_max(server_.options_.admission.max_message_bytes);
 }
 
-void Session::run(net::yield_context yield) {
+Session::~Session() {
+    server_.retireTraffic(compression_stats_);
+    server_.open_connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+net::awaitable<void> Session::run() {
+    // The HTTP phase runs in its own frame, so its parser is gone before the WebSocket phase.
+    auto upgrade = co_await serve_http();
+    if (upgrade) {
+        co_await run_websocket(std::move(*upgrade));
+    }
+}
+
+net::awaitable<std::optional<HttpRequest> > Session::serve_http() {
     beast::error_code ec;
+    auto &stream = ws_.next_layer();
+    const auto &admission = server_.options_.admission;
+
+    // Every connection starts as HTTP. An upgrade request becomes a WebSocket session; anything
+    // else is answered in a keep-alive loop, and pipelined requests already sitting in buffer_
+    // are served in order.
+    for (bool first = true;; first = false) {
+        http::request_parser<http::string_body> parser;
+        parser.body_limit(max_http_body_bytes);
 
+        if (first) {
+            stream.expires_after(admission.handshake_timeout);
+        } else if (admission.idle_timeout.count() > 0) {
+            stream.expires_after(admission.idle_timeout);
+        } else {
+            stream.expires_never();
+        }
+
+        co_await http::async_read(stream, buffer_, parser, net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            if (ec != http::error::end_of_stream) {
+                LOG_DEBUG("Session", "HTTP read failed: ", ec.message());
+            }
+            break;
+        }
+
+        if (websocket::is_upgrade(parser.get())) {
+            // The WebSocket layer runs its own timers from here on.
+            stream.expires_never();
+            co_return parser.release();
+        }
+
+        const auto request = parser.release();
+        co_await write_http_response(request, ec);
+        if (ec) {
+            LOG_DEBUG("Session", "HTTP write failed: ", ec.message());
+            break;
+        }
+        if (!request.keep_alive()) {
+            break;
+        }
+    }
+
+    stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+    co_return std::nullopt;
+}
+
+net::awaitable<void> Session::run_websocket(HttpRequest upgrade) {
+    beast::error_code ec;
 
     try {
-        ws_.async_accept(yield[ec]);
+        const auto protocols = upgrade[http::field::sec_websocket_protocol];
+        batch_frames_ = BatchFrames::offered({protocols.data(), protocols.size()});
+        if (batch_frames_) {
+            ws_.set_option(websocket::stream_base::decorator([](websocket::response_type &res) {
+                res.set(http::field::sec_websocket_protocol, BatchFrames::subprotocol);
+            }));
+        }
+        co_await ws_.async_accept(upgrade, net::redirect_error(net::use_awaitable, ec));
         if (ec) {
-            std::cerr << "Handshake failed: " << ec.message() << std::endl;
-            return;
+            LOG_WARN("Session", "Handshake failed: ", ec.message());
+            co_return;
         }
+        // Both live as long as the session; an idle connection should not keep the upgrade
+        // request's headers or the HTTP read buffer around.
+        upgrade = {};
+        buffer_.shrink_to_fit();
 
         server_.join(shared_from_this());
+        writer_running_ = true;
+        net::co_spawn(ws_.get_executor(), [self = shared_from_this()] { return self->do_write(); }, net::detached);
+        grant_credits();
 
-        do_read(yield);
+        co_await do_read();
     } catch (const std::exception &e) {
-        std::cerr << "Session error: " << e.what() << std::endl;
+        LOG_ERROR("Session", "Session error: ", e.what());
     }
 
     server_.leave(shared_from_this());
+    // The close frame is a write too; it must not overlap one of the writer's.
+    co_await stop_writer();
 
-    ws_.async_close(websocket::close_code::normal, yield[ec]);
+    co_await ws_.async_close(websocket::close_code::normal, net::redirect_error(net::use_awaitable, ec));
     if (ec) {
-        std::cerr << "Close failed: " << ec.message() << std::endl;
+        LOG_DEBUG("Session", "Close failed: ", ec.message());
     }
 }
 
-void Session::do_read(boost::asio::yield_context yield) {
+net::awaitable<void> Session::write_http_response(const HttpRequest &request, beast::error_code &ec) {
+    auto &stream = ws_.next_layer();
+    // Each write gets the handshake timeout, so a stalled reader cannot pin a streaming response.
+    const auto write_timeout = server_.options_.admission.handshake_timeout;
+    auto response = server_.http_handler_
+                        ? server_.http_handler_(request)
+                        : HttpResponse::error(http::status::not_found, "not found");
+
+    if (!response.body_parts.empty()) {
+        std::vector<net::const_buffer> buffers;
+        buffers.reserve(response.body_parts.size());
+        std::size_t length = 0;
+        for (const auto &part: response.body_parts) {
+            buffers.emplace_back(net::buffer(*part));
+            length += part->size();
+        }
+
+        http::response<http::empty_body> res{response.status, request.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, response.content_type);
+        if (!response.content_encoding.empty()) {
+            res.set(http::field::content_encoding, response.content_encoding);
+            res.set(http::field::vary, "Accept-Encoding");
+        }
+        res.keep_alive(request.keep_alive());
+        res.content_length(length);
+
+        http::response_serializer<http::empty_body> serializer{res};
+        stream.expires_after(write_timeout);
+        co_await http::async_write_header(stream, serializer, net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+        stream.expires_after(write_timeout);
+        co_await net::async_write(stream, buffers, net::redirect_error(net::use_awaitable, ec));
+        co_return;
+    }
+
+    // HTTP/1.0 has no chunked encoding, so the chunks are gathered into one body with a length.
+    if (response.next_chunk && request.version() < 11) {
+        std::string chunk;
+        while (response.next_chunk(chunk)) {
+            response.body += chunk;
+            chunk.clear();
+        }
+        response.next_chunk = nullptr;
+    }
+
+    if (!response.next_chunk) {
+        http::response<http::string_body> res{response.status, request.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, response.content_type);
+        res.keep_alive(request.keep_alive());
+        res.body() = std::move(response.body);
+        res.prepare_payload();
+        stream.expires_after(write_timeout);
+        co_await http::async_write(stream, res, net::redirect_error(net::use_awaitable, ec));
+        co_return;
+    }
+
+    http::response<http::empty_body> res{response.status, request.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, response.content_type);
+    res.keep_alive(request.keep_alive());
+    res.chunked(true);
+
+    http::response_serializer<http::empty_body> serializer{res};
+    stream.expires_after(write_timeout);
+    co_await http::async_write_header(stream, serializer, net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+        co_return;
+    }
+
+    // Chunks are produced one at a time, so a large query never sits in memory whole.
+    std::string chunk;
+    while (response.next_chunk(chunk)) {
+        if (!chunk.empty()) {
+            stream.expires_after(write_timeout);
+            co_await net::async_write(stream, http::make_chunk(net::buffer(chunk)),
+                                      net::redirect_error(net::use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+        }
+        chunk.clear();
+    }
+    stream.expires_after(write_timeout);
+    co_await net::async_write(stream, http::make_chunk_last(), net::redirect_error(net::use_awaitable, ec));
+}
+
+net::awaitable<void> Session::do_read() {
     beast::error_code ec;
 
     for (;;) {
-        ws_.async_read(buffer_, yield[ec]);
+        co_await wait_for_ingest_capacity();
+
+        co_await ws_.async_read(buffer_, net::redirect_error(net::use_awaitable, ec));
 
         if (ec == websocket::error::closed) {
             break;
         }
 
         if (ec) {
-            std::cerr << "Read failed: " << ec.message() << std::endl;
+            LOG_WARN("Session", "Read failed: ", ec.message());
             break;
         }
 
+        compression_stats_.recordRead(buffer_.size());
+        if (server_.recorder_.isRecording()) {
+            server_.recorder_.record(session_id_, buffer_.cdata().data(), buffer_.size());
+        }
+
         if (server_.on_message_callback_) {
-            auto message = beast::buffers_to_string(buffer_.data());
-            server_.on_message_callback_(shared_from_this(), message);
+            server_.ingest_queue_.push(ingest_shard_, shared_from_this(), beast::buffers_to_string(buffer_.data()));
         }
 
         buffer_.consume(buffer_.size());
+        consume_credit();
     }
 }
 
-void Session::do_write(boost::asio::yield_context yield) {
+net::awaitable<void> Session::wait_for_ingest_capacity() {
+    const auto &flow = server_.options_.flow_control;
+    if (!flow.enabled || server_.ingest_queue_.depth() < flow.high_watermark) {
+        co_return;
+    }
+
+    // Stop reading until the ingest workers catch up; TCP backpressure does the rest.
     beast::error_code ec;
+    net::steady_timer timer(ws_.get_executor());
+    while (server_.ingest_queue_.depth() >= flow.high_watermark) {
+        timer.expires_after(std::chrono::milliseconds(10));
+        co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+    }
+}
+
+void Session::grant_credits() {
+    const auto &flow = server_.options_.flow_control;
+    if (!flow.enabled) {
+        return;
+    }
+
+    const auto depth = server_.ingest_queue_.depth();
+    int throttle = 0;
+    if (depth >= flow.high_watermark) {
+        throttle = 2;
+    } else if (depth >= flow.low_watermark) {
+        throttle = 1;
+    }
+
+    // Each throttle level shrinks the window by 4x, but always leave the client one credit so
+    // its next frame brings another grant.
+    credits_ = std::max(1, flow.window >> (2 * throttle));
+    granted_credits_ = credits_;
+    send_control(FlowControlMessage{credits_, throttle}.toJson());
+}
+
+void Session::consume_credit() {
+    const auto &flow = server_.options_.flow_control;
+    if (!flow.enabled) {
+        return;
+    }
 
-    // While there are messages in the queue...
-    while (!write_queue_.empty()) {
-        ws_.text(true);
-        ws_.async_write(net::buffer(*write_queue_.front()), yield[ec]);
+    --credits_;
+    if (credits_ <= granted_credits_ / 2) {
+        grant_credits();
+    }
+}
 
+net::awaitable<void> Session::do_write() {
+    beast::error_code ec;
+    while (!write_stopped_) {
+        if (control_queue_.empty() && write_queue_.empty()) {
+            // An idle session keeps no queue storage; the next burst allocates it again.
+            write_queue_.shrink_to_fit();
+            control_queue_.shrink_to_fit();
+            write_signal_.expires_at(net::steady_timer::time_point::max());
+            co_await write_signal_.async_wait(net::redirect_error(net::use_awaitable, ec));
+            continue;
+        }
+        co_await write_next(ec);
         if (ec) {
-            std::cerr << "Write failed: " << ec.message() << std::endl;
-            write_queue_.clear();
-            return;
+            LOG_WARN("Session", "Write failed: ", ec.message());
+            write_stopped_ = true;
         }
+    }
 
-        write_queue_.pop_front();}
+    write_queue_.clear();
+    control_queue_.clear();
+    write_queue_depth_.store(0, std::memory_order_relaxed);
+    writer_running_ = false;
+    writer_done_.cancel();
+}
+
+net::awaitable<void> Session::write_next(beast::error_code &ec) {
+    const auto max_gather = server_.options_.write_queue.max_gather;
+    std::vector<std::shared_ptr<const std::string> > batch;
+    std::vector<net::const_buffer> buffers;
+    std::string control;
+
+    if (!control_queue_.empty()) {
+        control = std::move(control_queue_.front());
+        control_queue_.pop_front();
+        buffers.emplace_back(net::buffer(control));
+    } else {
+        // Take frames off the queue before writing so overflow handling never touches
+        // payloads whose buffers are in flight. Only a run of JSON frames is gathered, and only
+        // for clients that can split it again.
+        batch.push_back(std::move(write_queue_.front().payload));
+        const bool gather = batch_frames_ && write_queue_.front().is_json;
+        write_queue_.pop_front();
+        while (gather && batch.size() < max_gather && !write_queue_.empty() && write_queue_.front().is_json) {
+            batch.push_back(std::move(write_queue_.front().payload));
+            write_queue_.pop_front();
+        }
+
+        // Several frames go out as one JSON array message, gathered straight from the shared
+        // payloads without copying them into a new string.
+        if (batch.size() == 1) {
+            buffers.emplace_back(net::buffer(*batch.front()));
+        } else {
+            buffers.emplace_back(net::buffer("[", 1));
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                if (i > 0) {
+                    buffers.emplace_back(net::buffer(",", 1));
+                }
+                buffers.emplace_back(net::buffer(*batch[i]));
+            }
+            buffers.emplace_back(net::buffer("]", 1));
+        }
+    }
+    write_queue_depth_.store(write_queue_.size() + control_queue_.size(), std::memory_order_relaxed);
+
+    ws_.text(true);
+    co_await ws_.async_write(buffers, net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+        co_return;
+    }
+
+    if (batch.empty()) {
+        compression_stats_.recordWrite(control, server_.options_.compression);
+    }
+    for (const auto &payload: batch) {
+        compression_stats_.recordWrite(*payload, server_.options_.compression);
+    }
+}
+
+net::awaitable<void> Session::stop_writer() {
+    write_stopped_ = true;
+    write_signal_.cancel();
+    beast::error_code ec;
+    while (writer_running_) {
+        writer_done_.expires_at(net::steady_timer::time_point::max());
+        co_await writer_done_.async_wait(net::redirect_error(net::use_awaitable, ec));
+    }
 }
 
 boost::asio::ip::tcp::endpoint Session::get_remote_endpoint() const {
-    return beast::get_lowest_layer(ws_).socket().remote_endpoint();
+    // Unspecified instead of throwing once the socket is closed.
+    beast::error_code ec;
+    return beast::get_lowest_layer(ws_).socket().remote_endpoint(ec);
+}
+
+const CompressionStats &Session::get_compression_stats() const {
+    return compression_stats_;
+}
+
+Session::StoreBinding &Session::get_store_binding() {
+    return store_binding_;
 }
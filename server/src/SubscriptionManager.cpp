@@ -0,0 +1,218 @@
+#include "SubscriptionManager.h"
+
+#include "Session.h"
+#include "Logger.h"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+
+namespace net = boost::asio;
+
+namespace {
+    constexpr auto tick_interval = std::chrono::milliseconds(50);
+    constexpr int min_interval_ms = 100;
+
+    std::string make_error(const std::string &id, const std::string &message) {
+        return nlohmann::json{{"type", "error"}, {"id", id}, {"message", message}}.dump();
+    }
+}
+
+SubscriptionManager::SubscriptionManager(boost::asio::io_context &ioc, std::size_t max_per_session)
+    : max_per_session_(max_per_session),
+      timer_(ioc) {
+}
+
+void SubscriptionManager::start() {
+    net::co_spawn(timer_.get_executor(), tickLoop(), net::detached);
+}
+
+void SubscriptionManager::handle(const std::shared_ptr<Session> &session, const SubscriptionRequest &request) {
+    if (request.id.empty()) {
+        session->send_control(make_error(request.id, "missing subscription id"));
+        return;
+    }
+
+    const Key key{session->get_id(), request.id};
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (request.action == SubscriptionRequest::Action::UNSUBSCRIBE) {
+        const auto it = subscriptions_.find(key);
+        if (it != subscriptions_.end()) {
+            unindex(it->second.get());
+            subscriptions_.erase(it);
+            count_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    auto it = subscriptions_.find(key);
+    if (it == subscriptions_.end()) {
+        const auto first = subscriptions_.lower_bound({key.first, std::string()});
+        std::size_t owned = 0;
+        for (auto owned_it = first; owned_it != subscriptions_.end() && owned_it->first.first == key.first;
+             ++owned_it) {
+            ++owned;
+        }
+        if (owned >= max_per_session_) {
+            lock.unlock();
+            session->send_control(make_error(request.id, "too many subscriptions"));
+            return;
+        }
+        it = subscriptions_.emplace(key, std::make_unique<Subscription>()).first;
+        count_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // Re-subscribing with the same id replaces the selectors.
+        unindex(it->second.get());
+    }
+
+    auto &subscription = *it->second;
+    subscription.session = session;
+    subscription.id = request.id;
+    subscription.client = request.client;
+    subscription.metric = request.metric;
+    subscription.interval = std::chrono::milliseconds(std::max(min_interval_ms, request.interval_ms));
+    subscription.next_due = std::chrono::steady_clock::now();
+    subscription.pending.clear();
+    index(&subscription);
+    lock.unlock();
+
+    LOG_DEBUG("Subscriptions", "Session #", LogHex{key.first}, " subscribed '", request.id, "' client=",
+              request.client.pattern, " metric=", request.metric.pattern);
+}
+
+void SubscriptionManager::removeSession(std::uint64_t session_id) {
+    if (count_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = subscriptions_.lower_bound({session_id, std::string()});
+    while (it != subscriptions_.end() && it->first.first == session_id) {
+        unindex(it->second.get());
+        it = subscriptions_.erase(it);
+        count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void SubscriptionManager::publish(const ClientData &data) {
+    // Nobody is watching most of the time; keep the ingest path free of the lock then.
+    if (count_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    const auto t_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        data.timestamp.time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto offer = [&](Subscription *subscription, const MetricDataPoint &metric) {
+        if (subscription->client.matches(data.clientId)) {
+            subscription->pending[{data.clientId, metric.name}] = Point{t_ms, metric.value};
+        }
+    };
+
+    for (const auto &metric: data.metrics) {
+        const auto it = by_metric_.find(metric.name);
+        if (it != by_metric_.end()) {
+            for (auto *subscription: it->second) {
+                offer(subscription, metric);
+            }
+        }
+        for (auto *subscription: by_metric_pattern_) {
+            if (subscription->metric.matches(metric.name)) {
+                offer(subscription, metric);
+            }
+        }
+    }
+}
+
+std::size_t SubscriptionManager::size() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+net::awaitable<void> SubscriptionManager::tickLoop() {
+    boost::system::error_code ec;
+    for (;;) {
+        timer_.expires_after(tick_interval);
+        co_await timer_.async_wait(net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+        flush(std::chrono::steady_clock::now());
+    }
+}
+
+void SubscriptionManager::flush(std::chrono::steady_clock::time_point now) {
+    if (count_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    std::vector<std::pair<std::shared_ptr<Session>, std::string> > frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = subscriptions_.begin(); it != subscriptions_.end();) {
+            auto &subscription = it->second;
+            // A subscribe handled after removeSession() ran for its session is only found here.
+            if (subscription->session.expired()) {
+                unindex(subscription.get());
+                it = subscriptions_.erase(it);
+                count_.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+            ++it;
+            if (subscription->pending.empty() || now < subscription->next_due) {
+                continue;
+            }
+            auto session = subscription->session.lock();
+            if (!session) {
+                continue;
+            }
+
+            nlohmann::json series = nlohmann::json::array();
+            for (const auto &[labels, point]: subscription->pending) {
+                series.push_back({
+                    {"client", labels.first}, {"metric", labels.second}, {"t", point.t_ms}, {"value", point.value}
+                });
+            }
+            subscription->pending.clear();
+            subscription->next_due = now + subscription->interval;
+
+            frames.emplace_back(std::move(session),
+                                nlohmann::json{{"type", "update"}, {"id", subscription->id}, {"series", series}}.
+                                dump());
+        }
+    }
+
+    // Session::send only posts to the session's executor, but keep it outside the lock anyway.
+    for (auto &[session, frame]: frames) {
+        session->send(frame, true);
+    }
+}
+
+void SubscriptionManager::index(Subscription *subscription) {
+    if (subscription->metric.isExact()) {
+        by_metric_[subscription->metric.pattern].push_back(subscription);
+    } else {
+        by_metric_pattern_.push_back(subscription);
+    }
+}
+
+void SubscriptionManager::unindex(Subscription *subscription) {
+    const auto erase_from = [subscription](std::vector<Subscription *> &list) {
+        list.erase(std::remove(list.begin(), list.end(), subscription), list.end());
+    };
+
+    if (subscription->metric.isExact()) {
+        const auto it = by_metric_.find(subscription->metric.pattern);
+        if (it != by_metric_.end()) {
+            erase_from(it->second);
+            if (it->second.empty()) {
+                by_metric_.erase(it);
+            }
+        }
+    } else {
+        erase_from(by_metric_pattern_);
+    }
+}
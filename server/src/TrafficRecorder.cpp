@@ -0,0 +1,259 @@
+#include "TrafficRecorder.h"
+
+#include <algorithm>
+#include <string_view>
+
+#include "CaptureFormat.h"
+#include "Logger.h"
+
+namespace {
+    // Position in one swapped-out thread buffer, holding its next record.
+    struct Cursor {
+        std::string_view rest;
+        std::uint64_t time_ns = 0;
+        std::uint64_t session_id = 0;
+        std::string_view payload;
+    };
+
+    bool read_varint(std::string_view &in, std::uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+            const auto c = static_cast<unsigned char>(in.front());
+            in.remove_prefix(1);
+            value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool advance(Cursor &cursor) {
+        std::uint64_t length;
+        if (!read_varint(cursor.rest, cursor.time_ns) || !read_varint(cursor.rest, cursor.session_id) ||
+            !read_varint(cursor.rest, length) || length > cursor.rest.size()) {
+            return false;
+        }
+        cursor.payload = cursor.rest.substr(0, static_cast<std::size_t>(length));
+        cursor.rest.remove_prefix(static_cast<std::size_t>(length));
+        return true;
+    }
+
+    // Merges the thread buffers into out in time order, as deltas from last_ns. Each buffer is in
+    // time order already; a record swapped out after a later one from another thread is written
+    // with a zero delta.
+    void merge(const std::vector<std::string> &pending, std::vector<Cursor> &cursors, std::uint64_t &last_ns,
+               std::string &out) {
+        cursors.clear();
+        for (const auto &buffer: pending) {
+            Cursor cursor;
+            cursor.rest = buffer;
+            if (advance(cursor)) {
+                cursors.push_back(cursor);
+            }
+        }
+        while (!cursors.empty()) {
+            std::size_t first = 0;
+            for (std::size_t i = 1; i < cursors.size(); ++i) {
+                if (cursors[i].time_ns < cursors[first].time_ns) {
+                    first = i;
+                }
+            }
+            auto &cursor = cursors[first];
+            const auto time_ns = std::max(cursor.time_ns, last_ns);
+            CaptureFormat::appendVarint(out, time_ns - last_ns);
+            CaptureFormat::appendVarint(out, cursor.session_id);
+            CaptureFormat::appendVarint(out, cursor.payload.size());
+            out.append(cursor.payload);
+            last_ns = time_ns;
+            if (!advance(cursor)) {
+                cursors.erase(cursors.begin() + static_cast<std::ptrdiff_t>(first));
+            }
+        }
+    }
+}
+
+TrafficRecorder::~TrafficRecorder() {
+    stop();
+}
+
+bool TrafficRecorder::start(const std::string &path, std::string &error) {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (writer_.joinable()) {
+        stopWriter();
+    }
+
+    file_.clear();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        error = "could not open " + path + " for writing";
+        return false;
+    }
+    const auto start_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    file_ << CaptureFormat::header(static_cast<std::uint64_t>(start_unix_ns));
+
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        for (const auto &buffer: buffers_) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffer->active.clear();
+            buffer->frames = 0;
+            buffer->bytes = 0;
+            buffer->dropped = 0;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+        path_ = path;
+    }
+    write_errors_.store(0, std::memory_order_relaxed);
+    flush_requested_.store(false, std::memory_order_relaxed);
+    start_ = std::chrono::steady_clock::now();
+    recording_.store(true, std::memory_order_release);
+    writer_ = std::thread(&TrafficRecorder::writerLoop, this);
+    LOG_INFO("Recorder", "Recording inbound traffic to ", path);
+    return true;
+}
+
+void TrafficRecorder::stop() {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (!writer_.joinable()) {
+        return;
+    }
+    stopWriter();
+    const auto status = getStatus();
+    LOG_INFO("Recorder", "Recording stopped: ", status.frames, " frames, ", status.bytes, " bytes, ",
+             status.dropped, " dropped, ", status.write_errors, " write errors");
+}
+
+void TrafficRecorder::stopWriter() {
+    recording_.store(false, std::memory_order_relaxed);
+    {
+        // Waits out any record that saw recording_ still set, so the final swap holds every frame.
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        for (const auto &buffer: buffers_) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    file_.close();
+}
+
+TrafficRecorder::ThreadBuffer &TrafficRecorder::local() {
+    thread_local const TrafficRecorder *owner = nullptr;
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (owner != this) {
+        auto slot = std::make_unique<ThreadBuffer>();
+        buffer = slot.get();
+        owner = this;
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        buffers_.push_back(std::move(slot));
+    }
+    return *buffer;
+}
+
+void TrafficRecorder::record(std::uint64_t session_id, const void *data, std::size_t size) {
+    auto &buffer = local();
+    std::unique_lock<std::mutex> lock(buffer.mutex);
+    if (!recording_.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (buffer.active.size() + size > max_buffered_bytes) {
+        ++buffer.dropped;
+        return;
+    }
+
+    const auto now_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count());
+    CaptureFormat::appendVarint(buffer.active, now_ns);
+    CaptureFormat::appendVarint(buffer.active, session_id);
+    CaptureFormat::appendVarint(buffer.active, size);
+    buffer.active.append(static_cast<const char *>(data), size);
+    ++buffer.frames;
+    buffer.bytes += size;
+
+    const bool flush = buffer.active.size() >= flush_threshold_bytes;
+    lock.unlock();
+    if (flush && !flush_requested_.exchange(true, std::memory_order_relaxed)) {
+        wake_.notify_one();
+    }
+}
+
+TrafficRecorder::Status TrafficRecorder::getStatus() const {
+    Status status;
+    status.recording = recording_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        status.path = path_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        for (const auto &buffer: buffers_) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            status.frames += buffer->frames;
+            status.bytes += buffer->bytes;
+            status.dropped += buffer->dropped;
+        }
+    }
+    status.write_errors = write_errors_.load(std::memory_order_relaxed);
+    return status;
+}
+
+void TrafficRecorder::takeBuffers(std::vector<std::string> &pending) {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    pending.resize(buffers_.size());
+    for (std::size_t i = 0; i < buffers_.size(); ++i) {
+        // The thread keeps appending into the string the writer just emptied.
+        std::lock_guard<std::mutex> buffer_lock(buffers_[i]->mutex);
+        pending[i].swap(buffers_[i]->active);
+    }
+}
+
+void TrafficRecorder::writerLoop() {
+    std::vector<std::string> pending;
+    std::vector<Cursor> cursors;
+    std::string out;
+    out.reserve(flush_threshold_bytes);
+    std::uint64_t last_ns = 0;
+
+    for (;;) {
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, flush_interval, [this]() {
+                return stopping_ || flush_requested_.load(std::memory_order_relaxed);
+            });
+            flush_requested_.store(false, std::memory_order_relaxed);
+            done = stopping_;
+        }
+
+        takeBuffers(pending);
+        merge(pending, cursors, last_ns, out);
+        for (auto &buffer: pending) {
+            buffer.clear();
+        }
+        if (!out.empty()) {
+            file_.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+        if (done) {
+            file_.flush();
+        }
+        if (!file_) {
+            if (write_errors_.fetch_add(1, std::memory_order_relaxed) == 0) {
+                LOG_WARN("Recorder", "Writing ", path_, " failed, the capture is incomplete");
+            }
+            file_.clear();
+        }
+        if (done) {
+            return;
+        }
+    }
+}
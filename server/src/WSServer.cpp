@@ -1,32 +1,166 @@
 #include "WSServer.h"
 
-#include <iostream>
+#include "Logger.h"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <string_view>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
-WSServer::WSServer(boost::asio::io_context &ioc, unsigned short port): ioc_(ioc),
-                                                                       acceptor_(ioc, {tcp::v4(), port}) {
+namespace {
+    // A refused client only needs to learn that it should back off; don't let it hold the socket.
+    constexpr auto reject_timeout = std::chrono::seconds(2);
+
+    // Past the reject bound: no handshake and no coroutine, just a 503 written straight into the
+    // socket buffer before closing.
+    void refuse(tcp::socket &socket) {
+        static constexpr std::string_view response =
+                "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 5\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        beast::error_code ec;
+        socket.non_blocking(true, ec);
+        socket.write_some(net::buffer(response), ec);
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+        socket.close(ec);
+    }
+
+#ifdef SO_REUSEPORT
+    using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+    constexpr bool reuse_port_supported = true;
+#else
+    constexpr bool reuse_port_supported = false;
+#endif
+
+    std::unique_ptr<tcp::acceptor> make_acceptor(net::io_context &ioc, unsigned short port, bool share_port) {
+        const tcp::endpoint endpoint{tcp::v4(), port};
+        auto acceptor = std::make_unique<tcp::acceptor>(ioc);
+        acceptor->open(endpoint.protocol());
+        acceptor->set_option(net::socket_base::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (share_port) {
+            acceptor->set_option(reuse_port(true));
+        }
+#else
+        (void) share_port;
+#endif
+        acceptor->bind(endpoint);
+        acceptor->listen(net::socket_base::max_listen_connections);
+        return acceptor;
+    }
+}
+
+WSServer::WSServer(IoContextPool &pool, unsigned short port, WSServerOptions options)
+    : pool_(pool),
+      options_(options),
+      ingest_queue_(options.ingest_workers) {
+    const auto &pool_options = pool_.getOptions();
+    per_shard_acceptors_ = pool_options.sharded && pool_options.reuse_port && reuse_port_supported;
+    if (pool_options.sharded && pool_options.reuse_port && !reuse_port_supported) {
+        LOG_WARN("WSServer", "SO_REUSEPORT not available, accepting on shard 0 and handing off round-robin");
+    }
+
+    if (per_shard_acceptors_) {
+        for (std::size_t i = 0; i < pool_.size(); ++i) {
+            acceptors_.emplace_back(make_acceptor(pool_.getContext(i), port, true));
+        }
+    } else {
+        acceptors_.emplace_back(make_acceptor(pool_.getContext(0), port, false));
+    }
+}
+
+WSServer::~WSServer() {
+    stop();
 }
 
 void WSServer::run() {
-    net::spawn(acceptor_.get_executor(), [this](net::yield_context yield) {
-        this->do_accept(yield);
+    ingest_queue_.start([this](std::shared_ptr<Session> session, const std::string &message) {
+        if (on_message_callback_) {
+            on_message_callback_(session, message);
+        }
     });
+
+    for (auto &acceptor: acceptors_) {
+        net::co_spawn(acceptor->get_executor(), do_accept(*acceptor), net::detached);
+    }
+}
+
+void WSServer::stop() {
+    ingest_queue_.stop();
 }
 
-void WSServer::broadcast(const std::string &message) {
+void WSServer::broadcast(const std::string &message, const bool is_json) {
     auto const shared_msg = std::make_shared<const std::string>(message);
-    std::list<std::shared_ptr<Session>> sessions_copy;
-    {
-        std::lock_guard<std::mutex> lock(sessions_mutex_);
-        sessions_copy = sessions_;
-    }
-    for (auto const& session : sessions_copy) {
-        session->send(*shared_msg);
-    }
+    sessions_.forEach([&shared_msg, is_json](const std::shared_ptr<Session> &session) {
+        session->send(shared_msg, is_json);
+    });
+}
+
+std::vector<std::shared_ptr<Session> > WSServer::getSessions() {
+    std::vector<std::shared_ptr<Session> > sessions;
+    sessions.reserve(sessions_.size());
+    sessions_.forEach([&sessions](const std::shared_ptr<Session> &session) {
+        sessions.push_back(session);
+    });
+    return sessions;
+}
+
+std::size_t WSServer::getSessionCount() const {
+    return sessions_.size();
+}
+
+const CompressionOptions &WSServer::getCompressionOptions() const {
+    return options_.compression;
+}
+
+std::size_t WSServer::getIngestDepth() const {
+    return ingest_queue_.depth();
+}
+
+const AdmissionOptions &WSServer::getAdmissionOptions() const {
+    return options_.admission;
+}
+
+std::size_t WSServer::getOpenConnectionCount() const {
+    return open_connections_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t WSServer::getRejectedConnectionCount() const {
+    return rejected_connections_.load(std::memory_order_relaxed);
+}
+
+std::size_t WSServer::getRejectingConnectionCount() const {
+    return rejecting_connections_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t WSServer::getRefusedConnectionCount() const {
+    return refused_connections_.load(std::memory_order_relaxed);
+}
+
+TrafficTotals WSServer::getTrafficTotals() {
+    TrafficTotals totals;
+    totals.payload_bytes_in = retired_payload_in_.load(std::memory_order_relaxed);
+    totals.payload_bytes_out = retired_payload_out_.load(std::memory_order_relaxed);
+    totals.wire_bytes_in = retired_wire_in_.load(std::memory_order_relaxed);
+    totals.wire_bytes_out = retired_wire_out_.load(std::memory_order_relaxed);
+    sessions_.forEach([&totals](const std::shared_ptr<Session> &session) {
+        const auto &stats = session->get_compression_stats();
+        totals.payload_bytes_in += stats.payload_bytes_in.load(std::memory_order_relaxed);
+        totals.payload_bytes_out += stats.payload_bytes_out.load(std::memory_order_relaxed);
+        totals.wire_bytes_in += stats.wire_bytes_in.load(std::memory_order_relaxed);
+        totals.wire_bytes_out += stats.wire_bytes_out.load(std::memory_order_relaxed);
+    });
+    return totals;
+}
+
+TrafficRecorder &WSServer::getRecorder() {
+    return recorder_;
 }
 
 void WSServer::setOnConnectCallback(std::function<void(std::shared_ptr<Session>)> on_connect_callback) {
@@ -41,37 +175,87 @@ void WSServer::setOnMessageCallback(std::function<void(std::shared_ptr<Session>,
     on_message_callback_ = std::move(on_message_callback);
 }
 
-void WSServer::do_accept(boost::asio::yield_context yield) {
+void WSServer::setHttpHandler(HttpHandler http_handler) {
+    http_handler_ = std::move(http_handler);
+}
+
+boost::asio::any_io_executor WSServer::make_session_executor(tcp::acceptor &acceptor) {
+    // Sharded: a single-threaded io_context already serialises the session's handlers.
+    // Shared: several threads run the context, so each session gets its own strand.
+    if (pool_.getOptions().sharded) {
+        if (per_shard_acceptors_) {
+            return acceptor.get_executor();
+        }
+        return pool_.getNextContext().get_executor();
+    }
+    return net::make_strand(pool_.getContext(0));
+}
+
+net::awaitable<void> WSServer::do_accept(tcp::acceptor &acceptor) {
     beast::error_code ec;
     for (;;) {
-        tcp::socket socket(ioc_);
-        acceptor_.async_accept(socket, yield[ec]);
+        tcp::socket socket(make_session_executor(acceptor));
+        co_await acceptor.async_accept(socket, net::redirect_error(net::use_awaitable, ec));
         if (ec) {
-            std::cerr << "Accept failed: " << ec.message() << std::endl;
+            LOG_ERROR("WSServer", "Accept failed: ", ec.message());
+        } else if (open_connections_.load(std::memory_order_relaxed) >= options_.admission.max_connections) {
+            rejected_connections_.fetch_add(1, std::memory_order_relaxed);
+            if (rejecting_connections_.fetch_add(1, std::memory_order_relaxed) < options_.admission.max_rejecting) {
+                LOG_WARN("WSServer", "At capacity (", options_.admission.max_connections, " connections), rejecting ",
+                         socket.remote_endpoint(ec));
+                auto executor = socket.get_executor();
+                net::co_spawn(executor, do_reject(std::move(socket)), net::detached);
+            } else {
+                rejecting_connections_.fetch_sub(1, std::memory_order_relaxed);
+                refused_connections_.fetch_add(1, std::memory_order_relaxed);
+                refuse(socket);
+            }
         } else {
+            open_connections_.fetch_add(1, std::memory_order_relaxed);
             auto session = Session::create(std::move(socket), *this);
-            net::spawn(acceptor_.get_executor(), [session](net::yield_context yield) {
-                session->run(yield);
-            });
+            // The lambda owns the session for as long as the coroutine runs.
+            net::co_spawn(session->ws_.get_executor(), [session] { return session->run(); }, net::detached);
         }
     }
 }
 
-void WSServer::join(std::shared_ptr<Session> session) {
-    {
-        std::lock_guard<std::mutex> lock(sessions_mutex_);
-        sessions_.emplace_back(session);
+net::awaitable<void> WSServer::do_reject(tcp::socket socket) {
+    // No Session, no deflate and a tiny message limit: just enough to tell the client to back off.
+    websocket::stream<tcp::socket> ws(std::move(socket));
+    websocket::stream_base::timeout timeout{};
+    timeout.handshake_timeout = reject_timeout;
+    timeout.idle_timeout = websocket::stream_base::none();
+    ws.set_option(timeout);
+    ws.read_message_max(512);
+
+    beast::error_code ec;
+    co_await ws.async_accept(net::redirect_error(net::use_awaitable, ec));
+    if (!ec) {
+        co_await ws.async_close(websocket::close_reason(websocket::close_code::try_again_later, "server at capacity"),
+                                net::redirect_error(net::use_awaitable, ec));
     }
+    rejecting_connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void WSServer::join(std::shared_ptr<Session> session) {
+    // The CLI reads ids while iterating a shard from its own thread; set it under that lock.
+    sessions_.insert(session, [](const SessionRegistry::Id id, const std::shared_ptr<Session> &inserted) {
+        inserted->session_id_ = id;
+    });
     if (on_connect_callback_) {
         on_connect_callback_(session);
     }
 }
 
 void WSServer::leave(std::shared_ptr<Session> session) {
-    {
-        std::lock_guard<std::mutex> lock(sessions_mutex_);
-        sessions_.remove(session);
-    }
+    sessions_.remove(session->session_id_);
     if (on_disconnect_callback_) {
         on_disconnect_callback_(session);}
-}
\ No newline at end of file
+}
+
+void WSServer::retireTraffic(const CompressionStats &stats) {
+    retired_payload_in_.fetch_add(stats.payload_bytes_in.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    retired_payload_out_.fetch_add(stats.payload_bytes_out.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    retired_wire_in_.fetch_add(stats.wire_bytes_in.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    retired_wire_out_.fetch_add(stats.wire_bytes_out.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
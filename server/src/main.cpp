@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -12,9 +13,22 @@
 #include "MetricStore.h"
 #include "ClientData.h"
 #include "ServerCLI.h"
+#include "ServerStats.h"
+#include "HttpQueryApi.h"
+#include "PrometheusExporter.h"
+#include "SubscriptionManager.h"
+#include "CommandLine.h"
+#include "CompressionOptions.h"
+#include "Iso8601.h"
+#include "Logger.h"
 
 #include <nlohmann/json.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 using json = nlohmann::json;
 namespace net = boost::asio;
@@ -23,109 +37,279 @@ std::map<std::string, std::shared_ptr<MetricStore>> g_client_stores;
 std::mutex g_stores_mutex;
 std::atomic<bool> g_shutdown_flag{false};
 
-std::chrono::system_clock::time_point parse_iso8601(const std::string& iso_str) {
-    std::tm tm = {};
-    std::stringstream ss(iso_str);
-    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
-    return std::chrono::system_clock::from_time_t(std::mktime(&tm));
-}
+// Periodically stores the server's own ingest counters as the reserved client, so they can be
+// shown, queried, scraped and subscribed to like any other client's metrics.
+net::awaitable<void> report_self_stats(WSServer &server, ServerStats &stats, SubscriptionManager &subscriptions,
+                                       std::chrono::seconds interval) {
+    std::shared_ptr<MetricStore> store;
+    {
+        std::lock_guard<std::mutex> lock(g_stores_mutex);
+        auto &entry = g_client_stores[ServerStats::reserved_client_id];
+        if (!entry) {
+            entry = std::make_shared<MetricStore>();
+        }
+        store = entry;
+    }
+    MetricStore::SeriesCache series;
+
+    auto previous = stats.snapshot();
+    auto previous_traffic = server.getTrafficTotals();
+    net::steady_timer timer(co_await net::this_coro::executor);
+    boost::system::error_code ec;
+    for (;;) {
+        timer.expires_after(interval);
+        co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+
+        const auto current = stats.snapshot();
+        const auto traffic = server.getTrafficTotals();
+        const double seconds = std::chrono::duration<double>(current.taken - previous.taken).count();
+        const auto rate = [seconds](std::uint64_t now, std::uint64_t before) {
+            return seconds > 0 && now > before ? static_cast<double>(now - before) / seconds : 0.0;
+        };
+
+        std::size_t write_queue_max = 0;
+        const auto sessions = server.getSessions();
+        for (const auto &session: sessions) {
+            write_queue_max = std::max(write_queue_max, session->get_write_queue_depth());
+        }
+
+        ClientData data;
+        data.clientId = ServerStats::reserved_client_id;
+        data.clientIp = "127.0.0.1";
+        data.timestamp = std::chrono::system_clock::now();
+        data.metrics = {
+            {"Messages/sec", rate(current.messages, previous.messages)},
+            {"Samples/sec", rate(current.samples, previous.samples)},
+            {"Rejected Messages", static_cast<double>(current.rejected)},
+            {"Parse p99 (us)", current.parse_ns.p99 / 1000.0},
+            {"Store p99 (us)", current.store_ns.p99 / 1000.0},
+            {"Ingest Queue Depth", static_cast<double>(server.getIngestDepth())},
+            {"Open Connections", static_cast<double>(server.getOpenConnectionCount())},
+            {"Rejecting Connections", static_cast<double>(server.getRejectingConnectionCount())},
+            {"Write Queue Max", static_cast<double>(write_queue_max)},
+            {"Wire Bytes In/sec", rate(traffic.wire_bytes_in, previous_traffic.wire_bytes_in)},
+            {"Wire Bytes Out/sec", rate(traffic.wire_bytes_out, previous_traffic.wire_bytes_out)},
+        };
+        store->addData(data, series);
+        subscriptions.publish(data);
 
+        previous = current;
+        previous_traffic = traffic;
+    }
+}
 
-int main() {
+int main(int argc, char *argv[]) {
     std::cout << "--- WebSocket Performance Monitor Server ---\n";
-    unsigned short port = 6969;
-    int threads = 4;
+    const CommandLine cl(argc, argv);
+    Logger::configure(LogOptions::fromCommandLine(cl));
+    const auto port = static_cast<unsigned short>(cl.getInt("port", 6969));
+    const auto pool_options = IoContextPoolOptions::fromCommandLine(cl);
+    WSServerOptions server_options;
+    server_options.admission = AdmissionOptions::fromCommandLine(cl);
+    server_options.compression = CompressionOptions::fromCommandLine(cl);
+    server_options.flow_control = FlowControlOptions::fromCommandLine(cl);
+    server_options.write_queue = WriteQueueOptions::fromCommandLine(cl);
+    server_options.ingest_workers = static_cast<std::size_t>(cl.getInt("ingest-workers", 2));
+    const auto self_stats_interval = std::chrono::seconds(cl.getInt("self-stats-interval", 5));
+    const auto record_path = cl.getString("record");
+    const auto &compression = server_options.compression;
     std::cout << "\nConfiguration set:" << std::endl;
     std::cout << "  - Listening on Port: " << port << std::endl;
-    std::cout << "  - Worker Threads:    " << threads << std::endl;
+    std::cout << "  - Worker Threads:    " << pool_options.threads
+            << (pool_options.sharded ? " (one io_context per thread)" : " (shared io_context)") << std::endl;
+    std::cout << "  - Max Connections:   " << server_options.admission.max_connections << std::endl;
+    std::cout << "  - Compression:       " << (compression.enabled ? "permessage-deflate" : "off") << std::endl;
+    std::cout << "  - Ingest Workers:    " << server_options.ingest_workers << std::endl;
+    std::cout << "  - Flow Control:      " << (server_options.flow_control.enabled ? "credits" : "off") << std::endl;
     std::cout << "-------------------------------------------\n" << std::endl;
 
     try {
-        net::io_context ioc{threads};
-        WSServer server(ioc, port);
-        ServerCLI cli(g_client_stores, g_shutdown_flag);
+        IoContextPool pool(pool_options);
+        WSServer server(pool, port, server_options);
+        ServerStats stats;
+        ServerCLI cli(g_client_stores, server, stats, g_shutdown_flag);
+        HttpQueryApi query_api(g_client_stores, g_stores_mutex);
+        PrometheusExporter exporter(g_client_stores, g_stores_mutex);
+        SubscriptionManager subscriptions(pool.getContext(0),
+                                          static_cast<std::size_t>(cl.getInt("max-subscriptions", 64)));
+
 
+        server.setHttpHandler([&query_api, &exporter](const HttpRequest &request) {
+            const auto target = request.target();
+            if (target == "/metrics" || target.starts_with("/metrics?")) {
+                return exporter.handle(request);
+            }
+            return query_api.handle(request);
+        });
 
         server.setOnConnectCallback([](std::shared_ptr<Session> session) {
-            std::cout << "\n[Server] Client connected: " << session->get_remote_endpoint() << std::endl;
+            LOG_INFO("Server", "Client connected: ", session->get_remote_endpoint());
         });
 
-        server.setOnDisconnectCallback([](std::shared_ptr<Session> /*session*/) {
-            std::cout << "[Server] Client disconnected." << std::endl;
+        server.setOnDisconnectCallback([&subscriptions](std::shared_ptr<Session> session) {
+            subscriptions.removeSession(session->get_id());
+            LOG_INFO("Server", "Client disconnected.");
         });
 
-        server.setOnMessageCallback([&cli](std::shared_ptr<Session> session, const std::string& msg) {
-            try {
-                json data = json::parse(msg);
+        auto ingest_sample = [&cli, &subscriptions, &stats](const std::shared_ptr<Session> &session,
+                                                            const json &data) {
+            ClientData received_data;
+            received_data.clientId = data.at("clientId").get<std::string>();
+            if (received_data.clientId == ServerStats::reserved_client_id) {
+                throw std::invalid_argument("clientId is reserved for the server");
+            }
+            received_data.clientIp = session->get_remote_endpoint().address().to_string();
+            received_data.timestamp = parse_iso8601(data.at("timestamp").get<std::string>());
+            received_data.metrics = data.at("counters").get<std::vector<MetricDataPoint>>();
+            received_data.maxSilence = std::chrono::milliseconds(data.value("max_silence_ms", std::int64_t{0}));
+
+            // Sessions almost always speak for one client, so the registry lookup only happens
+            // when the clientId differs from the one the session is bound to.
+            auto &binding = session->get_store_binding();
+            if (!binding.store || binding.client_id != received_data.clientId) {
+                std::lock_guard<std::mutex> lock(g_stores_mutex);
+                auto it = g_client_stores.find(received_data.clientId);
+                if (it == g_client_stores.end()) {
+                    it = g_client_stores.emplace(received_data.clientId, std::make_shared<MetricStore>()).first;
+                }
+                binding.client_id = received_data.clientId;
+                binding.store = it->second;
+                binding.series.clear();
+            }
+
+            auto &counters = stats.local();
+            const auto store_start = std::chrono::steady_clock::now();
+            binding.store->addData(received_data, binding.series);
+            counters.store_ns.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - store_start).count()));
+            ServerStats::ThreadCounters::bump(counters.samples);
+            subscriptions.publish(received_data);
+            cli.postDataReceived(received_data.clientId, received_data.metrics.size());
+        };
 
-                ClientData received_data;
-                received_data.clientId = data.at("clientId").get<std::string>();
-                received_data.clientIp = session->get_remote_endpoint().address().to_string();
-                received_data.timestamp = parse_iso8601(data.at("timestamp").get<std::string>());
-                received_data.metrics = data.at("counters").get<std::vector<MetricDataPoint>>();
-
-                std::shared_ptr<MetricStore> client_store;
-                {
-                    std::lock_guard<std::mutex> lock(g_stores_mutex);
-                    auto it = g_client_stores.find(received_data.clientId);
-                    if (it == g_client_stores.end()) {
-                        client_store = std::make_shared<MetricStore>();
-                        g_client_stores[received_data.clientId] = client_store;
+        // Samples carrying an "ack" token are acknowledged once processed, stored or not, so a
+        // client never resends a sample the server will keep refusing; rejected counts the
+        // samples of the message that could not be stored. stored_ns is the server's monotonic
+        // clock, which load generators on the same host can compare with.
+        auto ingest_batch = [&ingest_sample, &stats](const std::shared_ptr<Session> &session, const json &data) {
+            std::vector<json> acks;
+            std::size_t rejected = 0;
+            const auto ingest_one = [&](const json &sample) {
+                if (sample.is_object()) {
+                    if (const auto ack = sample.find("ack"); ack != sample.end()) {
+                        acks.push_back(*ack);
+                    }
+                }
+                try {
+                    ingest_sample(session, sample);
+                } catch (const std::exception &e) {
+                    ++rejected;
+                    ServerStats::ThreadCounters::bump(stats.local().rejected);
+                    LOG_WARN("Server", "Rejected sample: ", e.what());
+                }
+            };
+
+            // Clients batch samples into an array while they are out of flow-control credits;
+            // when the queued messages are arrays themselves they arrive nested one level.
+            if (data.is_array()) {
+                for (const auto &sample: data) {
+                    if (sample.is_array()) {
+                        for (const auto &inner: sample) {
+                            ingest_one(inner);
+                        }
                     } else {
-                        client_store = it->second;
+                        ingest_one(sample);
                     }
                 }
+            } else {
+                ingest_one(data);
+            }
+
+            for (const auto &ack: acks) {
+                const json reply = {
+                    {"type", "ack"},
+                    {"ack", ack},
+                    {"rejected", rejected},
+                    {"stored_ns", std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count()}
+                };
+                session->send_control(reply.dump());
+            }
+        };
 
-                client_store->addData(received_data);
+        server.setOnMessageCallback([&ingest_batch, &subscriptions, &stats](std::shared_ptr<Session> session,
+                                                                             const std::string& msg) {
+            auto &counters = stats.local();
+            ServerStats::ThreadCounters::bump(counters.messages);
+            ServerStats::ThreadCounters::bump(counters.bytes, msg.size());
+            try {
+                const auto parse_start = std::chrono::steady_clock::now();
+                json data = json::parse(msg);
+                counters.parse_ns.record(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - parse_start).count()));
 
-                std::stringstream ss;
-                ss << "[Real-time] Data received from " << received_data.clientId
-                   << " (" << received_data.metrics.size() << " metrics)";
-                cli.postMessage(ss.str());
+                SubscriptionRequest request;
+                if (SubscriptionRequest::fromJson(data, request)) {
+                    subscriptions.handle(session, request);
+                    return;
+                }
 
+                ingest_batch(session, data);
             } catch (const std::exception& e) {
-                std::cerr << "[Error] Failed to process message: " << e.what() << std::endl;
+                ServerStats::ThreadCounters::bump(counters.rejected);
+                LOG_WARN("Server", "Failed to process message: ", e.what());
             }
         });
 
 
-        boost::asio::signal_set signals(ioc, SIGINT, SIGTERM);
+        boost::asio::signal_set signals(pool.getContext(0), SIGINT, SIGTERM);
         signals.async_wait([&](boost::system::error_code /*ec*/, int /*signum*/) {
-            std::cout << "\nSignal received. Initiating shutdown..." << std::endl;
+            LOG_INFO("Server", "Signal received. Initiating shutdown...");
             g_shutdown_flag = true;
         });
 
-        std::thread shutdown_checker([&ioc]() {
+        std::thread shutdown_checker([&pool]() {
             while (!g_shutdown_flag) {
                 std::this_thread::sleep_for(std::chrono::milliseconds(250));
             }
-            ioc.stop();
+            pool.stop();
         });
 
 
+        if (!record_path.empty()) {
+            std::string error;
+            if (!server.getRecorder().start(record_path, error)) {
+                LOG_ERROR("Main", "Recording disabled: ", error);
+            }
+        }
         server.run();
+        subscriptions.start();
+        if (self_stats_interval.count() > 0) {
+            net::co_spawn(pool.getContext(0),
+                          report_self_stats(server, stats, subscriptions, self_stats_interval), net::detached);
+        }
         cli.run();
 
         std::cout << ">>> Server is running. Type 'help' for commands. Press Ctrl+C to exit. <<<\n" << std::endl;
 
-        std::vector<std::thread> v;
-        v.reserve(threads - 1);
-        for(auto i = threads - 1; i > 0; --i) {
-            v.emplace_back([&ioc] { ioc.run(); });
-        }
-        ioc.run();
+        pool.run();
+        pool.join();
 
         std::cout << "Asio event loop stopped. Waiting for threads to join..." << std::endl;
-        for(auto& t : v) {
-            t.join();
-        }
+        server.stop();
         shutdown_checker.join();
 
     } catch (const std::exception& e) {
         std::cerr << "Fatal Error: " << e.what() << std::endl;
+        Logger::shutdown();
         return 1;
     }
 
+    Logger::shutdown();
     std::cout << "Shutdown complete." << std::endl;
     return 0;
 }
\ No newline at end of file